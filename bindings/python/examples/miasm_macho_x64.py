@@ -55,6 +55,10 @@ class MiasmVM(pyqbdl.TargetMemory):
     def write(self, ptr, data):
         self.vm.set_mem(ptr, bytes(data))
 
+    def write_many(self, writes):
+        for ptr, data in writes:
+            self.vm.set_mem(ptr, bytes(data))
+
     def read(self, ptr, size):
         return self.vm.get_mem(ptr, size)
 ##end_target_memory
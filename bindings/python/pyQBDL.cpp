@@ -4,7 +4,9 @@
 
 #include "QBDL/Engine.hpp"
 #include "QBDL/Loader.hpp"
+#include "QBDL/Namespace.hpp"
 #include "QBDL/arch.hpp"
+#include "QBDL/engines/Cached.hpp"
 #include "QBDL/engines/Native.hpp"
 #include "QBDL/loaders/MachO.hpp"
 #include "QBDL/loaders/ELF.hpp"
@@ -12,6 +14,7 @@
 
 #include <pybind11/functional.h>
 #include <pybind11/operators.h>
+#include <pybind11/stl.h>
 
 #include <stdexcept>
 
@@ -31,6 +34,38 @@ struct PyTargetMemory: public TargetMemory
       ptr, len);
   }
 
+  uint64_t reserve(uint64_t ptr, size_t len) override {
+    PYBIND11_OVERRIDE(
+      uint64_t,
+      TargetMemory,
+      reserve,
+      ptr, len);
+  }
+
+  bool commit(uint64_t ptr, size_t len, int prot) override {
+    PYBIND11_OVERRIDE(
+      bool,
+      TargetMemory,
+      commit,
+      ptr, len, prot);
+  }
+
+  void release(uint64_t ptr, size_t len) override {
+    PYBIND11_OVERRIDE(
+      void,
+      TargetMemory,
+      release,
+      ptr, len);
+  }
+
+  bool concurrent_access() const override {
+    PYBIND11_OVERRIDE(
+      bool,
+      TargetMemory,
+      concurrent_access,
+      );
+  }
+
   bool mprotect(uint64_t ptr, size_t len, int flags) override {
     PYBIND11_OVERRIDE_PURE(
       bool,
@@ -63,6 +98,48 @@ struct PyTargetMemory: public TargetMemory
     }
     memcpy(out, retbuf, len);
   }
+
+  void write_batch(std::vector<WriteSpan> const& spans) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "write_many");
+    if (!pyfunc) {
+      // Fall back to one write() call per span
+      return TargetMemory::write_batch(spans);
+    }
+    py::list writes;
+    for (const WriteSpan& span: spans) {
+      auto view = py::memoryview::from_buffer(reinterpret_cast<uint8_t const*>(span.buf),
+          { static_cast<ssize_t>(span.len) }, { 1 });
+      writes.append(py::make_tuple(span.addr, view));
+    }
+    pyfunc(writes);
+  }
+
+  void read_batch(std::vector<ReadSpan> const& spans) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "read_many");
+    if (!pyfunc) {
+      // Fall back to one read() call per span
+      return TargetMemory::read_batch(spans);
+    }
+    py::list reads;
+    for (const ReadSpan& span: spans) {
+      reads.append(py::make_tuple(span.addr, span.len));
+    }
+    py::sequence ret = pyfunc(reads);
+    if (ret.size() != spans.size()) {
+      throw std::range_error{"invalid number of read buffers"};
+    }
+    for (size_t i = 0; i < spans.size(); ++i) {
+      py::bytes data = ret[i];
+      char* retbuf; ssize_t retlen = 0;
+      PYBIND11_BYTES_AS_STRING_AND_SIZE(data.ptr(), &retbuf, &retlen);
+      if (static_cast<size_t>(retlen) != spans[i].len) {
+        throw std::range_error{"invalid read length"};
+      }
+      memcpy(spans[i].buf, retbuf, spans[i].len);
+    }
+  }
 };
 
 struct PyTargetSystem: public TargetSystem
@@ -79,6 +156,16 @@ struct PyTargetSystem: public TargetSystem
       &loader, &sym);
   }
 
+  uint64_t symlink_versioned(Loader& loader, LIEF::Symbol const& sym,
+                             std::string const& version) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "symlink_versioned");
+    if (!pyfunc) {
+      return TargetSystem::symlink_versioned(loader, sym, version);
+    }
+    return pyfunc(&loader, &sym, version).cast<uint64_t>();
+  }
+
   bool supports(LIEF::Binary const& bin) override {
     PYBIND11_OVERRIDE_PURE(
       bool,
@@ -94,6 +181,75 @@ struct PyTargetSystem: public TargetSystem
       base_address_hint,
       binary_base_address, virtual_size);
   }
+
+  bool supports_arch(Arch const& arch) override {
+    PYBIND11_OVERRIDE(
+      bool,
+      TargetSystem,
+      supports_arch,
+      arch);
+  }
+
+  uint64_t resolve_ifunc(Loader& loader, uint64_t resolver) override {
+    // The loader is given by pointer, as it can't be copied
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "resolve_ifunc");
+    if (!pyfunc) {
+      return TargetSystem::resolve_ifunc(loader, resolver);
+    }
+    return pyfunc(&loader, resolver).cast<uint64_t>();
+  }
+
+  TlsModule tls_register(Loader& loader, TlsImage const& image) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "tls_register");
+    if (!pyfunc) {
+      return TargetSystem::tls_register(loader, image);
+    }
+    return pyfunc(&loader, image).cast<TlsModule>();
+  }
+
+  void tls_unregister(Loader& loader, TlsModule const& module) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "tls_unregister");
+    if (!pyfunc) {
+      return TargetSystem::tls_unregister(loader, module);
+    }
+    pyfunc(&loader, module);
+  }
+
+  uint64_t delay_load_helper(Loader& loader) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "delay_load_helper");
+    if (!pyfunc) {
+      return TargetSystem::delay_load_helper(loader);
+    }
+    return pyfunc(&loader).cast<uint64_t>();
+  }
+
+  std::string prelink_cache_dir() override {
+    PYBIND11_OVERRIDE(
+      std::string,
+      TargetSystem,
+      prelink_cache_dir,
+      );
+  }
+
+  unsigned relocation_threads() override {
+    PYBIND11_OVERRIDE(
+      unsigned,
+      TargetSystem,
+      relocation_threads,
+      );
+  }
+
+  bool cache_relocation_plans() override {
+    PYBIND11_OVERRIDE(
+      bool,
+      TargetSystem,
+      cache_relocation_plans,
+      );
+  }
 };
 
 struct PyNativeTargetSystem: public Engines::Native::TargetSystem {
@@ -108,6 +264,85 @@ struct PyNativeTargetSystem: public Engines::Native::TargetSystem {
       symlink,
       &loader, &sym);
   }
+
+  uint64_t symlink_versioned(Loader& loader, LIEF::Symbol const& sym,
+                             std::string const& version) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "symlink_versioned");
+    if (!pyfunc) {
+      return Engines::Native::TargetSystem::symlink_versioned(loader, sym, version);
+    }
+    return pyfunc(&loader, &sym, version).cast<uint64_t>();
+  }
+
+  bool supports_arch(Arch const& arch) override {
+    PYBIND11_OVERRIDE(
+      bool,
+      Engines::Native::TargetSystem,
+      supports_arch,
+      arch);
+  }
+
+  uint64_t resolve_ifunc(Loader& loader, uint64_t resolver) override {
+    // The loader is given by pointer, as it can't be copied
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "resolve_ifunc");
+    if (!pyfunc) {
+      return Engines::Native::TargetSystem::resolve_ifunc(loader, resolver);
+    }
+    return pyfunc(&loader, resolver).cast<uint64_t>();
+  }
+
+  TlsModule tls_register(Loader& loader, TlsImage const& image) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "tls_register");
+    if (!pyfunc) {
+      return Engines::Native::TargetSystem::tls_register(loader, image);
+    }
+    return pyfunc(&loader, image).cast<TlsModule>();
+  }
+
+  void tls_unregister(Loader& loader, TlsModule const& module) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "tls_unregister");
+    if (!pyfunc) {
+      return Engines::Native::TargetSystem::tls_unregister(loader, module);
+    }
+    pyfunc(&loader, module);
+  }
+
+  uint64_t delay_load_helper(Loader& loader) override {
+    pybind11::gil_scoped_acquire gil;
+    pybind11::function pyfunc = pybind11::get_override(this, "delay_load_helper");
+    if (!pyfunc) {
+      return Engines::Native::TargetSystem::delay_load_helper(loader);
+    }
+    return pyfunc(&loader).cast<uint64_t>();
+  }
+
+  std::string prelink_cache_dir() override {
+    PYBIND11_OVERRIDE(
+      std::string,
+      Engines::Native::TargetSystem,
+      prelink_cache_dir,
+      );
+  }
+
+  unsigned relocation_threads() override {
+    PYBIND11_OVERRIDE(
+      unsigned,
+      Engines::Native::TargetSystem,
+      relocation_threads,
+      );
+  }
+
+  bool cache_relocation_plans() override {
+    PYBIND11_OVERRIDE(
+      bool,
+      Engines::Native::TargetSystem,
+      cache_relocation_plans,
+      );
+  }
 };
 
 } // anonymous
@@ -163,21 +398,111 @@ void pyinit_arch(py::module &m) {
 }
 
 void pyinit_engine(py::module &m) {
-  py::class_<TargetMemory, PyTargetMemory>(m, "TargetMemory", "Memory model of the targeted system")
+  py::class_<TargetMemory, PyTargetMemory> pymem(m, "TargetMemory",
+      R"pbdoc(
+      Memory model of the targeted system
+
+      Subclasses can optionally implement ``write_many(writes)`` and
+      ``read_many(reads)`` to receive the many small accesses done by the
+      loaders (relocations, bindings, ...) with a single Python call:
+
+      * ``writes`` is a list of ``(address, memoryview)`` tuples, that must be
+        written in order;
+      * ``reads`` is a list of ``(address, length)`` tuples, and ``read_many``
+        must return a list of ``bytes`` objects of the same lengths.
+
+      The memory views are only valid during the call. If these methods are not
+      implemented, :meth:`~.TargetMemory.write` and :meth:`~.TargetMemory.read`
+      are called for each access.
+      )pbdoc");
+  py::enum_<TargetMemory::PROT>(pymem, "PROT", py::arithmetic(),
+      "Memory protection flags given to :meth:`~.TargetMemory.mprotect`")
+      .value("NONE", TargetMemory::NONE, "Memory can't be accessed")
+      .value("READ", TargetMemory::READ, "Memory can be read")
+      .value("WRITE", TargetMemory::WRITE, "Memory can be written")
+      .value("EXEC", TargetMemory::EXEC, "Memory can be executed");
+
+  pymem
     .def(py::init<>())
     .def("mmap", &TargetMemory::mmap,
         "Function used by the loaders to allocate memory pages",
         "ptr"_a, "len"_a)
+    .def("reserve", &TargetMemory::reserve,
+        R"pbdoc(
+        Function used by the loaders to reserve the address range of a whole
+        binary. Only the loaded parts of this range are then committed with
+        :meth:`~.TargetMemory.commit`.
+
+        Defaults to :meth:`~.TargetMemory.mmap`.
+        )pbdoc",
+        "ptr"_a, "len"_a)
+    .def("commit", &TargetMemory::commit,
+        R"pbdoc(
+        Function used by the loaders to back a range previously reserved with
+        :meth:`~.TargetMemory.reserve` with zero-filled, writable memory.
+        ``prot`` is the protection the range will eventually have.
+
+        Does nothing by default.
+        )pbdoc",
+        "addr"_a, "len"_a, "prot"_a)
+    .def("release", &TargetMemory::release,
+        R"pbdoc(
+        Function used by the loaders to release the memory of a binary when
+        they are destroyed.
+
+        Does nothing by default.
+        )pbdoc",
+        "addr"_a, "len"_a)
     .def("mprotect", &TargetMemory::mprotect,
-        "Function used by the loaders to change permissions on a memory area",
+        R"pbdoc(
+        Function used by the loaders to change permissions on a memory area,
+        once the binary has been relocated.
+
+        ``prot`` is a combination of :class:`~.TargetMemory.PROT` flags.
+        )pbdoc",
         "addr"_a, "len"_a, "prot"_a)
     .def("write", &TargetMemory::write,
         "Function used by the loader to write data in memory")
     .def("read", &TargetMemory::read,
         "Function used by the loaders to read data from memory")
+    .def("concurrent_access", &TargetMemory::concurrent_access,
+        R"pbdoc(
+        Function that returns whether :meth:`~.TargetMemory.read` and
+        :meth:`~.TargetMemory.write` can be called from several threads at
+        once (see :meth:`~.TargetSystem.relocation_threads`).
+
+        Returns ``False`` by default.
+        )pbdoc")
     ;
 
-  py::class_<TargetSystem, PyTargetSystem>(m, "TargetSystem")
+  py::class_<TargetSystem, PyTargetSystem> pysystem(m, "TargetSystem");
+  py::class_<TargetSystem::TlsImage>(pysystem, "TlsImage",
+      "Thread-local storage template of an image, given to :meth:`~.TargetSystem.tls_register`")
+    .def(py::init<>())
+    .def_readwrite("init_addr", &TargetSystem::TlsImage::init_addr,
+        "Absolute address of the initialization image")
+    .def_readwrite("init_size", &TargetSystem::TlsImage::init_size,
+        "Size of the initialization image")
+    .def_readwrite("size", &TargetSystem::TlsImage::size,
+        "Size of a block (the rest is zero-filled)")
+    .def_readwrite("align", &TargetSystem::TlsImage::align,
+        "Alignment of a block")
+    .def_readwrite("static_block", &TargetSystem::TlsImage::static_block,
+        "Whether the image uses the static TLS models and needs a static block");
+  py::class_<TargetSystem::TlsModule>(pysystem, "TlsModule",
+      "Thread-local storage module of an image, returned by :meth:`~.TargetSystem.tls_register`")
+    .def(py::init<>())
+    .def_readwrite("id", &TargetSystem::TlsModule::id,
+        "Module id, 0 if the image has no module")
+    .def_readwrite("get_addr", &TargetSystem::TlsModule::get_addr,
+        "Address ``__tls_get_addr`` is bound to, or 0 to resolve it with :meth:`~.TargetSystem.symlink`")
+    .def_readwrite("tlsdesc", &TargetSystem::TlsModule::tlsdesc,
+        "Address of the TLSDESC resolver, or 0 if TLS descriptors are not supported")
+    .def_readwrite("static_block", &TargetSystem::TlsModule::static_block,
+        "Whether the block of each thread is at ``tp_offset`` from its thread pointer")
+    .def_readwrite("tp_offset", &TargetSystem::TlsModule::tp_offset,
+        "Offset of the static block from the thread pointer");
+  pysystem
     .def(py::init<TargetMemory&>(), py::keep_alive<1,2>())
     .def("symlink", &TargetSystem::symlink,
         R"pbdoc(
@@ -197,16 +522,107 @@ void pyinit_engine(py::module &m) {
                 return default_address
         )pbdoc")
 
+    .def("symlink_versioned", &TargetSystem::symlink_versioned,
+        R"pbdoc(
+          Callback used by the loader to resolve external symbols that require
+          a version (GNU symbol versioning), such as ``memcpy`` of
+          ``GLIBC_2.14``.
+
+          It takes the :class:`~.Loader`, the LIEF's symbol object and the
+          name of the version. Each (name, version) pair is only resolved once
+          per load. The default implementation ignores the version and calls
+          :meth:`~.TargetSystem.symlink`.
+        )pbdoc",
+        "loader"_a, "symbol"_a, "version"_a)
+
     .def("supports", &TargetSystem::supports,
         "Function that returns whether we support the architecture associated with the given binary",
         "binary"_a)
 
+    .def("supports_arch", &TargetSystem::supports_arch,
+        R"pbdoc(
+        Function that returns whether we support binaries of the given
+        :class:`~.Arch`, without parsing them.
+        If it returns ``True``, ELF binaries are read directly rather than
+        parsed with LIEF, and :meth:`~.TargetSystem.supports` is not called
+        for them.
+        Returns ``False`` by default.
+        )pbdoc",
+        "arch"_a)
+
     .def("base_address_hint", &TargetSystem::base_address_hint,
         R"pbdoc(
         Function that returns the preferred based address where the binary should be mapped.
         If it returns 0, the loader can choose any address.
         )pbdoc" ,
         "binary_base_address"_a, "virtual_size"_a)
+
+    .def("resolve_ifunc", &TargetSystem::resolve_ifunc,
+        R"pbdoc(
+        Function that runs the IFUNC resolver at ``resolver`` (an absolute
+        address) of the image loaded by ``loader``, and returns the address
+        of the implementation it selects.
+        Emulators can also directly return the variant that suits them.
+        The default implementation returns 0, which leaves the relocation
+        unresolved.
+        )pbdoc",
+        "loader"_a, "resolver"_a)
+
+    .def("tls_register", &TargetSystem::tls_register,
+        R"pbdoc(
+        Function that registers the thread-local storage of the image loaded
+        by ``loader``, described by a :class:`~.TargetSystem.TlsImage`, and
+        returns its :class:`~.TargetSystem.TlsModule`.
+        The template is relocated after this call, so it must be read when
+        the per-thread blocks are allocated.
+        The default implementation returns an empty module (id 0), which
+        leaves the TLS relocations unresolved.
+        )pbdoc",
+        "loader"_a, "image"_a)
+
+    .def("tls_unregister", &TargetSystem::tls_unregister,
+        R"pbdoc(
+        Function called with the module returned by
+        :meth:`~.TargetSystem.tls_register` when ``loader`` is destroyed.
+        )pbdoc",
+        "loader"_a, "module"_a)
+
+    .def("delay_load_helper", &TargetSystem::delay_load_helper,
+        R"pbdoc(
+        Function that returns the address the delay-load thunks of the x86-64
+        PE image loaded by ``loader`` jump to, with the address of the delay
+        IAT slot of the called import in ``rax``. It must call
+        :meth:`~.loaders.PE.delay_bind` and resume at the returned address.
+        Emulators can return an address they hook.
+        The default implementation returns 0, which resolves the delay-load
+        imports when the image is loaded.
+        )pbdoc",
+        "loader"_a)
+
+    .def("prelink_cache_dir", &TargetSystem::prelink_cache_dir,
+        R"pbdoc(
+        Function that returns the directory where the fully relocated images of
+        the ELF binaries loaded with ``BIND.NOW`` are cached, so that later
+        loads of the same binary are just mappings.
+        An empty string (the default) disables the cache.
+        )pbdoc")
+
+    .def("relocation_threads", &TargetSystem::relocation_threads,
+        R"pbdoc(
+        Function that returns the number of threads the loaders may use to
+        apply the rebases of an image, if the target memory supports it (see
+        :meth:`~.TargetMemory.concurrent_access`).
+        0 means one thread per CPU, and 1 (the default) disables threading.
+        )pbdoc")
+
+    .def("cache_relocation_plans", &TargetSystem::cache_relocation_plans,
+        R"pbdoc(
+        Function that returns whether the relocation plans of the ELF and
+        Mach-O binaries loaded with ``BIND.NOW`` are saved next to them (keyed
+        by their build-id or LC_UUID), so that later loads replay them without
+        parsing the relocations of the binary.
+        Returns ``False`` by default.
+        )pbdoc")
     ;
 
   py::module_ engines = m.def_submodule("engines");
@@ -218,11 +634,32 @@ void pyinit_engine(py::module &m) {
 
       Default engines provided by QBDL
 
+      .. autoclass:: pyqbdl.engines.CachedTargetMemory
+         :members:
+
       .. automodule:: pyqbdl.engines.Native
          :members:
          :undoc-members:
 
       )pbdoc";
+
+  py::class_<Engines::CachedTargetMemory, TargetMemory>(engines, "CachedTargetMemory",
+      R"pbdoc(
+      :class:`~pyqbdl.TargetMemory` wrapper that caches the pages of another
+      :class:`~pyqbdl.TargetMemory` object.
+
+      Loaders' reads and writes are served from local pages, and dirty pages
+      are written back with a single batched write (see ``write_many``) once
+      the binary is loaded. This is useful for emulators, where each access
+      costs a Python call.
+
+      .. code-block:: python
+
+        system = MySystem(pyqbdl.engines.CachedTargetMemory(MyVM(vm)))
+      )pbdoc")
+    .def(py::init<TargetMemory&>(), py::keep_alive<1,2>(), "backend"_a)
+    .def("flush", &Engines::CachedTargetMemory::flush,
+        "Write dirty pages back to the underlying memory and drop the cache");
   py::module_ native = engines.def_submodule("Native");
   native.doc() = R"pbdoc(
       Native
@@ -234,13 +671,36 @@ void pyinit_engine(py::module &m) {
       )pbdoc";
 
 
+  py::class_<Engines::Native::MemoryPolicy> pypolicy(native, "MemoryPolicy",
+      R"pbdoc(
+        Policy applied to the memory of the loaded images (only honoured on
+        Linux).
+      )pbdoc");
+  py::enum_<Engines::Native::MemoryPolicy::DataAdvice>(pypolicy, "DataAdvice")
+    .value("NORMAL", Engines::Native::MemoryPolicy::DataAdvice::NORMAL)
+    .value("WILLNEED", Engines::Native::MemoryPolicy::DataAdvice::WILLNEED)
+    .value("RANDOM", Engines::Native::MemoryPolicy::DataAdvice::RANDOM);
+  pypolicy
+    .def(py::init<>())
+    .def_readwrite("huge_text", &Engines::Native::MemoryPolicy::huge_text,
+        "Place images on 2 MiB boundaries and back their text with transparent huge pages")
+    .def_readwrite("hugetlb_text", &Engines::Native::MemoryPolicy::hugetlb_text,
+        "Back the text of images with pages of the hugetlb pool (MAP_HUGETLB) when it has some left")
+    .def_readwrite("populate", &Engines::Native::MemoryPolicy::populate,
+        "Prefault committed memory (MAP_POPULATE)")
+    .def_readwrite("data_advice", &Engines::Native::MemoryPolicy::data_advice,
+        "madvise(2) advice applied to non-executable ranges")
+    .def_readwrite("reuse_released", &Engines::Native::MemoryPolicy::reuse_released,
+        "Keep released images reserved and reuse their address range for later loads");
+
   native.def("memory", &Engines::Native::memory,
       R"pbdoc(
         Return a native implementation of the memory accesses.
 
         This model assumes that the loader and the loaded binary share
         the same memory space.
-      )pbdoc");
+      )pbdoc",
+      "policy"_a = Engines::Native::MemoryPolicy{});
   native.def("arch", &Engines::Native::arch,
       ":class:`~.Arch` object that matches the system on which QBDL is running on.");
 
@@ -283,9 +743,41 @@ void pyinit_loaders(py::module &m) {
            py::overload_cast<uint64_t>(&Loader::get_address, py::const_),
            "Get the absolute address form the offset given in parameter",
            "offset"_a)
+      .def("get_addresses", &Loader::get_addresses,
+          R"pbdoc(
+          Return the absolute addresses associated with a list of symbols, in
+          the same order (0 for the symbols that can't be found)
+          )pbdoc",
+          "sym_names"_a)
       .def_property_readonly("entrypoint", &Loader::entrypoint,
           "Binary entrypoint as an **absolute** address");
 
+  py::class_<Namespace>(m, "Namespace",
+      R"pbdoc(
+      Set of images loaded with their dependencies (``DT_NEEDED``,
+      ``LC_LOAD_DYLIB``, PE imports), which resolve their imports against
+      each other before falling back to :meth:`~.TargetSystem.symlink`.
+      )pbdoc")
+      .def(py::init<TargetSystem&, std::vector<std::string>>(),
+          "engine"_a, "search_paths"_a = std::vector<std::string>{},
+          py::keep_alive<1, 2>())
+      .def("load", &Namespace::load,
+          R"pbdoc(
+          Load a binary and its dependencies, and return its :class:`~.Loader`
+          (owned by the namespace), or ``None`` if it can't be loaded
+          )pbdoc",
+          "path"_a, "binding"_a = Loader::BIND_DEFAULT,
+          py::return_value_policy::reference_internal)
+      .def("find", &Namespace::find,
+          "Absolute address of a symbol exported by an image of the namespace (0 if none)",
+          "name"_a)
+      .def("get", &Namespace::get,
+          "Loader of an image of the namespace, given its file name",
+          "name"_a, py::return_value_policy::reference_internal)
+      .def_property_readonly("loaders", &Namespace::loaders,
+          "Loaders of the namespace, dependencies first",
+          py::return_value_policy::reference_internal);
+
   py::module_ loaders = m.def_submodule("loaders");
   loaders.doc() = R"pbdoc(
         Loaders
@@ -305,6 +797,21 @@ void pyinit_loaders(py::module &m) {
           "Load a Mach-O file from its path on the disk",
           "path"_a, "arch"_a, "engine"_a, "binding"_a = Loader::BIND_DEFAULT,
           py::keep_alive<0, 2>())
+      .def_static("from_buffer",
+          [](py::bytes const &data, Arch const &arch, TargetSystem &engine,
+             Loader::BIND binding) {
+            char *buf; ssize_t len = 0;
+            PYBIND11_BYTES_AS_STRING_AND_SIZE(data.ptr(), &buf, &len);
+            return Loaders::MachO::from_buffer(
+                reinterpret_cast<const uint8_t *>(buf), len, arch, engine,
+                binding);
+          },
+          R"pbdoc(
+          Load a (potentially universal) Mach-O file from its content. Only
+          the slice that matches the given architecture is parsed.
+          )pbdoc",
+          "data"_a, "arch"_a, "engine"_a, "binding"_a = Loader::BIND_DEFAULT,
+          py::keep_alive<0, 3>())
       .def_static("take_arch_binary", &Loaders::MachO::take_arch_binary,
           "Extract a Mach-O binary from a Fat binary that matches the given architecture",
           "fatbin"_a, "arch"_a)
@@ -325,7 +832,11 @@ void pyinit_loaders(py::module &m) {
                   "engines"_a, "bind"_a = Loader::BIND_DEFAULT,
                   py::keep_alive<0, 2>())
       .def("is_valid", &Loaders::PE::is_valid,
-           "Whether the loader object is consistent");
+           "Whether the loader object is consistent")
+      .def("delay_bind", &Loaders::PE::delay_bind,
+           "Resolve the delay-load import whose delay IAT slot is at "
+           "``slot``, write it to the slot and return its address",
+           "slot"_a);
 }
 
 } // namespace QBDL
@@ -66,6 +66,20 @@ struct FinalTargetSystem: public Engines::Native::TargetSystem {
     }
     return reinterpret_cast<uint64_t>(symAddr);
   }
+
+#if defined(__GLIBC__)
+  uint64_t symlink_versioned(Loader &loader, const LIEF::Symbol &sym,
+                             const std::string &version) override {
+    if (SYMS.count(sym.name()) == 0) {
+      void *symAddr =
+          dlvsym(RTLD_DEFAULT, sym.name().c_str(), version.c_str());
+      if (symAddr != nullptr) {
+        return reinterpret_cast<uint64_t>(symAddr);
+      }
+    }
+    return symlink(loader, sym);
+  }
+#endif
 };
 
 }
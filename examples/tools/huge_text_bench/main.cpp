@@ -0,0 +1,106 @@
+// Time the walk of a library with a large text (libhuge_text_walk.so),
+// loaded with each text policy of the native engine, to show the effect of
+// huge pages on the iTLB.
+//
+// hugetlb_text needs pages in the hugetlb pool, e.g.:
+//   echo 40 | sudo tee /proc/sys/vm/nr_hugepages
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <LIEF/LIEF.hpp>
+#include <QBDL/Engine.hpp>
+#include <QBDL/engines/Native.hpp>
+#include <QBDL/loaders/ELF.hpp>
+
+using namespace QBDL;
+
+namespace {
+
+// libhuge_text_walk.so has no imports
+struct BenchTargetSystem : public Engines::Native::TargetSystem {
+  using Engines::Native::TargetSystem::TargetSystem;
+
+  uint64_t symlink(Loader &, const LIEF::Symbol &) override { return 0; }
+};
+
+// Sum the huge pages backing [start, end), from /proc/self/smaps
+void print_huge_pages(uint64_t start, uint64_t end) {
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool in_range = false;
+  unsigned long long thp = 0, hugetlb = 0;
+  while (std::getline(smaps, line)) {
+    unsigned long long lo = 0, hi = 0, kb = 0;
+    char dash = 0;
+    if (sscanf(line.c_str(), "%llx%c%llx", &lo, &dash, &hi) == 3 &&
+        dash == '-') {
+      in_range = lo < end && hi > start;
+    } else if (in_range &&
+               sscanf(line.c_str(), "AnonHugePages: %llu", &kb) == 1) {
+      thp += kb;
+    } else if (in_range &&
+               sscanf(line.c_str(), "Private_Hugetlb: %llu", &kb) == 1) {
+      hugetlb += kb;
+    }
+  }
+  printf("    text in transparent huge pages: %llu kB, in hugetlb pages: "
+         "%llu kB\n",
+         thp, hugetlb);
+}
+
+bool bench(const char *name, Engines::Native::MemoryPolicy const &policy,
+           const char *path, int iterations) {
+  Engines::Native::TargetMemory mem{policy};
+  BenchTargetSystem system{mem};
+  std::unique_ptr<Loaders::ELF> loader =
+      Loaders::ELF::from_file(path, system, Loader::BIND::NOW);
+  if (loader == nullptr) {
+    fprintf(stderr, "Can't load %s\n", path);
+    return false;
+  }
+  using walk_t = int (*)();
+  auto walk = reinterpret_cast<walk_t>(loader->get_address("walk"));
+  if (walk == nullptr) {
+    fprintf(stderr, "Can't find symbol 'walk'\n");
+    return false;
+  }
+
+  // Each call crosses as many pages as it returns
+  const int pages = walk();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    walk();
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("%-13s %6.1f ns per page (%d pages, %d walks)\n", name,
+         elapsed.count() / iterations / pages, pages, iterations);
+  print_huge_pages(loader->base_address(),
+                   loader->base_address() + loader->mem_size());
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s libhuge_text_walk.so [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *path = argv[1];
+  const int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+
+  Engines::Native::MemoryPolicy small;
+  Engines::Native::MemoryPolicy thp;
+  thp.huge_text = true;
+  Engines::Native::MemoryPolicy hugetlb;
+  hugetlb.hugetlb_text = true;
+
+  const bool ok = bench("4 KiB pages", small, path, iterations) &&
+                  bench("huge_text", thp, path, iterations) &&
+                  bench("hugetlb_text", hugetlb, path, iterations);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,6 +7,8 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace LIEF {
 class Symbol;
@@ -26,6 +28,33 @@ struct Arch;
  */
 QBDL_API class TargetMemory {
 public:
+  /** Memory protection flags, used by ::QBDL::TargetMemory::mprotect.
+   */
+  enum PROT : int {
+    NONE = 0,
+    READ = 1 << 0,
+    WRITE = 1 << 1,
+    EXEC = 1 << 2,
+  };
+
+  /** Buffer to write at a given address, used by
+   * ::QBDL::TargetMemory::write_batch.
+   */
+  struct WriteSpan {
+    uint64_t addr;
+    const void *buf;
+    size_t len;
+  };
+
+  /** Buffer to fill from a given address, used by
+   * ::QBDL::TargetMemory::read_batch.
+   */
+  struct ReadSpan {
+    uint64_t addr;
+    void *buf;
+    size_t len;
+  };
+
   virtual ~TargetMemory() = default;
 
   /** Reserve a region of memory in the targeted memory space.
@@ -37,7 +66,63 @@ public:
    */
   virtual uint64_t mmap(uint64_t hint, size_t len) = 0;
 
+  /** Reserve a region of the targeted memory space, without necessarily
+   * backing it with memory.
+   *
+   * Loaders reserve the whole span of a binary with this function, and then
+   * call ::QBDL::TargetMemory::commit (or ::QBDL::TargetMemory::map_file) on
+   * the ranges that are actually loaded. Holes (padding between segments,
+   * __PAGEZERO-like regions, ...) are never committed, and must not be
+   * accessible.
+   *
+   * The default implementation calls ::QBDL::TargetMemory::mmap, so that
+   * the whole region is usable.
+   *
+   * @param[in] hint A hint as to where the address should be. 0 means any
+   * address.
+   * @param[in] len Size of the memory region to reserve
+   * @returns 0 if an error occurred, any value otherwise.
+   */
+  virtual uint64_t reserve(uint64_t hint, size_t len);
+
+  /** Back a range of a region reserved with ::QBDL::TargetMemory::reserve
+   * with zero-filled memory.
+   *
+   * The committed range must be readable and writable until the loader sets
+   * its final protection with ::QBDL::TargetMemory::mprotect.
+   *
+   * The default implementation does nothing and returns true.
+   *
+   * @param[in] addr Virtual absolute address of the range
+   * @param[in] len Size of the range
+   * @param[in] prot Protection of the mapped range, as a combination of
+   * ::QBDL::TargetMemory::PROT flags. It must allow the writes done before
+   * the range is given its final protection with
+   * ::QBDL::TargetMemory::mprotect.
+   * @returns true on success
+   */
+  virtual bool commit(uint64_t addr, size_t len, int prot);
+
+  /** Release a region previously allocated with ::QBDL::TargetMemory::mmap or
+   * ::QBDL::TargetMemory::reserve.
+   *
+   * Loaders call this function on the whole image when they are destroyed.
+   * The default implementation does nothing, i.e. the region is leaked.
+   *
+   * @param[in] addr Virtual absolute address of the region
+   * @param[in] len Size of the region
+   */
+  virtual void release(uint64_t addr, size_t len);
+
   /** Change permissions on a region of memory.
+   *
+   * Loaders call this function once the binary has been relocated and its
+   * symbols bound, with page-aligned regions.
+   *
+   * @param[in] addr Virtual absolute address of the region
+   * @param[in] len Size of the region
+   * @param[in] prot Combination of ::QBDL::TargetMemory::PROT flags
+   * @returns true if the permissions have been changed, false otherwise.
    */
   virtual bool mprotect(uint64_t addr, size_t len, int prot) = 0;
 
@@ -60,6 +145,73 @@ public:
    */
   virtual void read(void *dst, uint64_t addr, size_t len) = 0;
 
+  /** Write several buffers to the targeted memory space.
+   *
+   * Loaders use this function to send many small writes (relocations,
+   * bindings, ...) at once. Spans must be written in order, as a span can
+   * overwrite a previous one.
+   *
+   * The default implementation calls ::QBDL::TargetMemory::write for each
+   * span. Backends for which each access is expensive (emulators, remote
+   * targets, ...) should override it.
+   *
+   * @param spans Buffers to write
+   */
+  virtual void write_batch(std::vector<WriteSpan> const &spans);
+
+  /** Read several buffers from the targeted memory space.
+   *
+   * The default implementation calls ::QBDL::TargetMemory::read for each
+   * span.
+   *
+   * @param spans Buffers to fill
+   */
+  virtual void read_batch(std::vector<ReadSpan> const &spans);
+
+  /** Whether ::QBDL::TargetMemory::read and ::QBDL::TargetMemory::write can
+   * be called concurrently, from several threads, on disjoint pages.
+   *
+   * Loaders only apply relocations in parallel (see
+   * ::QBDL::TargetSystem::relocation_threads) if this returns true. The
+   * default implementation returns false.
+   */
+  virtual bool concurrent_access() const;
+
+  /** Make sure every previous write has reached the targeted memory space.
+   *
+   * Loaders call this function once they are done loading a binary. This is
+   * only useful for backends that defer writes (see
+   * ::QBDL::Engines::CachedTargetMemory), so the default implementation does
+   * nothing.
+   */
+  virtual void flush();
+
+  /** Map a range of a file into a memory region previously reserved with
+   * ::QBDL::TargetMemory::reserve.
+   *
+   * This is an optional optimization: backends that can share pages with the
+   * file (copy-on-write) avoid copying the content of the file through
+   * ::QBDL::TargetMemory::write. Writes done afterward to this region must
+   * not be visible in the file.
+   *
+   * The default implementation does nothing and returns false.
+   *
+   * @param[in] addr Virtual absolute address where the file range must be
+   * mapped
+   * @param[in] len Length of the range to map
+   * @param[in] path Path to the file to map
+   * @param[in] offset Offset of the range within the file
+   * @param[in] prot Protection of the mapped range, as a combination of
+   * ::QBDL::TargetMemory::PROT flags. It must allow the writes done before
+   * the range is given its final protection with
+   * ::QBDL::TargetMemory::mprotect.
+   * @returns true if the range has been mapped, false if the caller must
+   * commit the range (see ::QBDL::TargetMemory::commit) and fall back to
+   * ::QBDL::TargetMemory::write.
+   */
+  virtual bool map_file(uint64_t addr, size_t len, const char *path,
+                        uint64_t offset, int prot);
+
   /** Convenience function that write a pointer value to the targeted memory
    * space, given an architecture.
    *
@@ -119,16 +271,53 @@ public:
    */
   virtual uint64_t symlink(Loader &loader, LIEF::Symbol const &sym) = 0;
 
+  /** Resolve an external symbol that requires a given version (GNU symbol
+   * versioning, e.g. `memcpy` of `GLIBC_2.14`).
+   *
+   * Loaders call this function instead of ::QBDL::TargetSystem::symlink for
+   * versioned imports. Each (name, version) pair is resolved once per load,
+   * whatever the number of relocations that refer to it.
+   *
+   * The default implementation ignores \p version and calls
+   * ::QBDL::TargetSystem::symlink.
+   *
+   * @param[in] loader The current loader object that is calling this function
+   * @param[in] sym The symbol to resolve
+   * @param[in] version Name of the required version
+   * @returns The absolute virtual address of \p sym
+   */
+  virtual uint64_t symlink_versioned(Loader &loader, LIEF::Symbol const &sym,
+                                     std::string const &version);
+
   /** Verify that the target system supports a binary.
    *
    * This is mainly used by the ::QBDL::Loaders::MachO loader to
    * select a valid binary within a universal MachO.
    *
+   * Note that ELF files whose architecture is accepted by
+   * ::QBDL::TargetSystem::supports_arch are not parsed, and thus never given
+   * to this function.
+   *
    * @param[in] bin Binary to verify
    * @returns true iif the target system can handle this binary.
    */
   virtual bool supports(LIEF::Binary const &bin) = 0;
 
+  /** Verify that the target system supports binaries of a given
+   * architecture, without parsing them.
+   *
+   * If it returns true, the ::QBDL::Loaders::ELF loader reads the files it
+   * loads directly, and only parses them with LIEF on demand: for ELF files,
+   * it then replaces ::QBDL::TargetSystem::supports, which must not reject
+   * binaries of \p arch. Otherwise, binaries are parsed and given to
+   * ::QBDL::TargetSystem::supports, and the prelink cache and relocation
+   * plans are not used to load them.
+   *
+   * @param[in] arch Architecture of the binary
+   * @returns false by default.
+   */
+  virtual bool supports_arch(Arch const &arch);
+
   /** Compute the preferred based address where the binary should
    * be mapped.
    *
@@ -143,6 +332,154 @@ public:
   virtual uint64_t base_address_hint(uint64_t binary_base_address,
                                      uint64_t virtual_size) = 0;
 
+  /** Directory of the prelink cache.
+   *
+   * When it is set, the ELF loader persists the fully relocated images of the
+   * binaries loaded from a file with BIND::NOW in this (existing) directory.
+   * A later load of the same binary (same build-id, device, inode, size and
+   * modification time) is then just a mapping of the cached image, provided
+   * that the same base address is available and that every import still
+   * resolves (see ::QBDL::TargetSystem::symlink) to the same address.
+   *
+   * Note that ::QBDL::TargetSystem::symlink may then be called with symbols
+   * that only have a name.
+   *
+   * @returns the path to the cache directory, or an empty string (the
+   * default) to disable the cache.
+   */
+  virtual std::string prelink_cache_dir();
+
+  /** Number of threads the loaders may use to apply relocations.
+   *
+   * The rebases of an image (relative relocations) are split in chunks that
+   * don't share any page, and these chunks are processed by this number of
+   * threads, provided that the target memory supports it (see
+   * ::QBDL::TargetMemory::concurrent_access). Relocations that refer to a
+   * symbol are always processed serially, as they may call
+   * ::QBDL::TargetSystem::symlink.
+   *
+   * This is only worth it for images with millions of relocations.
+   *
+   * @returns the number of threads, 0 for one per hardware thread, or 1 (the
+   * default) to relocate serially.
+   */
+  virtual unsigned relocation_threads();
+
+  /** Whether the relocation plans of the binaries loaded from disk with
+   * BIND::NOW are cached.
+   *
+   * A plan is the base-independent list of the relocations of a binary,
+   * with the names of its imports. It is saved next to the binary (in
+   * `<binary>.qbdlplan`) and keyed by its build-id, so that later loads of
+   * the same binary, at any base address, replay it instead of parsing the
+   * binary. ELF binaries with a NT_GNU_BUILD_ID note and Mach-O binaries
+   * with a LC_UUID command are supported: for the latter, the rebase and
+   * bind opcodes are not decoded. PE binaries are not, as their base
+   * relocations and imports are always parsed along with the headers.
+   *
+   * @returns false by default.
+   */
+  virtual bool cache_relocation_plans();
+
+  /** Run an IFUNC resolver (STT_GNU_IFUNC symbols and R_*_IRELATIVE
+   * relocations) of a loaded image.
+   *
+   * The resolver selects the implementation of a function, usually from the
+   * features of the CPU. Loaders call it once every other relocation of the
+   * image has been applied. Emulators can run \p resolver, or directly
+   * choose the variant that suits them.
+   *
+   * @param[in] loader The current loader object that is calling this function
+   * @param[in] resolver Absolute address of the resolver
+   * @returns The absolute address of the selected implementation, or 0 (the
+   * default) if the resolver can't be run. The relocation is then left
+   * unresolved.
+   */
+  virtual uint64_t resolve_ifunc(Loader &loader, uint64_t resolver);
+
+  /** Thread-local storage template of an image (its PT_TLS segment), used by
+   * ::QBDL::TargetSystem::tls_register.
+   */
+  struct TlsImage {
+    uint64_t init_addr; ///< Absolute address of the initialization image
+    uint64_t init_size; ///< Size of the initialization image
+    uint64_t size;      ///< Size of a block (the rest is zero-filled)
+    uint64_t align;     ///< Alignment of a block
+
+    /** Whether the image uses the static TLS models (initial and local exec,
+     * R_X86_64_TPOFF64 and R_AARCH64_TLS_TPREL64 relocations), and needs a
+     * static block. Its initialization image is then zero.
+     */
+    bool static_block = false;
+  };
+
+  /** Thread-local storage module of an image, returned by
+   * ::QBDL::TargetSystem::tls_register.
+   */
+  struct TlsModule {
+    /** Module id, written by R_*_DTPMOD64 relocations. 0 means the image has
+     * no module, and its TLS relocations are left unresolved.
+     */
+    uint64_t id = 0;
+
+    /** Absolute address of the function imports of `__tls_get_addr` are
+     * bound to, or 0 to resolve it with ::QBDL::TargetSystem::symlink.
+     */
+    uint64_t get_addr = 0;
+
+    /** Absolute address of the TLSDESC resolver, or 0 if TLSDESC
+     * relocations are not supported. The argument word of the descriptors
+     * is `(id << 32) | offset`.
+     */
+    uint64_t tlsdesc = 0;
+
+    /** Whether the block of each thread is at `tp_offset` from its thread
+     * pointer, as the static TLS models require. Images that request a
+     * static block fail to load without it.
+     */
+    bool static_block = false;
+    int64_t tp_offset = 0; ///< Offset of the static block
+  };
+
+  /** Register the thread-local storage of a loaded image.
+   *
+   * Loaders call this function once the image is mapped, if it has a TLS
+   * template. The target system owns the per-thread blocks of the module,
+   * and allocates them (usually lazily) from this template. As the template
+   * is only relocated after this call, it must not be copied right away.
+   *
+   * Images using the static TLS models (initial and local exec) request a
+   * static block with TlsImage::static_block, which the module must provide
+   * (see TlsModule::static_block) for them to load.
+   *
+   * @param[in] loader The current loader object that is calling this function
+   * @param[in] image TLS template of the image
+   * @returns The module of the image. By default, an empty module (id 0).
+   */
+  virtual TlsModule tls_register(Loader &loader, TlsImage const &image);
+
+  /** Unregister a module returned by ::QBDL::TargetSystem::tls_register.
+   *
+   * Loaders call this function when they are destroyed. The default
+   * implementation does nothing.
+   */
+  virtual void tls_unregister(Loader &loader, TlsModule const &module);
+
+  /** Helper the delay-load thunks of PE images jump to.
+   *
+   * The delay-load imports of x86-64 PE images are resolved on their first
+   * call: their delay IAT slots point to thunks that load the address of the
+   * slot in `rax` and jump to this helper. The helper must call
+   * ::QBDL::Loaders::PE::delay_bind with this address, and resume at the
+   * returned address with the registers of the call preserved. Emulators can
+   * return an address they hook.
+   *
+   * @param[in] loader The current loader object that is calling this function
+   * @returns The absolute address of the helper, or 0 (the default) to
+   * resolve the delay-load imports when the image is loaded.
+   */
+  virtual uint64_t delay_load_helper(Loader &loader);
+
   TargetMemory &mem() { return mem_; }
 
 private:
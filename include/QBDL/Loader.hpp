@@ -6,6 +6,7 @@
 #include <QBDL/macros.hpp>
 
 #include <string>
+#include <vector>
 
 namespace QBDL {
 class TargetSystem;
@@ -22,6 +23,14 @@ public:
    */
   virtual uint64_t get_address(const std::string &sym) const = 0;
 
+  /** Get the resolved absolute virtual addresses of several symbols.
+   *
+   * @returns the address of each symbol of \p syms, in the same order (0 for
+   * the ones that can't be found).
+   */
+  virtual std::vector<uint64_t>
+  get_addresses(std::vector<std::string> const &syms) const;
+
   /** Compute the absolute virtual address of on offset. This is basically
    * `base_address + offset`.
    */
@@ -43,6 +52,10 @@ public:
    */
   bool contains_address(uint64_t ptr) const;
 
+  /** Loaders release the memory of the binary on destruction (see
+   * ::QBDL::TargetMemory::release): nothing must reference the loaded binary
+   * afterward.
+   */
   virtual ~Loader();
 
   /** Get the architecture targeted by the loaded binary.
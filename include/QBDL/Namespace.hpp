@@ -0,0 +1,113 @@
+#ifndef QBDL_NAMESPACE_H_
+#define QBDL_NAMESPACE_H_
+
+#include <QBDL/Engine.hpp>
+#include <QBDL/Loader.hpp>
+#include <QBDL/exports.hpp>
+#include <QBDL/macros.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace QBDL {
+
+/** Set of images loaded with their dependencies, which resolve their imports
+ * against each other.
+ *
+ * ::QBDL::Namespace::load loads a binary (ELF, Mach-O or PE) and the whole
+ * graph of the libraries it depends on (DT_NEEDED, LC_LOAD_DYLIB, import
+ * directory) with the QBDL loaders. Dependencies are loaded before the images
+ * that need them, and every symbol they export is added to a single table,
+ * shared by the three formats. Imports are looked up in this table first,
+ * and only given to ::QBDL::TargetSystem::symlink if no image of the
+ * namespace exports them.
+ *
+ * As for the ELF dynamic linkers, a name exported by several images resolves
+ * to the first of them in breadth-first order of the dependency graph (the
+ * loaded binary, then its dependencies level by level), images of previous
+ * loads coming first. Versioned imports are bound to the definition of their
+ * version, or to an unversioned one. Since images are relocated as soon as
+ * they are loaded, imports of a dependency can only be bound to images loaded
+ * before it: the definitions of the images that need it (e.g. the copy of a
+ * variable in an executable) don't interpose them.
+ */
+class QBDL_API Namespace {
+public:
+  /**
+   * @param[in] engine Target system the images are loaded into. The namespace
+   * does *not* own this reference, which must outlive it.
+   * @param[in] search_paths Directories where dependencies are looked for,
+   * after the directory of the image that needs them.
+   */
+  Namespace(TargetSystem &engine, std::vector<std::string> search_paths = {});
+  ~Namespace();
+
+  /** Load \p path and its dependencies.
+   *
+   * Binaries of each level of the dependency graph are parsed in parallel.
+   * Dependencies that are already loaded in the namespace are reused, and
+   * the ones that can't be found are skipped: their symbols are then
+   * resolved by ::QBDL::TargetSystem::symlink.
+   *
+   * @param[in] path Path to the binary to load
+   * @param[in] binding Binding mode of every loaded image
+   * @returns The loader of \p path, owned by the namespace, or nullptr if it
+   * can't be loaded.
+   */
+  Loader *load(std::string const &path,
+               Loader::BIND binding = Loader::BIND_DEFAULT);
+
+  /** Absolute address of the symbol \p name exported by an image of the
+   * namespace, or 0 if there is none.
+   */
+  uint64_t find(std::string const &name) const;
+
+  /** Loader of the image whose file name is \p name (e.g. `libc.so.6`), or
+   * nullptr if it is not loaded in the namespace.
+   */
+  Loader *get(std::string const &name) const;
+
+  /** Loaders of the namespace, in load order (dependencies first).
+   */
+  std::vector<Loader *> loaders() const;
+
+private:
+  class System;
+  struct Export;
+  struct Image;
+
+  struct ExportAddr {
+    uint64_t addr;
+    size_t rank; // breadth-first order of the image that exports it
+  };
+
+  /** Parse \p path, and list its dependencies and exports. This runs
+   * concurrently with the parsing of the other binaries of the same level.
+   * Only the first slice of \p archs of a universal Mach-O is parsed.
+   */
+  static std::unique_ptr<Image> parse(std::string const &path,
+                                      std::vector<Arch> const &archs);
+  std::string find_library(std::string const &name,
+                           std::string const &origin) const;
+  void add_exports(Image const &image, Loader &loader, size_t rank);
+  void add_export(std::string key, uint64_t addr, size_t rank);
+  bool exported_before(std::string const &key, size_t rank) const;
+  uint64_t lookup(std::string const &name, std::string const &version) const;
+
+  TargetSystem &engine_;
+  std::unique_ptr<System> system_;
+  std::vector<std::string> search_paths_;
+  std::vector<std::unique_ptr<Loader>> loaders_;
+  std::unordered_map<std::string, Loader *> by_name_;
+  // name, or name@version for versioned ELF exports -> address
+  std::unordered_map<std::string, ExportAddr> exports_;
+  size_t next_rank_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(Namespace);
+};
+
+} // namespace QBDL
+
+#endif
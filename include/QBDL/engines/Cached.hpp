@@ -0,0 +1,85 @@
+#ifndef QBDL_ENGINE_CACHED_H_
+#define QBDL_ENGINE_CACHED_H_
+
+#include <QBDL/Engine.hpp>
+#include <QBDL/exports.hpp>
+#include <QBDL/macros.hpp>
+
+#include <map>
+#include <memory>
+
+namespace QBDL::Engines {
+
+/** ::QBDL::TargetMemory decorator that caches the pages of another
+ * ::QBDL::TargetMemory object.
+ *
+ * Reads are served from pages cached locally (fetched from the underlying
+ * backend with batched reads), and writes are only applied to these pages.
+ * Dirty pages are written back in a single
+ * ::QBDL::TargetMemory::write_batch call, with contiguous pages merged, when
+ * ::QBDL::TargetMemory::flush is called (which loaders do once the binary is
+ * loaded, and after each slot written by a lazy binder), before any
+ * ::QBDL::TargetMemory::mprotect call and on destruction.
+ *
+ * This turns the many read-modify-write accesses done by loaders into a
+ * couple of calls to the underlying backend, which is useful for emulated or
+ * remote targets where each access is expensive.
+ *
+ * Memory returned by ::QBDL::TargetMemory::mmap and
+ * ::QBDL::TargetMemory::reserve is assumed to be filled with zeros (as loaders
+ * already expect for .bss-like sections), so such pages are never fetched.
+ */
+QBDL_API class CachedTargetMemory : public QBDL::TargetMemory {
+public:
+  /** @param[in] backend Memory to cache. It must outlive this object.
+   */
+  explicit CachedTargetMemory(QBDL::TargetMemory &backend);
+  ~CachedTargetMemory() override;
+
+  uint64_t mmap(uint64_t hint, size_t len) override;
+  uint64_t reserve(uint64_t hint, size_t len) override;
+  bool commit(uint64_t addr, size_t len, int prot) override;
+  void release(uint64_t addr, size_t len) override;
+  bool mprotect(uint64_t addr, size_t len, int prot) override;
+  bool map_file(uint64_t addr, size_t len, const char *path, uint64_t offset,
+                int prot) override;
+  void write(uint64_t addr, const void *buf, size_t len) override;
+  void read(void *dst, uint64_t addr, size_t len) override;
+  void write_batch(std::vector<WriteSpan> const &spans) override;
+  void read_batch(std::vector<ReadSpan> const &spans) override;
+
+  /** Write the dirty pages back to the underlying backend, and drop the
+   * cache.
+   */
+  void flush() override;
+
+  QBDL::TargetMemory &backend() { return backend_; }
+
+private:
+  struct Page {
+    std::unique_ptr<uint8_t[]> data;
+    bool dirty;
+  };
+
+  // Make sure the pages containing the given addresses are cached, fetching
+  // the missing ones from the backend with a single batched read.
+  void fetch(std::vector<uint64_t> const &addrs);
+  uint8_t *page(uint64_t page_addr);
+  void add_zeros(uint64_t addr, size_t len);
+  bool is_zero(uint64_t page_addr) const;
+  void forget(uint64_t addr, size_t len);
+  void write_cached(uint64_t addr, const void *buf, size_t len);
+  void read_cached(void *dst, uint64_t addr, size_t len);
+
+  QBDL::TargetMemory &backend_;
+  // Key is the address of the page
+  std::map<uint64_t, Page> pages_;
+  // Regions returned by mmap and never written back since: start -> end
+  std::map<uint64_t, uint64_t> zeros_;
+
+  DISALLOW_COPY_AND_ASSIGN(CachedTargetMemory);
+};
+
+} // namespace QBDL::Engines
+
+#endif
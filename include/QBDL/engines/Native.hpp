@@ -5,6 +5,8 @@
 #include <QBDL/arch.hpp>
 #include <QBDL/exports.hpp>
 
+#include <map>
+#include <mutex>
 #include <optional>
 
 namespace LIEF {
@@ -13,6 +15,43 @@ class Binary;
 
 namespace QBDL::Engines::Native {
 
+/** Policy applied by ::QBDL::Engines::Native::TargetMemory to the memory of
+ * the images it loads.
+ *
+ * These are only honoured on Linux, and ignored elsewhere.
+ */
+struct MemoryPolicy {
+  /** How committed non-executable ranges are advised (see madvise(2)) */
+  enum class DataAdvice { NORMAL, WILLNEED, RANDOM };
+
+  /** Make executable ranges eligible to transparent huge pages: images are
+   * placed on a 2 MiB boundary, and their text is copied in anonymous
+   * memory advised with MADV_HUGEPAGE, instead of being mapped from the
+   * file.
+   */
+  bool huge_text = false;
+
+  /** Back the 2 MiB aligned part of executable ranges with pages of the
+   * hugetlb pool (MAP_HUGETLB), which must be reserved beforehand
+   * (vm.nr_hugepages). Images are placed as with
+   * ::QBDL::Engines::Native::MemoryPolicy::huge_text, which is also what the
+   * rest of the text gets, and all of it once the pool is exhausted.
+   */
+  bool hugetlb_text = false;
+
+  /** Prefault committed ranges and file mappings (MAP_POPULATE) */
+  bool populate = false;
+
+  DataAdvice data_advice = DataAdvice::NORMAL;
+
+  /** Keep released regions reserved (without any memory backing them), and
+   * reuse them for later reservations instead of giving them back to the
+   * system. This avoids fragmenting the address space when many images are
+   * loaded and dropped.
+   */
+  bool reuse_released = false;
+};
+
 /** Native ::QBDL::TargetMemory class that matches the OS QBDL is
  * running onto.
  *
@@ -20,15 +59,56 @@ namespace QBDL::Engines::Native {
  */
 QBDL_API class TargetMemory : public QBDL::TargetMemory {
 public:
+  TargetMemory() = default;
+  explicit TargetMemory(MemoryPolicy const &policy) : policy_(policy) {}
+
+  MemoryPolicy const &policy() const { return policy_; }
+
   uint64_t mmap(uint64_t hint, size_t len) override;
+
+  /** Reserve address space without committing memory (PROT_NONE and
+   * MAP_NORESERVE mapping on POSIX systems, MEM_RESERVE on Windows).
+   *
+   * The returned region is aligned on 2 MiB if
+   * ::QBDL::Engines::Native::MemoryPolicy::huge_text or
+   * ::QBDL::Engines::Native::MemoryPolicy::hugetlb_text is set.
+   */
+  uint64_t reserve(uint64_t hint, size_t len) override;
+  bool commit(uint64_t addr, size_t len, int prot) override;
+
+  /** Unmap the region, or keep it reserved for later reservations if
+   * ::QBDL::Engines::Native::MemoryPolicy::reuse_released is set.
+   */
+  void release(uint64_t addr, size_t len) override;
   bool mprotect(uint64_t addr, size_t len, int prot) override;
   void write(uint64_t addr, const void *buf, size_t len) override;
   void read(void *dst, uint64_t addr, size_t len) override;
+  bool concurrent_access() const override { return true; }
+
+  /** Map \p path privately (copy-on-write) at \p addr, so that pages that
+   * are never written are shared through the page cache.
+   *
+   * Only supported on POSIX systems, and if both \p addr and \p offset are
+   * aligned on the system page size.
+   */
+  bool map_file(uint64_t addr, size_t len, const char *path, uint64_t offset,
+                int prot) override;
+
+private:
+  uint64_t take_free(size_t len, size_t align);
+  void put_free(uint64_t addr, size_t len);
+
+  MemoryPolicy policy_;
+  std::mutex free_lock_;
+  std::map<uint64_t, uint64_t> free_; // start -> end of released regions
 };
 
 /** Allocates and returns a ::QBDL::Engines::Native::TargetMemory object.
+ *
+ * @param[in] policy Memory policy applied to the loaded images
  */
-QBDL_API std::unique_ptr<QBDL::TargetMemory> memory();
+QBDL_API std::unique_ptr<QBDL::TargetMemory>
+memory(MemoryPolicy const &policy = {});
 
 /** Native ::QBDL::TargetMemory class that matches the OS on which QBDL is
  * running on.
@@ -38,6 +118,23 @@ public:
   using QBDL::TargetSystem::TargetSystem;
 
   bool supports(LIEF::Binary const &bin) override;
+  bool supports_arch(Arch const &arch) override;
+  uint64_t resolve_ifunc(Loader &loader, uint64_t resolver) override;
+
+  /** Register the module in the TLS of the process: each thread allocates its
+   * block from a per-thread pool the first time it accesses it, and later
+   * accesses neither lock nor allocate. `__tls_get_addr` imports are bound
+   * to QBDL's own implementation, and TLSDESC is supported on x86-64 and
+   * AArch64 Linux. On these hosts, static blocks come from a small surplus
+   * area (512 bytes for all the modules) in the static TLS of QBDL.
+   */
+  TlsModule tls_register(Loader &loader, TlsImage const &image) override;
+  void tls_unregister(Loader &loader, TlsModule const &module) override;
+
+  /** QBDL's own helper on x86-64 Linux, which resolves the delay-load
+   * imports of the PE images on their first call.
+   */
+  uint64_t delay_load_helper(Loader &loader) override;
   uint64_t base_address_hint(uint64_t binary_base_address,
                              uint64_t virtual_size) override;
 };
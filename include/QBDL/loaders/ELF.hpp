@@ -1,22 +1,39 @@
 #ifndef QBDL_LOADER_ELF_H_
 #define QBDL_LOADER_ELF_H_
 #include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <QBDL/Engine.hpp>
 #include <QBDL/Loader.hpp>
 #include <QBDL/exports.hpp>
 
+// PLT0 trampoline of the lazily bound images (see dl_resolve_*.S). It saves
+// the argument registers and calls _dl_resolve().
 extern "C" void _dl_resolve_internal();
+extern "C" uintptr_t _dl_resolve(void *loader, uintptr_t hint);
 
 namespace LIEF::ELF {
 class Binary;
 class Relocation;
+class Segment;
 class Symbol;
 } // namespace LIEF::ELF
 
+namespace LIEF {
+class Symbol;
+}
+
 namespace QBDL {
-struct Arch;
+class ElfFile;
+class Protections;
+class SymbolIndex;
+struct PlanReloc;
+struct PlanSegment;
+struct PlanSymbol;
+struct RelocPlan;
 } // namespace QBDL
 
 namespace QBDL::Loaders {
@@ -33,7 +50,8 @@ public:
    * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
    * ELF object does *not* own this reference. It is the responsibility of the
    * user to ensure this object lives as long as the returned ELF object lives.
-   * @param[in] binding Binding mode. Only BIND::NOW is supported for now.
+   * @param[in] binding Binding mode. Note that BIND::LAZY is only supported
+   * with a native engine.
    * @returns A ::QBDL::Loaders::ELF object, or nullptr if loading failed.
    */
   static std::unique_ptr<ELF>
@@ -43,7 +61,9 @@ public:
   /** Loads an ELF file directly from disk.
    *
    * This function also loads the binary into \p engine, and return an :ELF
-   * object with associated information.
+   * object with associated information. If the target memory supports it
+   * (see ::QBDL::TargetMemory::map_file), page-aligned segments are mapped
+   * directly from \p path instead of being copied.
    *
    * @param[in] path Path to the ELF file to load
    * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
@@ -52,13 +72,28 @@ public:
    * @param[in] binding Binding mode. Note that BIND::LAZY is only supported
    * with a native engine.
    * @returns An ::QBDL::Loaders::ELF object, or nullptr if loading failed.
+   *
+   * With BIND::NOW, the image may come from (or be saved to) the prelink
+   * cache (see ::QBDL::TargetSystem::prelink_cache_dir). In that case, \p path
+   * is only parsed if ::QBDL::Loaders::ELF::get_binary is called.
+   *
+   * Unless \p binding is BIND::LAZY, binaries whose architecture is accepted
+   * by ::QBDL::TargetSystem::supports_arch are not parsed either: only the
+   * structures needed to load them are read from the mapped file.
+   *
+   * Likewise, if ::QBDL::TargetSystem::cache_relocation_plans is set, the
+   * relocation plan of \p path is saved next to it (keyed by its
+   * NT_GNU_BUILD_ID note) and replayed by later loads, without parsing \p
+   * path.
    */
   static std::unique_ptr<ELF> from_file(const char *path, TargetSystem &engine,
                                         BIND binding = BIND_DEFAULT);
 
   operator bool() const { return this->is_valid(); }
 
-  inline bool is_valid() const { return this->bin_ != nullptr; }
+  inline bool is_valid() const {
+    return this->bin_ != nullptr || !this->path_.empty();
+  }
 
   uint64_t get_address(const std::string &sym) const override;
   uint64_t get_address(uint64_t offset) const override;
@@ -67,30 +102,92 @@ public:
   uint64_t mem_size() const override { return mem_size_; }
   Arch arch() const override;
 
-  LIEF::ELF::Binary &get_binary() { return *bin_; }
-  const LIEF::ELF::Binary &get_binary() const { return *bin_; }
+  LIEF::ELF::Binary &get_binary();
+  const LIEF::ELF::Binary &get_binary() const;
 
   ~ELF() override;
 
 private:
-  static uintptr_t dl_resolve(void *loader, uintptr_t symidx);
-  using relocator_t = void (ELF::*)(const LIEF::ELF::Relocation &);
-  void reloc_x86_64(const LIEF::ELF::Relocation &reloc);
-  void reloc_aarch64(const LIEF::ELF::Relocation &reloc);
-  void bind_lazy(relocator_t relocator);
-  void bind_now(relocator_t relocator);
+  static std::unique_ptr<ELF> create(std::unique_ptr<LIEF::ELF::Binary> bin,
+                                     TargetSystem &engine, BIND binding,
+                                     const char *path, uint64_t file_key = 0,
+                                     std::string const &build_id = {});
+  static std::unique_ptr<ELF> from_prelink(const char *path,
+                                           uint64_t file_key,
+                                           TargetSystem &engine);
+  static std::unique_ptr<ELF> from_plan(const char *path, ElfFile const &file,
+                                        std::string const &build_id,
+                                        TargetSystem &engine);
+  void save_prelink(Protections const &prots);
+  void save_plan(RelocPlan &plan);
+  std::vector<std::pair<std::string, uint64_t>> exported_symbols() const;
+  void index_file();
+  friend uintptr_t ::_dl_resolve(void *loader, uintptr_t hint);
+  static uintptr_t dl_resolve(void *loader, uintptr_t hint);
+  void describe(RelocPlan &plan) const;
+  bool compile(RelocPlan &plan);
+  bool compile(ElfFile const &file, RelocPlan &plan);
+  PlanSymbol plan_symbol(const LIEF::ELF::Symbol &sym) const;
+  void plan_reloc(RelocPlan &plan, std::vector<PlanReloc> &out, uint32_t type,
+                  uint64_t address, const LIEF::ELF::Symbol *sym,
+                  int64_t addend, bool rela) const;
+  void plan_packed(RelocPlan &plan);
+  void apply(RelocPlan const &plan, std::vector<PlanReloc> const &relocs,
+             std::vector<uint64_t> &imports);
+  bool read_table(uint64_t tag, uint64_t size_tag,
+                  std::vector<uint8_t> &out) const;
+  void bind_lazy(RelocPlan &plan, std::vector<uint64_t> &imports);
   uint64_t get_rva(const LIEF::ELF::Binary &bin, uint64_t addr) const;
-  void load(BIND binding);
+  bool load(BIND binding);
+  bool map(RelocPlan const &plan);
+  bool segment_content(PlanSegment const &segment,
+                       std::vector<uint8_t> &out) const;
+  bool map_from_file(PlanSegment const &segment, int prot);
+  Protections protect(RelocPlan const &plan);
+  const LIEF::ELF::Symbol *find_dynamic(std::string_view name) const;
   uintptr_t resolve(const LIEF::ELF::Symbol &sym);
   uintptr_t resolve_or_symlink(const LIEF::ELF::Symbol &sym);
+  uintptr_t symlink(const LIEF::Symbol &sym, std::string_view version = {},
+                    bool record = true);
+  uint64_t resolve_ifunc(uint64_t resolver);
+  void run_ifuncs();
+  bool register_tls(RelocPlan const &plan);
+  bool static_tls_zero(RelocPlan const &plan) const;
 
   ELF(std::unique_ptr<LIEF::ELF::Binary> bin, TargetSystem &engines);
 
-  std::unique_ptr<LIEF::ELF::Binary> bin_;
+  // Lazily parsed from path_ for images loaded from the prelink cache, or
+  // from file_
+  mutable std::unique_ptr<LIEF::ELF::Binary> bin_;
+  // Mapped file, if the image has been loaded without parsing it. Static
+  // and dynamic symbols are then in symbols_ (name -> RVA).
+  std::unique_ptr<ElfFile> file_;
+  std::string path_; // Empty if the binary does not come from a file
+  uint64_t file_key_{0}; // 0 if the image must not be prelinked
+  std::string build_id_;  // Empty if no relocation plan must be saved
   uint64_t base_address_{0};
   uint64_t mem_size_{0};
-  std::unordered_map<std::string, LIEF::ELF::Symbol *>
-      sym_exp_; // Cache to speed-up symbol resolution
+  Arch arch_{LIEF::ARCH_NONE, LIEF::ENDIAN_NONE, false};
+  bool prelinked_{false};
+  uint64_t entrypoint_{0}; // RVA, only for prelinked images and file_
+  std::unordered_map<std::string, uint64_t> prelinked_syms_; // name -> RVA
+  // Resolved by symlink() while loading, keyed by
+  // RelocPlan::versioned_name(). Not written by lazy binding.
+  std::unordered_map<std::string, uint64_t> imports_;
+  std::vector<PlanReloc> ifuncs_; // IRELATIVE relocations, see run_ifuncs()
+  TargetSystem::TlsModule tls_;   // see register_tls()
+
+  // Lazy binding: PLT relocations, indexed by the hint given by the PLT0
+  // trampoline to dl_resolve()
+  uint64_t pltgot_rva_{0};
+  std::vector<const LIEF::ELF::Relocation *> plt_relocs_;
+
+  // Dynamic symbols are looked up through the GNU or SysV hash table of the
+  // binary, or through dynindex_ (name -> index in dynsyms_) if there is
+  // none. Static symbols are in symbols_ (name -> value).
+  std::vector<const LIEF::ELF::Symbol *> dynsyms_;
+  std::unique_ptr<SymbolIndex> dynindex_;
+  std::unique_ptr<SymbolIndex> symbols_;
 };
 } // namespace QBDL::Loaders
 
@@ -1,10 +1,16 @@
 #ifndef QBDL_LOADER_MACHO_H_
 #define QBDL_LOADER_MACHO_H_
 #include <memory>
+#include <string_view>
 
 #include <QBDL/Loader.hpp>
 #include <QBDL/exports.hpp>
 
+// dyld_stub_binder of the lazily bound images (see dyld_stub_binder_*.S). It
+// saves the argument registers and calls _qbdl_stub_bind().
+extern "C" void _qbdl_stub_binder();
+extern "C" uintptr_t _qbdl_stub_bind(uintptr_t cache, uintptr_t lazy_offset);
+
 namespace LIEF::MachO {
 class Binary;
 class FatBinary;
@@ -12,6 +18,11 @@ class FatBinary;
 
 namespace QBDL {
 struct Arch;
+struct ChainedImport;
+class RelativeRelocs;
+struct RelocPlan;
+class SymbolIndex;
+class WriteBatch;
 } // namespace QBDL
 
 namespace QBDL::Loaders {
@@ -27,7 +38,8 @@ public:
    * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
    * ELF object does *not* own this reference. It is the responsibility of the
    * user to ensure this object lives as long as the returned ELF object lives.
-   * @param[in] binding Binding mode. Only BIND::NOW is supported for now.
+   * @param[in] binding Binding mode. Note that BIND::LAZY is only supported
+   * with a native engine.
    * @returns A ::QBDL::Loaders::MachO object, or nullptr if loading failed.
    */
   static std::unique_ptr<MachO>
@@ -54,6 +66,13 @@ public:
    * nullptr is returned. If successful, this function also loads the binary
    * into \p engine.
    *
+   * Only the fat header and the selected slice are read and parsed.
+   *
+   * If ::QBDL::TargetSystem::cache_relocation_plans is set and \p binding is
+   * BIND::NOW, the relocation plan of \p path is saved next to it (keyed by
+   * its LC_UUID), and later loads replay it instead of decoding the rebase
+   * and bind opcodes.
+   *
    * @param[in] path Path to the MachO file to load
    * @param[in] arch In case of a universal MachO, specify the architecture to
    * extract
@@ -69,6 +88,17 @@ public:
                                           TargetSystem &engine,
                                           BIND binding = BIND_DEFAULT);
 
+  /** Loads a (potentially universal) MachO file from memory.
+   *
+   * Same as ::QBDL::Loaders::MachO::from_file, for a file whose content is
+   * the \p size bytes at \p data. Only the slice of \p arch is parsed, and
+   * \p data can be released once this function returns.
+   */
+  static std::unique_ptr<MachO> from_buffer(const uint8_t *data, size_t size,
+                                            Arch const &arch,
+                                            TargetSystem &engine,
+                                            BIND binding = BIND_DEFAULT);
+
   operator bool() const { return this->is_valid(); }
 
   inline bool is_valid() const { return this->bin_ != nullptr; }
@@ -83,17 +113,41 @@ public:
   ~MachO() override;
 
 private:
-  void bind_now();
+  static std::unique_ptr<MachO>
+  create(std::unique_ptr<LIEF::MachO::Binary> bin, TargetSystem &engine,
+         BIND binding, const char *path = nullptr,
+         std::string const &uuid = {}, const RelocPlan *cached = nullptr);
+  void compile(RelocPlan &plan) const;
+  void bind_now(RelocPlan const &plan, bool skip_lazy = false);
+  void bind_lazy(RelocPlan const &plan);
+  uint64_t resolve_name(RelocPlan const &plan, uint32_t id);
+  friend uintptr_t ::_qbdl_stub_bind(uintptr_t cache, uintptr_t lazy_offset);
+  static uintptr_t stub_bind(uintptr_t cache, uintptr_t lazy_offset);
+  bool chained_fixups(RelativeRelocs &rebases, WriteBatch *binds);
+  bool threaded_fixups(RelativeRelocs &rebases, WriteBatch *binds);
+  uint64_t resolve_import(ChainedImport const &import);
+  uint64_t find_export(std::string_view name) const;
+  void protect();
   uint64_t get_rva(const LIEF::MachO::Binary &bin, uint64_t addr) const;
   LIEF::MachO::Binary &get_binary() { return *bin_; }
   const LIEF::MachO::Binary &get_binary() const { return *bin_; }
-  bool load(BIND binding);
+  bool load(BIND binding, const RelocPlan *cached = nullptr);
 
   MachO(std::unique_ptr<LIEF::MachO::Binary> bin, TargetSystem &engine);
 
   std::unique_ptr<LIEF::MachO::Binary> bin_;
+  std::string path_; // Empty if the binary does not come from a file
+  std::string uuid_; // Empty if no relocation plan must be saved
   uint64_t base_address_{0};
   uint64_t mem_size_{0};
+  // Export trie (LC_DYLD_EXPORTS_TRIE or LC_DYLD_INFO), in bin_
+  const uint8_t *export_trie_{nullptr};
+  size_t export_trie_size_{0};
+  // Symbols that are not in the export trie (name -> value)
+  std::unique_ptr<SymbolIndex> symbols_;
+  // Lazy binding: address given for dyld_stub_binder, 0 if the image is
+  // bound now
+  uint64_t stub_binder_{0};
 };
 } // namespace QBDL::Loaders
 
@@ -7,6 +7,11 @@
 #include <QBDL/Loader.hpp>
 #include <QBDL/exports.hpp>
 
+// Delay-load helper of the native engine (see delay_load_x86_64.S). It saves
+// the argument registers and calls _qbdl_delay_load().
+extern "C" void _qbdl_delay_load_helper();
+extern "C" uintptr_t _qbdl_delay_load(uintptr_t slot);
+
 namespace LIEF::PE {
 class Binary;
 class Symbol;
@@ -14,10 +19,24 @@ class Symbol;
 
 namespace QBDL {
 struct Arch;
+class PEExports;
+struct PEDelayImport;
 } // namespace QBDL
 
 namespace QBDL::Loaders {
 
+/** Loader of PE images.
+ *
+ * Imports (by name or by ordinal) of a DLL that has already been loaded by
+ * QBDL in the same ::QBDL::TargetSystem are resolved against its export
+ * directory, following forwarded exports. Other imports are given to
+ * ::QBDL::TargetSystem::symlink, by name, or as `<dll>#<ordinal>` (e.g.
+ * `ws2_32.dll#23`) for imports by ordinal.
+ *
+ * Delay-load imports are resolved the same way, on their first call if the
+ * target system provides a ::QBDL::TargetSystem::delay_load_helper (x86-64
+ * images only), and when the image is loaded otherwise.
+ */
 class QBDL_API PE : public Loader {
 public:
   /** Loads an PE file directly from a LIEF object.
@@ -70,18 +89,39 @@ public:
   LIEF::PE::Binary &get_binary() { return *bin_; }
   const LIEF::PE::Binary &get_binary() const { return *bin_; }
 
+  /** Resolve the delay-load import whose delay IAT slot is at \p slot, and
+   * write its address to the slot.
+   *
+   * This is called by the helper returned by
+   * ::QBDL::TargetSystem::delay_load_helper, with the value of `rax`.
+   *
+   * @returns The absolute address of the import, or 0 if it can't be
+   * resolved, in which case the slot is left untouched
+   */
+  uint64_t delay_bind(uint64_t slot);
+
   ~PE() override;
 
 private:
   uint64_t get_rva(const LIEF::PE::Binary &bin, uint64_t addr) const;
   void load(BIND binding);
-  uintptr_t resolve(const LIEF::PE::Symbol &sym);
+  void protect();
+  void bind_imports(uint64_t delay_helper);
+  uint64_t resolve_import(std::string dll, std::string name, uint32_t hint);
+  friend uintptr_t ::_qbdl_delay_load(uintptr_t slot);
+  static uintptr_t delay_load(uintptr_t slot);
 
   PE(std::unique_ptr<LIEF::PE::Binary> bin, TargetSystem &engines);
 
   std::unique_ptr<LIEF::PE::Binary> bin_;
   uint64_t base_address_{0};
   uint64_t mem_size_{0};
+  std::unique_ptr<PEExports> exports_;
+  // Sorted by slot
+  std::vector<PEDelayImport> delay_imports_;
+  // RVA of the delay-load thunks, 0 if delay-load imports are resolved when
+  // the image is loaded
+  uint64_t delay_thunks_{0};
 };
 } // namespace QBDL::Loaders
 
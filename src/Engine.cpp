@@ -41,6 +41,35 @@ uint64_t read_ptr_impl(TargetMemory &mem, uint64_t addr,
 
 } // namespace
 
+uint64_t TargetMemory::reserve(uint64_t hint, size_t len) {
+  return mmap(hint, len);
+}
+
+bool TargetMemory::commit(uint64_t addr, size_t len, int prot) { return true; }
+
+void TargetMemory::release(uint64_t addr, size_t len) {}
+
+bool TargetMemory::map_file(uint64_t addr, size_t len, const char *path,
+                            uint64_t offset, int prot) {
+  return false;
+}
+
+void TargetMemory::write_batch(std::vector<WriteSpan> const &spans) {
+  for (const WriteSpan &span : spans) {
+    write(span.addr, span.buf, span.len);
+  }
+}
+
+void TargetMemory::read_batch(std::vector<ReadSpan> const &spans) {
+  for (const ReadSpan &span : spans) {
+    read(span.buf, span.addr, span.len);
+  }
+}
+
+bool TargetMemory::concurrent_access() const { return false; }
+
+void TargetMemory::flush() {}
+
 void TargetMemory::write_ptr(Arch const &arch, uint64_t addr, uint64_t ptr) {
   archPtrType(arch, [&](auto tag) {
     using T = typename decltype(tag)::type;
@@ -55,4 +84,31 @@ uint64_t TargetMemory::read_ptr(Arch const &arch, uint64_t addr) {
   });
 }
 
+uint64_t TargetSystem::symlink_versioned(Loader &loader,
+                                         LIEF::Symbol const &sym,
+                                         std::string const &version) {
+  return symlink(loader, sym);
+}
+
+bool TargetSystem::supports_arch(Arch const &arch) { return false; }
+
+std::string TargetSystem::prelink_cache_dir() { return {}; }
+
+unsigned TargetSystem::relocation_threads() { return 1; }
+
+bool TargetSystem::cache_relocation_plans() { return false; }
+
+uint64_t TargetSystem::resolve_ifunc(Loader &loader, uint64_t resolver) {
+  return 0;
+}
+
+TargetSystem::TlsModule TargetSystem::tls_register(Loader &loader,
+                                                   TlsImage const &image) {
+  return {};
+}
+
+void TargetSystem::tls_unregister(Loader &loader, TlsModule const &module) {}
+
+uint64_t TargetSystem::delay_load_helper(Loader &loader) { return 0; }
+
 } // namespace QBDL
@@ -6,6 +6,16 @@ Loader::Loader() = default;
 Loader::Loader(TargetSystem &engine) : engine_{&engine} {}
 Loader::~Loader() = default;
 
+std::vector<uint64_t>
+Loader::get_addresses(std::vector<std::string> const &syms) const {
+  std::vector<uint64_t> ret;
+  ret.reserve(syms.size());
+  for (const std::string &sym : syms) {
+    ret.push_back(get_address(sym));
+  }
+  return ret;
+}
+
 bool Loader::contains_address(uint64_t ptr) const {
   const uint64_t BA = base_address();
   return (ptr >= BA) && (ptr < (BA + mem_size()));
@@ -0,0 +1,459 @@
+#include "logging.hpp"
+#include "macho_file.hpp"
+#include <QBDL/Namespace.hpp>
+#include <QBDL/arch.hpp>
+#include <QBDL/loaders/ELF.hpp>
+#include <QBDL/loaders/MachO.hpp>
+#include <QBDL/loaders/PE.hpp>
+
+#include <LIEF/ELF.hpp>
+#include <LIEF/MachO.hpp>
+#include <LIEF/PE.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <unordered_set>
+
+namespace QBDL {
+
+namespace {
+// File name of \p path
+std::string file_name(std::string const &path) {
+  const size_t pos = path.find_last_of("/\\");
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+std::string dir_name(std::string const &path) {
+  const size_t pos = path.find_last_of("/\\");
+  return pos == std::string::npos ? "." : path.substr(0, pos);
+}
+
+// DLL names are case-insensitive
+std::string lower(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return str;
+}
+
+bool is_file(std::string const &path) {
+  return std::ifstream{path, std::ios::binary}.good();
+}
+
+// Key of \p name in the export table, for definitions of \p version
+std::string export_key(std::string const &name, std::string const &version) {
+  return version.empty() ? name : name + '@' + version;
+}
+} // namespace
+
+/** Symbol exported by an image.
+ *
+ * An ELF image may define a name once per version, so its exports are
+ * located by RVA rather than by name.
+ */
+struct Namespace::Export {
+  std::string name;
+  std::string version; // ELF only, empty if none
+  bool hidden;         // ELF non-default version (name@version)
+  uint64_t rva;        // ELF only
+};
+
+/** Binary parsed by ::QBDL::Namespace::load, and not loaded yet
+ */
+struct Namespace::Image {
+  std::string path;
+  std::string key; // see by_name_
+  std::unique_ptr<LIEF::ELF::Binary> elf;
+  std::unique_ptr<LIEF::MachO::Binary> macho;
+  std::unique_ptr<LIEF::PE::Binary> pe;
+  std::vector<std::string> needed;
+  std::vector<Export> exports;
+  std::vector<Export> ifuncs; // ELF exports to give to resolve_ifunc()
+  bool by_rva = false;        // ELF exports are located by RVA
+};
+
+/** Target system given to the loaders of a ::QBDL::Namespace.
+ *
+ * It forwards everything to the target system of the namespace, but first
+ * looks imports up in the exports of the namespace.
+ */
+class Namespace::System : public TargetSystem {
+public:
+  System(Namespace &ns, TargetSystem &engine)
+      : TargetSystem(engine.mem()), ns_(ns), engine_(engine) {}
+
+  uint64_t symlink(Loader &loader, LIEF::Symbol const &sym) override {
+    const uint64_t addr = ns_.lookup(sym.name(), {});
+    if (addr != 0) {
+      return addr;
+    }
+    return engine_.symlink(loader, sym);
+  }
+
+  uint64_t symlink_versioned(Loader &loader, LIEF::Symbol const &sym,
+                             std::string const &version) override {
+    const uint64_t addr = ns_.lookup(sym.name(), version);
+    if (addr != 0) {
+      return addr;
+    }
+    return engine_.symlink_versioned(loader, sym, version);
+  }
+
+  bool supports(LIEF::Binary const &bin) override {
+    return engine_.supports(bin);
+  }
+  bool supports_arch(Arch const &arch) override {
+    return engine_.supports_arch(arch);
+  }
+  uint64_t base_address_hint(uint64_t binary_base_address,
+                             uint64_t virtual_size) override {
+    return engine_.base_address_hint(binary_base_address, virtual_size);
+  }
+  std::string prelink_cache_dir() override {
+    return engine_.prelink_cache_dir();
+  }
+  unsigned relocation_threads() override {
+    return engine_.relocation_threads();
+  }
+  bool cache_relocation_plans() override {
+    return engine_.cache_relocation_plans();
+  }
+  uint64_t resolve_ifunc(Loader &loader, uint64_t resolver) override {
+    return engine_.resolve_ifunc(loader, resolver);
+  }
+  TlsModule tls_register(Loader &loader, TlsImage const &image) override {
+    return engine_.tls_register(loader, image);
+  }
+  void tls_unregister(Loader &loader, TlsModule const &module) override {
+    engine_.tls_unregister(loader, module);
+  }
+  uint64_t delay_load_helper(Loader &loader) override {
+    return engine_.delay_load_helper(loader);
+  }
+
+private:
+  Namespace &ns_;
+  TargetSystem &engine_;
+};
+
+std::unique_ptr<Namespace::Image>
+Namespace::parse(std::string const &path, std::vector<Arch> const &archs) {
+  auto image = std::make_unique<Image>();
+  image->path = path;
+  image->key = file_name(path);
+
+  if (LIEF::ELF::is_elf(path)) {
+    image->elf = LIEF::ELF::Parser::parse(path);
+    if (image->elf == nullptr) {
+      return {};
+    }
+    image->needed = image->elf->imported_libraries();
+    image->by_rva = true;
+    const uint64_t imagebase = image->elf->imagebase();
+    for (const LIEF::ELF::Symbol &sym : image->elf->dynamic_symbols()) {
+      if (sym.shndx() == 0 || sym.value() == 0 ||
+          sym.binding() == LIEF::ELF::SYMBOL_BINDINGS::STB_LOCAL ||
+          sym.type() == LIEF::ELF::ELF_SYMBOL_TYPES::STT_TLS) {
+        continue;
+      }
+      Export exported{sym.name(), {}, false,
+                      sym.value() >= imagebase ? sym.value() - imagebase
+                                               : sym.value()};
+      if (sym.has_version()) {
+        // Definitions of the base version (index 1) are unversioned
+        const LIEF::ELF::SymbolVersion &version = sym.symbol_version();
+        if ((version.value() & 0x7fff) > 1 &&
+            version.has_auxiliary_version()) {
+          exported.version = version.symbol_version_auxiliary().name();
+          exported.hidden = (version.value() & 0x8000) != 0;
+        }
+      }
+      if (sym.type() == LIEF::ELF::ELF_SYMBOL_TYPES::STT_GNU_IFUNC) {
+        image->ifuncs.push_back(std::move(exported));
+      } else {
+        image->exports.push_back(std::move(exported));
+      }
+    }
+    return image;
+  }
+
+  if (LIEF::MachO::is_macho(path)) {
+    // Only the first slice of a supported architecture is parsed
+    image->macho = parse_macho_slice(path, [&archs](Arch const &arch) {
+      return std::find(archs.begin(), archs.end(), arch) != archs.end();
+    });
+    if (image->macho == nullptr) {
+      return {};
+    }
+    for (const LIEF::MachO::DylibCommand &lib : image->macho->libraries()) {
+      image->needed.push_back(lib.name());
+    }
+    const uint8_t *trie = nullptr;
+    size_t trie_size = 0;
+    export_trie(*image->macho, trie, trie_size);
+    for (std::string &name : trie_exports(trie, trie_size)) {
+      image->exports.push_back({std::move(name), {}, false, 0});
+    }
+    return image;
+  }
+
+  if (LIEF::PE::is_pe(path)) {
+    image->pe = LIEF::PE::Parser::parse(path);
+    if (image->pe == nullptr) {
+      return {};
+    }
+    image->key = lower(image->key);
+    if (image->pe->has_imports()) {
+      for (const LIEF::PE::Import &import : image->pe->imports()) {
+        image->needed.push_back(import.name());
+      }
+    }
+    if (image->pe->has_exports()) {
+      for (const LIEF::PE::ExportEntry &entry :
+           image->pe->get_export().entries()) {
+        // Forwarded exports are resolved by the DLL they point to
+        if (!entry.name().empty() && !entry.is_extern()) {
+          image->exports.push_back({entry.name(), {}, false, 0});
+        }
+      }
+    }
+    return image;
+  }
+  return {};
+}
+
+Namespace::Namespace(TargetSystem &engine,
+                     std::vector<std::string> search_paths)
+    : engine_(engine), system_(std::make_unique<System>(*this, engine)),
+      search_paths_(std::move(search_paths)) {}
+
+Namespace::~Namespace() {
+  // Images are unloaded before their dependencies
+  while (!loaders_.empty()) {
+    loaders_.pop_back();
+  }
+}
+
+Loader *Namespace::load(std::string const &path, Loader::BIND binding) {
+  Logger::info("Loading {} and its dependencies", path);
+  Loader *loaded = get(file_name(path));
+  if (loaded != nullptr) {
+    return loaded;
+  }
+
+  // Mach-O slices are selected by the parsing threads, which can't call
+  // TargetSystem::supports_arch as it may not be thread-safe
+  std::vector<Arch> archs;
+  for (const Arch &arch : macho_archs()) {
+    if (engine_.supports_arch(arch)) {
+      archs.push_back(arch);
+    }
+  }
+
+  // Parse the dependency graph, one level at a time
+  std::vector<std::unique_ptr<Image>> images;
+  std::unordered_map<std::string, size_t> index; // key -> index in images
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> level{path};
+  seen.insert(file_name(path));
+  while (!level.empty()) {
+    std::vector<std::future<std::unique_ptr<Image>>> parsed;
+    parsed.reserve(level.size());
+    for (const std::string &lib : level) {
+      parsed.push_back(std::async(std::launch::async, parse, lib,
+                                  std::cref(archs)));
+    }
+
+    std::vector<std::string> next;
+    for (size_t i = 0; i < parsed.size(); ++i) {
+      std::unique_ptr<Image> image = parsed[i].get();
+      if (image == nullptr) {
+        Logger::err("Can't parse {}", level[i]);
+        if (images.empty()) {
+          return nullptr;
+        }
+        continue;
+      }
+      for (const std::string &needed : image->needed) {
+        const bool pe = image->pe != nullptr;
+        const std::string key = pe ? lower(file_name(needed))
+                                   : file_name(needed);
+        if (by_name_.count(key) != 0 || !seen.insert(key).second) {
+          continue;
+        }
+        std::string lib = find_library(needed, dir_name(image->path));
+        if (lib.empty()) {
+          Logger::warn("Can't find {}, needed by {}", needed, image->path);
+          continue;
+        }
+        next.push_back(std::move(lib));
+      }
+      index.emplace(image->key, images.size());
+      images.push_back(std::move(image));
+    }
+    level = std::move(next);
+  }
+
+  // Exports are looked up in breadth-first order, which is the order of
+  // images, after the ones of the previous loads
+  const size_t first_rank = next_rank_;
+  next_rank_ += images.size();
+
+  // Load the dependencies first (post-order). Cycles are broken at the
+  // first image met twice, whose symbols are then resolved by symlink().
+  std::vector<bool> visited(images.size(), false);
+  Loader *root = nullptr;
+  std::function<void(size_t)> load_image = [&](size_t idx) {
+    visited[idx] = true;
+    Image &image = *images[idx];
+    for (const std::string &needed : image.needed) {
+      const auto it = index.find(image.pe != nullptr ? lower(file_name(needed))
+                                                     : file_name(needed));
+      if (it != index.end() && !visited[it->second]) {
+        load_image(it->second);
+      }
+    }
+
+    Logger::debug("Loading {}", image.path);
+    std::unique_ptr<Loader> loader;
+    if (image.elf != nullptr) {
+      loader = Loaders::ELF::from_binary(std::move(image.elf), *system_,
+                                         binding);
+    } else if (image.macho != nullptr) {
+      loader = Loaders::MachO::from_binary(std::move(image.macho), *system_,
+                                           binding);
+    } else if (image.pe != nullptr) {
+      loader = Loaders::PE::from_binary(std::move(image.pe), *system_,
+                                        binding);
+    }
+    if (loader == nullptr) {
+      Logger::err("Can't load {}", image.path);
+      return;
+    }
+    add_exports(image, *loader, first_rank + idx);
+    by_name_.emplace(image.key, loader.get());
+    if (idx == 0) {
+      root = loader.get();
+    }
+    loaders_.push_back(std::move(loader));
+  };
+  load_image(0);
+  return root;
+}
+
+std::string Namespace::find_library(std::string const &name,
+                                    std::string const &origin) const {
+  if (!name.empty() && (name[0] == '/' || name.find(':') == 1) &&
+      is_file(name)) {
+    return name;
+  }
+  // Mach-O install names (@rpath/..., /usr/lib/...) are looked up by their
+  // file name
+  const std::string lib = file_name(name);
+  if (is_file(origin + "/" + lib)) {
+    return origin + "/" + lib;
+  }
+  for (const std::string &dir : search_paths_) {
+    if (is_file(dir + "/" + lib)) {
+      return dir + "/" + lib;
+    }
+  }
+  return {};
+}
+
+void Namespace::add_export(std::string key, uint64_t addr, size_t rank) {
+  const auto [it, inserted] =
+      exports_.try_emplace(std::move(key), ExportAddr{addr, rank});
+  if (!inserted && rank < it->second.rank) {
+    it->second = ExportAddr{addr, rank};
+  }
+}
+
+bool Namespace::exported_before(std::string const &key, size_t rank) const {
+  const auto it = exports_.find(key);
+  return it != exports_.end() && it->second.rank <= rank;
+}
+
+void Namespace::add_exports(Image const &image, Loader &loader,
+                            size_t rank) {
+  const auto add = [&](Export const &exported, uint64_t addr) {
+    if (!exported.version.empty()) {
+      add_export(export_key(exported.name, exported.version), addr, rank);
+    }
+    // Only the default version of a name satisfies unversioned imports
+    if (!exported.hidden) {
+      add_export(exported.name, addr, rank);
+    }
+  };
+  const auto addresses = [&](std::vector<Export> const &exports) {
+    std::vector<uint64_t> addrs;
+    if (image.by_rva) {
+      addrs.reserve(exports.size());
+      for (const Export &exported : exports) {
+        addrs.push_back(loader.get_address(exported.rva));
+      }
+      return addrs;
+    }
+    std::vector<std::string> names;
+    names.reserve(exports.size());
+    for (const Export &exported : exports) {
+      names.push_back(exported.name);
+    }
+    return loader.get_addresses(names);
+  };
+
+  const std::vector<uint64_t> addrs = addresses(image.exports);
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    if (addrs[i] != 0) {
+      add(image.exports[i], addrs[i]);
+    }
+  }
+  // The implementation of an IFUNC is selected once, when it is exported
+  const std::vector<uint64_t> resolvers = addresses(image.ifuncs);
+  for (size_t i = 0; i < resolvers.size(); ++i) {
+    const Export &ifunc = image.ifuncs[i];
+    if (resolvers[i] == 0 ||
+        exported_before(export_key(ifunc.name, ifunc.version), rank)) {
+      continue;
+    }
+    const uint64_t addr = engine_.resolve_ifunc(loader, resolvers[i]);
+    if (addr != 0) {
+      add(ifunc, addr);
+    }
+  }
+}
+
+uint64_t Namespace::lookup(std::string const &name,
+                           std::string const &version) const {
+  // As the glibc, an unversioned definition satisfies a versioned import
+  auto it = exports_.find(export_key(name, version));
+  if (it == exports_.end() && !version.empty()) {
+    it = exports_.find(name);
+  }
+  return it != exports_.end() ? it->second.addr : 0;
+}
+
+uint64_t Namespace::find(std::string const &name) const {
+  return lookup(name, {});
+}
+
+Loader *Namespace::get(std::string const &name) const {
+  auto it = by_name_.find(name);
+  if (it == by_name_.end()) {
+    it = by_name_.find(lower(name));
+  }
+  return it != by_name_.end() ? it->second : nullptr;
+}
+
+std::vector<Loader *> Namespace::loaders() const {
+  std::vector<Loader *> ret;
+  ret.reserve(loaders_.size());
+  for (const std::unique_ptr<Loader> &loader : loaders_) {
+    ret.push_back(loader.get());
+  }
+  return ret;
+}
+
+} // namespace QBDL
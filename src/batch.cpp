@@ -0,0 +1,94 @@
+#include "batch.hpp"
+#include "intmem.hpp"
+#include <QBDL/Engine.hpp>
+
+namespace QBDL {
+
+namespace {
+size_t ptr_size(Arch const &arch) {
+  return arch.is64 ? sizeof(uint64_t) : sizeof(uint32_t);
+}
+
+template <class T> void store_ptr(Arch const &arch, void *dst, uint64_t ptr) {
+  if (arch.endianness == LIEF::ENDIANNESS::ENDIAN_LITTLE) {
+    intmem::storeu_le<T>(dst, static_cast<T>(ptr));
+  } else {
+    intmem::storeu_be<T>(dst, static_cast<T>(ptr));
+  }
+}
+
+template <class T> uint64_t load_ptr(Arch const &arch, const void *src) {
+  if (arch.endianness == LIEF::ENDIANNESS::ENDIAN_LITTLE) {
+    return intmem::loadu_le<T>(src);
+  }
+  return intmem::loadu_be<T>(src);
+}
+} // namespace
+
+void WriteBatch::write(uint64_t addr, const void *buf, size_t len) {
+  const size_t offset = data_.size();
+  const auto *bytes = reinterpret_cast<const uint8_t *>(buf);
+  data_.insert(data_.end(), bytes, bytes + len);
+  if (!pending_.empty()) {
+    Pending &last = pending_.back();
+    if (last.addr + last.len == addr) {
+      last.len += len;
+      return;
+    }
+  }
+  pending_.push_back({addr, offset, len});
+}
+
+void WriteBatch::write_ptr(uint64_t addr, uint64_t ptr) {
+  uint8_t buf[sizeof(uint64_t)];
+  if (arch_.is64) {
+    store_ptr<uint64_t>(arch_, buf, ptr);
+  } else {
+    store_ptr<uint32_t>(arch_, buf, ptr);
+  }
+  write(addr, buf, ptr_size(arch_));
+}
+
+void WriteBatch::flush() {
+  if (pending_.empty()) {
+    return;
+  }
+  std::vector<TargetMemory::WriteSpan> spans;
+  spans.reserve(pending_.size());
+  for (const Pending &pending : pending_) {
+    spans.push_back({pending.addr, &data_[pending.offset], pending.len});
+  }
+  mem_.write_batch(spans);
+  pending_.clear();
+  data_.clear();
+}
+
+std::vector<uint64_t> read_ptrs(TargetMemory &mem, Arch const &arch,
+                                std::vector<uint64_t> const &addrs) {
+  const size_t size = ptr_size(arch);
+  std::vector<uint8_t> data(addrs.size() * size);
+  std::vector<TargetMemory::ReadSpan> spans;
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    if (!spans.empty()) {
+      TargetMemory::ReadSpan &last = spans.back();
+      if (last.addr + last.len == addrs[i]) {
+        last.len += size;
+        continue;
+      }
+    }
+    spans.push_back({addrs[i], &data[i * size], size});
+  }
+  if (!spans.empty()) {
+    mem.read_batch(spans);
+  }
+
+  std::vector<uint64_t> ret;
+  ret.reserve(addrs.size());
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    ret.push_back(arch.is64 ? load_ptr<uint64_t>(arch, &data[i * size])
+                            : load_ptr<uint32_t>(arch, &data[i * size]));
+  }
+  return ret;
+}
+
+} // namespace QBDL
@@ -0,0 +1,61 @@
+#ifndef QBDL_BATCH_H_
+#define QBDL_BATCH_H_
+
+#include <QBDL/arch.hpp>
+#include <QBDL/macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace QBDL {
+class TargetMemory;
+
+/** Accumulate writes to the target memory, and send them to the backend with
+ * a single ::QBDL::TargetMemory::write_batch call.
+ *
+ * Contiguous writes (GOT or IAT slots for instance) are merged into a single
+ * span.
+ */
+class WriteBatch {
+public:
+  WriteBatch(TargetMemory &mem, Arch const &arch) : mem_(mem), arch_(arch) {}
+  ~WriteBatch() { flush(); }
+
+  /** Queue a copy of \p buf to be written at \p addr.
+   */
+  void write(uint64_t addr, const void *buf, size_t len);
+
+  /** Queue a pointer value to be written at \p addr, encoded according to
+   * the architecture given to the constructor.
+   */
+  void write_ptr(uint64_t addr, uint64_t ptr);
+
+  /** Send the queued writes to the target memory.
+   */
+  void flush();
+
+private:
+  struct Pending {
+    uint64_t addr;
+    size_t offset; // in data_
+    size_t len;
+  };
+
+  TargetMemory &mem_;
+  const Arch arch_;
+  std::vector<uint8_t> data_;
+  std::vector<Pending> pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteBatch);
+};
+
+/** Read the pointer values stored at \p addrs with a single
+ * ::QBDL::TargetMemory::read_batch call.
+ */
+std::vector<uint64_t> read_ptrs(TargetMemory &mem, Arch const &arch,
+                                std::vector<uint64_t> const &addrs);
+
+} // namespace QBDL
+
+#endif
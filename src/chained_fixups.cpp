@@ -0,0 +1,199 @@
+#include "chained_fixups.hpp"
+#include "logging.hpp"
+
+#include <cstring>
+
+namespace QBDL {
+
+namespace {
+// Read the little-endian T at \p offset of \p data, if it is in bounds
+template <class T>
+bool read(const uint8_t *data, size_t size, uint64_t offset, T &value) {
+  if (offset > size || size - offset < sizeof(T)) {
+    return false;
+  }
+  value = intmem::loadu_le<T>(data + offset);
+  return true;
+}
+
+// Whether \p count entries of \p entry_size bytes at \p offset are in bounds
+bool fits(size_t size, uint64_t offset, uint64_t count, uint64_t entry_size) {
+  return offset <= size && count <= (size - offset) / entry_size;
+}
+
+// See DYLD_CHAINED_IMPORT* in <mach-o/fixup-chains.h>
+enum ImportFormat : uint32_t {
+  IMPORT = 1,
+  IMPORT_ADDEND = 2,
+  IMPORT_ADDEND64 = 3,
+};
+
+// Library ordinals are signed: the special lookups (main executable, flat
+// and weak lookups) are the top values of the field
+int lib_ordinal(uint64_t value, unsigned bits) {
+  const uint64_t sign = uint64_t{1} << (bits - 1);
+  return static_cast<int>(static_cast<int64_t>(value ^ sign) -
+                          static_cast<int64_t>(sign));
+}
+} // namespace
+
+bool ChainedFixups::parse(const uint8_t *data, size_t size) {
+  // dyld_chained_fixups_header
+  uint32_t version = 0;
+  uint32_t starts_offset = 0;
+  uint32_t imports_offset = 0;
+  uint32_t symbols_offset = 0;
+  uint32_t imports_count = 0;
+  uint32_t imports_format = 0;
+  uint32_t symbols_format = 0;
+  if (!read(data, size, 0, version) || !read(data, size, 4, starts_offset) ||
+      !read(data, size, 8, imports_offset) ||
+      !read(data, size, 12, symbols_offset) ||
+      !read(data, size, 16, imports_count) ||
+      !read(data, size, 20, imports_format) ||
+      !read(data, size, 24, symbols_format)) {
+    Logger::err("Truncated chained fixups header");
+    return false;
+  }
+  if (version != 0 || symbols_format != 0) {
+    Logger::err("Unsupported chained fixups (version {}, symbols format {})",
+                version, symbols_format);
+    return false;
+  }
+
+  // Imports. Counts are checked before allocating anything for them.
+  uint64_t import_size = 0;
+  switch (imports_format) {
+  case IMPORT:
+    import_size = 4;
+    break;
+  case IMPORT_ADDEND:
+    import_size = 8;
+    break;
+  case IMPORT_ADDEND64:
+    import_size = 16;
+    break;
+  default:
+    Logger::err("Unsupported chained fixups imports format {}",
+                imports_format);
+    return false;
+  }
+  if (!fits(size, imports_offset, imports_count, import_size)) {
+    Logger::err("Chained fixups imports are out of bounds");
+    return false;
+  }
+  imports_.clear();
+  imports_.reserve(imports_count);
+  for (uint64_t i = 0; i < imports_count; ++i) {
+    ChainedImport import{{}, 0, false, 0};
+    uint64_t name_offset = 0;
+    switch (imports_format) {
+    case IMPORT:
+    case IMPORT_ADDEND: {
+      // lib_ordinal:8 weak_import:1 name_offset:23, followed by an int32
+      // addend for IMPORT_ADDEND
+      const uint64_t offset = imports_offset + i * import_size;
+      uint32_t entry = 0;
+      if (!read(data, size, offset, entry)) {
+        return false;
+      }
+      import.lib_ordinal = lib_ordinal(entry & 0xFF, 8);
+      import.weak = ((entry >> 8) & 1) != 0;
+      name_offset = entry >> 9;
+      if (imports_format == IMPORT_ADDEND) {
+        int32_t addend = 0;
+        if (!read(data, size, offset + 4, addend)) {
+          return false;
+        }
+        import.addend = addend;
+      }
+      break;
+    }
+    case IMPORT_ADDEND64: {
+      // lib_ordinal:16 weak_import:1 reserved:15 name_offset:32, followed by
+      // an uint64 addend
+      const uint64_t offset = imports_offset + i * import_size;
+      uint64_t entry = 0;
+      uint64_t addend = 0;
+      if (!read(data, size, offset, entry) ||
+          !read(data, size, offset + 8, addend)) {
+        return false;
+      }
+      import.lib_ordinal = lib_ordinal(entry & 0xFFFF, 16);
+      import.weak = ((entry >> 16) & 1) != 0;
+      name_offset = entry >> 32;
+      import.addend = static_cast<int64_t>(addend);
+      break;
+    }
+    }
+    const uint64_t name = symbols_offset + name_offset;
+    if (name >= size) {
+      Logger::err("Invalid name of chained import #{}", i);
+      return false;
+    }
+    const char *str = reinterpret_cast<const char *>(data + name);
+    import.name = std::string_view{str, strnlen(str, size - name)};
+    imports_.push_back(import);
+  }
+
+  // dyld_chained_starts_in_image
+  uint32_t seg_count = 0;
+  if (!read(data, size, starts_offset, seg_count) ||
+      !fits(size, uint64_t{starts_offset} + 4, seg_count, 4)) {
+    Logger::err("Chained fixups starts are out of bounds");
+    return false;
+  }
+  segments_.clear();
+  segments_.resize(seg_count);
+  for (uint32_t i = 0; i < seg_count; ++i) {
+    uint32_t seg_info_offset = 0;
+    if (!read(data, size, starts_offset + 4 + uint64_t{i} * 4,
+              seg_info_offset)) {
+      return false;
+    }
+    if (seg_info_offset == 0) {
+      continue;
+    }
+
+    // dyld_chained_starts_in_segment
+    const uint64_t offset = uint64_t{starts_offset} + seg_info_offset;
+    Segment &segment = segments_[i];
+    uint16_t page_count = 0;
+    if (!read(data, size, offset + 4, segment.page_size) ||
+        !read(data, size, offset + 6, segment.format) ||
+        !read(data, size, offset + 8, segment.offset) ||
+        !read(data, size, offset + 20, page_count)) {
+      return false;
+    }
+    switch (segment.format) {
+    case PTR_ARM64E:
+    case PTR_64:
+    case PTR_64_OFFSET:
+    case PTR_ARM64E_USERLAND:
+    case PTR_ARM64E_USERLAND24:
+      break;
+    default:
+      Logger::err("Unsupported chained pointer format {}", segment.format);
+      return false;
+    }
+    if (!fits(size, offset + 22, page_count, 2)) {
+      Logger::err("Chained fixups page starts are out of bounds");
+      return false;
+    }
+    segment.page_starts.resize(page_count);
+    for (uint16_t page = 0; page < page_count; ++page) {
+      uint16_t &start = segment.page_starts[page];
+      if (!read(data, size, offset + 22 + page * 2, start)) {
+        return false;
+      }
+      // Several chains per page are only used by the 32-bit formats
+      if (start != PAGE_START_NONE && (start & 0x8000)) {
+        Logger::err("Unsupported chain start 0x{:x}", start);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace QBDL
@@ -0,0 +1,205 @@
+#ifndef QBDL_CHAINED_FIXUPS_H_
+#define QBDL_CHAINED_FIXUPS_H_
+
+#include "intmem.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace QBDL {
+
+/** Import of a LC_DYLD_CHAINED_FIXUPS table.
+ */
+struct ChainedImport {
+  std::string_view name;
+  int lib_ordinal; // 0 for the image itself, < 0 for the special lookups
+  bool weak;
+  int64_t addend;
+};
+
+/** Pointer decoded from a fixup chain.
+ */
+struct ChainedFixup {
+  uint64_t rva;     // of the pointer
+  bool bind;
+  uint32_t ordinal; // bind: index in ::QBDL::ChainedFixups::imports
+  int64_t addend;   // bind
+  uint64_t target;  // rebase: offset of the target from the image base
+  uint8_t high8;    // rebase: top byte of the pointer
+};
+
+/** Fixups of a Mach-O image described by LC_DYLD_CHAINED_FIXUPS.
+ *
+ * Instead of rebase and bind opcodes, recent images encode their fixups in
+ * place: each pointer to fix holds its target (or the index of an import)
+ * and the distance to the next pointer to fix in the same page. The payload
+ * of the load command only gives the import table and the first pointer of
+ * each page.
+ *
+ * Only the 64-bit pointer formats are supported. Pointer authentication of
+ * the arm64e formats is dropped: authenticated pointers are fixed up as plain
+ * ones.
+ */
+class ChainedFixups {
+public:
+  // See DYLD_CHAINED_PTR_* in <mach-o/fixup-chains.h>
+  enum PointerFormat : uint16_t {
+    PTR_ARM64E = 1,
+    PTR_64 = 2,
+    PTR_64_OFFSET = 6,
+    PTR_ARM64E_USERLAND = 9,
+    PTR_ARM64E_USERLAND24 = 12,
+  };
+
+  /** Decode the header, the import table and the chain starts of the
+   * LC_DYLD_CHAINED_FIXUPS payload \p data. \p data must outlive this object,
+   * as the names of the imports point into it.
+   *
+   * @returns false if the payload is invalid or uses an unsupported format
+   */
+  bool parse(const uint8_t *data, size_t size);
+
+  std::vector<ChainedImport> const &imports() const { return imports_; }
+
+  /** Number of segments described by the payload, including the ones
+   * without fixups (__PAGEZERO, __TEXT, ...). They are in the order of the
+   * segment load commands.
+   */
+  size_t segments_count() const { return segments_.size(); }
+
+  /** Call \p F(ChainedFixup const&) on each pointer of the chains of the
+   * segment \p idx, whose file content is \p content. Chains are followed
+   * in a single pass over \p content, which is not modified.
+   *
+   * @param[in] imagebase Preferred address of the image, to turn the targets
+   * of the formats that store addresses into offsets.
+   * @returns false if a chain goes out of \p content
+   */
+  template <class Func>
+  bool for_each_fixup(size_t idx, const uint8_t *content, size_t size,
+                      uint64_t imagebase, Func F) const;
+
+  /** Call \p F(ChainedFixup const&) on each pointer of the chain of
+   * \p format starting at \p offset of \p content, which is mapped at
+   * \p rva.
+   *
+   * This also walks the chains of the BIND_SUBOPCODE_THREADED_APPLY opcodes,
+   * which use the PTR_ARM64E format.
+   *
+   * @returns false if the chain goes out of \p content
+   */
+  template <class Func>
+  static bool for_each_in_chain(uint16_t format, const uint8_t *content,
+                                size_t size, size_t offset, uint64_t rva,
+                                uint64_t imagebase, Func F);
+
+private:
+  static constexpr uint16_t PAGE_START_NONE = 0xFFFF;
+
+  struct Segment {
+    uint64_t offset; // from the image base
+    uint16_t page_size;
+    uint16_t format;
+    std::vector<uint16_t> page_starts; // empty if the segment has no fixup
+  };
+
+  /** Decode the pointer \p raw of \p format into \p out, and return the
+   * distance to the next pointer of the chain (0 at its end).
+   */
+  static size_t decode(uint16_t format, uint64_t raw, uint64_t imagebase,
+                       ChainedFixup &out);
+
+  std::vector<ChainedImport> imports_;
+  std::vector<Segment> segments_;
+};
+
+inline size_t ChainedFixups::decode(uint16_t format, uint64_t raw,
+                                    uint64_t imagebase, ChainedFixup &out) {
+  out.bind = (raw >> 63) != 0;
+  out.ordinal = 0;
+  out.addend = 0;
+  out.target = 0;
+  out.high8 = 0;
+  if (format == PTR_64 || format == PTR_64_OFFSET) {
+    // bind: ordinal:24 addend:8 reserved:19 next:12 bind:1
+    // rebase: target:36 high8:8 reserved:7 next:12 bind:1
+    if (out.bind) {
+      out.ordinal = raw & 0xFFFFFF;
+      out.addend = (raw >> 24) & 0xFF;
+    } else {
+      out.target = raw & 0xFFFFFFFFF;
+      out.high8 = (raw >> 36) & 0xFF;
+      if (format == PTR_64) {
+        out.target -= imagebase;
+      }
+    }
+    return ((raw >> 51) & 0xFFF) * 4;
+  }
+
+  // arm64e: auth:1 bind:1 next:11 ...
+  const bool auth = (raw >> 63) != 0;
+  out.bind = ((raw >> 62) & 1) != 0;
+  if (out.bind) {
+    out.ordinal = raw & (format == PTR_ARM64E_USERLAND24 ? 0xFFFFFF : 0xFFFF);
+    if (!auth) {
+      // Sign-extend the 19-bit addend
+      out.addend = static_cast<int64_t>(raw << 13) >> 45;
+    }
+  } else if (auth) {
+    // The target of authenticated rebases always is an offset
+    out.target = raw & 0xFFFFFFFF;
+  } else {
+    out.target = raw & 0x7FFFFFFFFFF;
+    out.high8 = (raw >> 43) & 0xFF;
+    if (format == PTR_ARM64E) {
+      out.target -= imagebase;
+    }
+  }
+  return ((raw >> 51) & 0x7FF) * 8;
+}
+
+template <class Func>
+bool ChainedFixups::for_each_in_chain(uint16_t format, const uint8_t *content,
+                                      size_t size, size_t offset, uint64_t rva,
+                                      uint64_t imagebase, Func F) {
+  ChainedFixup fixup;
+  for (;;) {
+    if (offset > size || size - offset < sizeof(uint64_t)) {
+      return false;
+    }
+    const uint64_t raw = intmem::loadu_le<uint64_t>(content + offset);
+    const size_t next = decode(format, raw, imagebase, fixup);
+    fixup.rva = rva + offset;
+    F(static_cast<ChainedFixup const &>(fixup));
+    if (next == 0) {
+      return true;
+    }
+    offset += next;
+  }
+}
+
+template <class Func>
+bool ChainedFixups::for_each_fixup(size_t idx, const uint8_t *content,
+                                   size_t size, uint64_t imagebase,
+                                   Func F) const {
+  if (idx >= segments_.size()) {
+    return true;
+  }
+  const Segment &segment = segments_[idx];
+  for (size_t page = 0; page < segment.page_starts.size(); ++page) {
+    const uint16_t start = segment.page_starts[page];
+    if (start != PAGE_START_NONE &&
+        !for_each_in_chain(segment.format, content, size,
+                           page * segment.page_size + start, segment.offset,
+                           imagebase, F)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace QBDL
+
+#endif
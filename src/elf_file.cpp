@@ -0,0 +1,491 @@
+#include "elf_file.hpp"
+#include "intmem.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace QBDL {
+
+namespace {
+constexpr uint32_t PT_LOAD = 1;
+constexpr uint32_t PT_DYNAMIC = 2;
+constexpr uint32_t PT_NOTE = 4;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_DYNSYM = 11;
+constexpr uint32_t NT_GNU_BUILD_ID = 3;
+
+constexpr uint64_t DT_NULL = 0;
+constexpr uint64_t DT_HASH = 4;
+constexpr uint64_t DT_STRTAB = 5;
+constexpr uint64_t DT_SYMTAB = 6;
+constexpr uint64_t DT_STRSZ = 10;
+constexpr uint64_t DT_GNU_HASH = 0x6ffffef5;
+constexpr uint64_t DT_VERSYM = 0x6ffffff0;
+constexpr uint64_t DT_VERNEED = 0x6ffffffe;
+constexpr uint64_t DT_VERNEEDNUM = 0x6fffffff;
+
+constexpr uint16_t EM_386 = 3;
+constexpr uint16_t EM_MIPS = 8;
+constexpr uint16_t EM_PPC = 20;
+constexpr uint16_t EM_PPC64 = 21;
+constexpr uint16_t EM_ARM = 40;
+constexpr uint16_t EM_X86_64 = 62;
+constexpr uint16_t EM_AARCH64 = 183;
+
+bool in_range(uint64_t offset, uint64_t size, uint64_t total) {
+  return offset <= total && size <= total - offset;
+}
+} // namespace
+
+ElfFile::~ElfFile() {
+#if !defined(_WIN32)
+  if (data_ != nullptr && buffer_.empty()) {
+    ::munmap(const_cast<uint8_t *>(data_), size_);
+  }
+#endif
+}
+
+template <class T> T ElfFile::read(const uint8_t *ptr) const {
+  return little_ ? intmem::loadu_le<T>(ptr) : intmem::loadu_be<T>(ptr);
+}
+
+uint64_t ElfFile::word(const uint8_t *ptr) const {
+  return is64_ ? read<uint64_t>(ptr) : read<uint32_t>(ptr);
+}
+
+bool ElfFile::open(const char *path) {
+#if defined(_WIN32)
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return false;
+  }
+  buffer_.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(buffer_.data()), buffer_.size());
+  if (!in) {
+    return false;
+  }
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+#else
+  const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    Logger::debug("Can't open {}: {}", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  void *data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    Logger::debug("Can't map {}: {}", path, strerror(errno));
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(data);
+  size_ = st.st_size;
+#endif
+
+  // Identification and header
+  static constexpr uint8_t ELFMAG[4] = {0x7f, 'E', 'L', 'F'};
+  if (size_ < 16 || memcmp(data_, ELFMAG, sizeof(ELFMAG)) != 0 ||
+      (data_[4] != 1 && data_[4] != 2) || (data_[5] != 1 && data_[5] != 2)) {
+    return false;
+  }
+  is64_ = data_[4] == 2;
+  little_ = data_[5] == 1;
+  if (size_ < (is64_ ? 64u : 52u)) {
+    return false;
+  }
+  machine_ = read<uint16_t>(data_ + 18);
+  entrypoint_ = word(data_ + 24);
+  const uint64_t phoff = word(data_ + (is64_ ? 32 : 28));
+  shoff_ = word(data_ + (is64_ ? 40 : 32));
+  const uint16_t phentsize = read<uint16_t>(data_ + (is64_ ? 54 : 42));
+  const uint16_t phnum = read<uint16_t>(data_ + (is64_ ? 56 : 44));
+  const uint16_t shentsize = read<uint16_t>(data_ + (is64_ ? 58 : 46));
+  shnum_ = read<uint16_t>(data_ + (is64_ ? 60 : 48));
+  if (phentsize < (is64_ ? 56 : 32) ||
+      !in_range(phoff, uint64_t{phnum} * phentsize, size_)) {
+    return false;
+  }
+  if (shentsize < (is64_ ? 64 : 40) ||
+      !in_range(shoff_, uint64_t{shnum_} * shentsize, size_)) {
+    // Section headers are optional
+    shnum_ = 0;
+  }
+
+  // Program headers
+  imagebase_ = ~uint64_t{0};
+  segments_.reserve(phnum);
+  for (uint16_t i = 0; i < phnum; ++i) {
+    const uint8_t *phdr = data_ + phoff + uint64_t{i} * phentsize;
+    Segment segment;
+    segment.type = read<uint32_t>(phdr);
+    if (is64_) {
+      segment.flags = read<uint32_t>(phdr + 4);
+      segment.offset = read<uint64_t>(phdr + 8);
+      segment.vaddr = read<uint64_t>(phdr + 16);
+      segment.file_size = read<uint64_t>(phdr + 32);
+      segment.mem_size = read<uint64_t>(phdr + 40);
+      segment.align = read<uint64_t>(phdr + 48);
+    } else {
+      segment.offset = read<uint32_t>(phdr + 4);
+      segment.vaddr = read<uint32_t>(phdr + 8);
+      segment.file_size = read<uint32_t>(phdr + 16);
+      segment.mem_size = read<uint32_t>(phdr + 20);
+      segment.flags = read<uint32_t>(phdr + 24);
+      segment.align = read<uint32_t>(phdr + 28);
+    }
+    if (segment.type == PT_LOAD) {
+      imagebase_ = std::min(imagebase_, segment.vaddr - segment.offset);
+    }
+    segments_.push_back(segment);
+  }
+  if (imagebase_ == ~uint64_t{0}) {
+    imagebase_ = 0;
+  }
+
+  load_symtab();
+  load_dynamic();
+  return true;
+}
+
+Arch ElfFile::arch() const {
+  LIEF::ARCHITECTURES arch = LIEF::ARCH_NONE;
+  switch (machine_) {
+  case EM_386:
+  case EM_X86_64:
+    arch = LIEF::ARCH_X86;
+    break;
+  case EM_ARM:
+    arch = LIEF::ARCH_ARM;
+    break;
+  case EM_AARCH64:
+    arch = LIEF::ARCH_ARM64;
+    break;
+  case EM_MIPS:
+    arch = LIEF::ARCH_MIPS;
+    break;
+  case EM_PPC:
+  case EM_PPC64:
+    arch = LIEF::ARCH_PPC;
+    break;
+  }
+  return {arch, little_ ? LIEF::ENDIAN_LITTLE : LIEF::ENDIAN_BIG, is64_};
+}
+
+const uint8_t *ElfFile::content(uint64_t offset, uint64_t size) const {
+  if (!in_range(offset, size, size_)) {
+    return nullptr;
+  }
+  return data_ + offset;
+}
+
+const uint8_t *ElfFile::at(uint64_t vaddr, uint64_t size) const {
+  for (const Segment &segment : segments_) {
+    if (segment.type != PT_LOAD || vaddr < segment.vaddr) {
+      continue;
+    }
+    const uint64_t delta = vaddr - segment.vaddr;
+    if (in_range(delta, size, segment.file_size)) {
+      return content(segment.offset + delta, size);
+    }
+  }
+  return nullptr;
+}
+
+bool ElfFile::dynamic(uint64_t tag, uint64_t &value) const {
+  for (const auto &entry : dynamic_) {
+    if (entry.first == tag) {
+      value = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ElfFile::load_dynamic() {
+  const auto it =
+      std::find_if(segments_.begin(), segments_.end(),
+                   [](Segment const &s) { return s.type == PT_DYNAMIC; });
+  if (it == segments_.end()) {
+    return;
+  }
+  const size_t entsize = is64_ ? 16 : 8;
+  const uint8_t *dyn = content(it->offset, it->file_size);
+  if (dyn == nullptr) {
+    Logger::warn("PT_DYNAMIC is out of the file");
+    return;
+  }
+  for (uint64_t cur = 0; cur + entsize <= it->file_size; cur += entsize) {
+    const uint64_t tag = word(dyn + cur);
+    if (tag == DT_NULL) {
+      break;
+    }
+    dynamic_.emplace_back(tag, word(dyn + cur + entsize / 2));
+  }
+
+  uint64_t symtab = 0, strtab = 0, strsz = 0;
+  if (!dynamic(DT_SYMTAB, symtab) || !dynamic(DT_STRTAB, strtab) ||
+      !dynamic(DT_STRSZ, strsz)) {
+    return;
+  }
+  dynsym_.strings = reinterpret_cast<const char *>(at(strtab, strsz));
+  dynsym_.strings_size = dynsym_.strings != nullptr ? strsz : 0;
+  const size_t count = count_dynamic_symbols();
+  const size_t symsize = is64_ ? 24 : 16;
+  dynsym_.symbols = at(symtab, count * symsize);
+  if (dynsym_.symbols != nullptr) {
+    dynsym_.count = count;
+    nb_dynsyms_ = count;
+    load_versions();
+  }
+}
+
+void ElfFile::load_versions() {
+  uint64_t versym = 0, verneed = 0, verneednum = 0;
+  if (!dynamic(DT_VERSYM, versym) || !dynamic(DT_VERNEED, verneed) ||
+      !dynamic(DT_VERNEEDNUM, verneednum)) {
+    return;
+  }
+  versym_ = at(versym, nb_dynsyms_ * 2);
+  if (versym_ == nullptr) {
+    return;
+  }
+
+  // Elf_Verneed entries, each followed by its Elf_Vernaux entries. The
+  // version index of a symbol (in DT_VERSYM) is the vna_other of one of them.
+  uint64_t addr = verneed;
+  for (uint64_t i = 0; i < verneednum; ++i) {
+    const uint8_t *need = at(addr, 16);
+    if (need == nullptr) {
+      Logger::warn("DT_VERNEED is out of the file");
+      return;
+    }
+    const uint16_t cnt = read<uint16_t>(need + 2);
+    uint64_t aux_addr = addr + read<uint32_t>(need + 8);
+    for (uint16_t j = 0; j < cnt; ++j) {
+      const uint8_t *aux = at(aux_addr, 16);
+      if (aux == nullptr) {
+        Logger::warn("DT_VERNEED is out of the file");
+        return;
+      }
+      const uint16_t other = read<uint16_t>(aux + 6) & 0x7fff;
+      const uint32_t name = read<uint32_t>(aux + 8);
+      if (name < dynsym_.strings_size) {
+        const char *str = dynsym_.strings + name;
+        if (other >= versions_.size()) {
+          versions_.resize(other + 1);
+        }
+        versions_[other] =
+            std::string_view{str, strnlen(str, dynsym_.strings_size - name)};
+      }
+      aux_addr += read<uint32_t>(aux + 12);
+    }
+    const uint32_t next = read<uint32_t>(need + 12);
+    if (next == 0) {
+      break;
+    }
+    addr += next;
+  }
+}
+
+size_t ElfFile::count_dynamic_symbols() const {
+  // The number of dynamic symbols is not recorded in the dynamic section,
+  // but it can be deduced from the hash tables.
+  uint64_t addr = 0;
+  if (dynamic(DT_HASH, addr)) {
+    const uint8_t *hash = at(addr, 8);
+    if (hash != nullptr) {
+      return read<uint32_t>(hash + 4); // nchain
+    }
+  }
+  if (dynamic(DT_GNU_HASH, addr)) {
+    const uint8_t *hash = at(addr, 16);
+    if (hash == nullptr) {
+      return dynsym_.count;
+    }
+    const uint32_t nbuckets = read<uint32_t>(hash);
+    const uint32_t symoffset = read<uint32_t>(hash + 4);
+    const uint32_t bloom_size = read<uint32_t>(hash + 8);
+    const uint64_t buckets_addr =
+        addr + 16 + uint64_t{bloom_size} * (is64_ ? 8 : 4);
+    const uint8_t *buckets = at(buckets_addr, uint64_t{nbuckets} * 4);
+    if (buckets == nullptr) {
+      return dynsym_.count;
+    }
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < nbuckets; ++i) {
+      last = std::max(last, read<uint32_t>(buckets + i * 4));
+    }
+    if (last < symoffset) {
+      return symoffset;
+    }
+    // Walk the chain of the last bucket up to its end marker
+    const uint64_t chains_addr = buckets_addr + uint64_t{nbuckets} * 4;
+    for (;; ++last) {
+      const uint8_t *chain =
+          at(chains_addr + uint64_t{last - symoffset} * 4, 4);
+      if (chain == nullptr) {
+        return dynsym_.count;
+      }
+      if (read<uint32_t>(chain) & 1) {
+        return last + 1;
+      }
+    }
+  }
+  // Fall back to the size of the .dynsym section (see load_symtab())
+  return dynsym_.count;
+}
+
+void ElfFile::load_symtab() {
+  const size_t shentsize = read<uint16_t>(data_ + (is64_ ? 58 : 46));
+  const size_t symsize = is64_ ? 24 : 16;
+  const auto section = [&](size_t idx, uint64_t &offset, uint64_t &size,
+                           uint32_t &link) {
+    const uint8_t *shdr = data_ + shoff_ + idx * shentsize;
+    offset = word(shdr + (is64_ ? 24 : 16));
+    size = word(shdr + (is64_ ? 32 : 20));
+    link = read<uint32_t>(shdr + (is64_ ? 40 : 24));
+    return read<uint32_t>(shdr + 4);
+  };
+
+  for (size_t i = 0; i < shnum_; ++i) {
+    uint64_t offset, size;
+    uint32_t link;
+    const uint32_t type = section(i, offset, size, link);
+    if (type == SHT_DYNSYM) {
+      // Only used if there is no hash table to count the dynamic symbols
+      dynsym_.count = size / symsize;
+      continue;
+    }
+    if (type != SHT_SYMTAB || link >= shnum_) {
+      continue;
+    }
+    uint64_t str_offset, str_size;
+    uint32_t str_link;
+    section(link, str_offset, str_size, str_link);
+    symtab_.symbols = content(offset, size);
+    symtab_.strings =
+        reinterpret_cast<const char *>(content(str_offset, str_size));
+    if (symtab_.symbols != nullptr && symtab_.strings != nullptr) {
+      symtab_.count = size / symsize;
+      symtab_.strings_size = str_size;
+    }
+  }
+}
+
+bool ElfFile::dynamic_symbol(size_t idx, Symbol &sym) const {
+  if (idx >= nb_dynsyms_ || !read_symbol(dynsym_, idx, sym)) {
+    return false;
+  }
+  if (versym_ != nullptr && sym.shndx == 0) {
+    const uint16_t version = read<uint16_t>(versym_ + idx * 2) & 0x7fff;
+    if (version < versions_.size()) {
+      sym.version = versions_[version];
+    }
+  }
+  return true;
+}
+
+bool ElfFile::read_symbol(SymbolTable const &table, size_t idx,
+                          Symbol &sym) const {
+  const uint8_t *ptr = table.symbols + idx * (is64_ ? 24 : 16);
+  const uint32_t name = read<uint32_t>(ptr);
+  if (is64_) {
+    sym.type = ptr[4] & 0xf;
+    sym.shndx = read<uint16_t>(ptr + 6);
+    sym.value = read<uint64_t>(ptr + 8);
+    sym.size = read<uint64_t>(ptr + 16);
+  } else {
+    sym.value = read<uint32_t>(ptr + 4);
+    sym.size = read<uint32_t>(ptr + 8);
+    sym.type = ptr[12] & 0xf;
+    sym.shndx = read<uint16_t>(ptr + 14);
+  }
+  if (name >= table.strings_size) {
+    return false;
+  }
+  const char *str = table.strings + name;
+  sym.name = std::string_view{str, strnlen(str, table.strings_size - name)};
+  sym.version = {};
+  return true;
+}
+
+bool ElfFile::relocations(uint64_t tag, uint64_t size_tag, bool rela,
+                          std::vector<Reloc> &out) const {
+  uint64_t addr = 0, size = 0;
+  if (!dynamic(tag, addr) || !dynamic(size_tag, size)) {
+    return false;
+  }
+  const uint8_t *table = at(addr, size);
+  if (table == nullptr) {
+    Logger::warn("Relocation table out of the file");
+    return false;
+  }
+  const size_t wordsize = is64_ ? 8 : 4;
+  const size_t entsize = wordsize * (rela ? 3 : 2);
+  out.reserve(out.size() + size / entsize);
+  for (uint64_t cur = 0; cur + entsize <= size; cur += entsize) {
+    const uint64_t info = word(table + cur + wordsize);
+    Reloc reloc;
+    reloc.offset = word(table + cur);
+    reloc.type = is64_ ? info & 0xffffffff : info & 0xff;
+    reloc.symbol = is64_ ? info >> 32 : info >> 8;
+    reloc.addend = 0;
+    if (rela) {
+      reloc.addend = is64_ ? static_cast<int64_t>(word(table + cur + 16))
+                           : static_cast<int32_t>(word(table + cur + 8));
+    }
+    out.push_back(reloc);
+  }
+  return true;
+}
+
+std::string ElfFile::build_id() const {
+  for (const Segment &segment : segments_) {
+    if (segment.type != PT_NOTE) {
+      continue;
+    }
+    const uint8_t *notes = content(segment.offset, segment.file_size);
+    if (notes == nullptr) {
+      continue;
+    }
+    // Each note is a header (namesz, descsz, type) followed by the name and
+    // the description, both padded to 4 bytes.
+    uint64_t cur = 0;
+    while (cur + 12 <= segment.file_size) {
+      const uint64_t namesz = read<uint32_t>(notes + cur);
+      const uint64_t descsz = read<uint32_t>(notes + cur + 4);
+      const uint32_t type = read<uint32_t>(notes + cur + 8);
+      const uint64_t name = cur + 12;
+      const uint64_t desc = name + ((namesz + 3) & ~uint64_t{3});
+      cur = desc + ((descsz + 3) & ~uint64_t{3});
+      if (type != NT_GNU_BUILD_ID || namesz != 4 || descsz == 0 ||
+          descsz > 64 || desc + descsz > segment.file_size) {
+        continue;
+      }
+      if (memcmp(notes + name, "GNU", 4) == 0) {
+        return std::string(reinterpret_cast<const char *>(notes + desc),
+                           descsz);
+      }
+    }
+  }
+  return {};
+}
+
+} // namespace QBDL
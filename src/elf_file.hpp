@@ -0,0 +1,166 @@
+#ifndef QBDL_ELF_FILE_H_
+#define QBDL_ELF_FILE_H_
+
+#include <QBDL/arch.hpp>
+#include <QBDL/macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace QBDL {
+
+/** Read-only view over a memory-mapped ELF file.
+ *
+ * Contrary to `LIEF::ELF::Parser`, only the structures needed to load the
+ * file are decoded, and only when asked for: the program headers, the
+ * dynamic section, the dynamic symbols and the relocation tables. The
+ * section headers are only used to find the static symbols.
+ *
+ * Strings (symbol names) are views over the mapping, which lives as long as
+ * this object.
+ */
+class ElfFile {
+public:
+  struct Segment {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t file_size;
+    uint64_t mem_size;
+    uint64_t align;
+  };
+
+  struct Symbol {
+    std::string_view name;
+    uint64_t value;
+    uint64_t size;
+    uint16_t shndx; // 0 (SHN_UNDEF) for imports
+    uint8_t type;   // STT_*
+    // Version required by dynamic imports (DT_VERNEED), empty if none
+    std::string_view version;
+  };
+
+  struct Reloc {
+    uint64_t offset;
+    uint32_t type;
+    uint32_t symbol;
+    int64_t addend; // 0 for REL tables
+  };
+
+  ElfFile() = default;
+  ~ElfFile();
+
+  /** Map \p path and decode its header and program headers.
+   *
+   * @returns false if \p path is not a valid ELF file
+   */
+  bool open(const char *path);
+
+  bool is64() const { return is64_; }
+  uint16_t machine() const { return machine_; }
+  Arch arch() const;
+
+  /** Lowest (virtual address - file offset) of the PT_LOAD segments, as
+   * `LIEF::ELF::Binary::imagebase`.
+   */
+  uint64_t imagebase() const { return imagebase_; }
+  uint64_t entrypoint() const { return entrypoint_; }
+  std::vector<Segment> const &segments() const { return segments_; }
+
+  /** Content of the file at \p offset, or nullptr if [offset, offset + size)
+   * is out of the file.
+   */
+  const uint8_t *content(uint64_t offset, uint64_t size) const;
+
+  /** Content of the file mapped at the virtual address \p vaddr, or nullptr
+   * if [vaddr, vaddr + size) is not backed by a PT_LOAD segment.
+   */
+  const uint8_t *at(uint64_t vaddr, uint64_t size) const;
+
+  /** Value of the first \p tag entry of the dynamic section.
+   *
+   * @returns false if there is none
+   */
+  bool dynamic(uint64_t tag, uint64_t &value) const;
+
+  size_t nb_dynamic_symbols() const { return nb_dynsyms_; }
+  bool dynamic_symbol(size_t idx, Symbol &sym) const;
+
+  /** Call \p F(Symbol const&) on each dynamic symbol, and then on each
+   * static symbol (.symtab), if any.
+   */
+  template <class Func> void for_each_symbol(Func F) const {
+    Symbol sym;
+    for (size_t i = 0; i < nb_dynsyms_; ++i) {
+      if (dynamic_symbol(i, sym)) {
+        F(static_cast<Symbol const &>(sym));
+      }
+    }
+    for (size_t i = 0; i < symtab_.count; ++i) {
+      if (read_symbol(symtab_, i, sym)) {
+        F(static_cast<Symbol const &>(sym));
+      }
+    }
+  }
+
+  /** Decode the relocation table pointed to by the dynamic entries \p tag
+   * and \p size_tag (DT_RELA/DT_RELASZ, DT_REL/DT_RELSZ, DT_JMPREL/
+   * DT_PLTRELSZ).
+   *
+   * @returns false if the table is missing or out of the file
+   */
+  bool relocations(uint64_t tag, uint64_t size_tag, bool rela,
+                   std::vector<Reloc> &out) const;
+
+  /** Content of the NT_GNU_BUILD_ID note, or an empty string if there is
+   * none.
+   */
+  std::string build_id() const;
+
+private:
+  struct SymbolTable {
+    const uint8_t *symbols = nullptr;
+    size_t count = 0;
+    const char *strings = nullptr;
+    size_t strings_size = 0;
+  };
+
+  template <class T> T read(const uint8_t *ptr) const;
+  uint64_t word(const uint8_t *ptr) const;
+  bool read_symbol(SymbolTable const &table, size_t idx, Symbol &sym) const;
+  void load_dynamic();
+  void load_versions();
+  void load_symtab();
+  size_t count_dynamic_symbols() const;
+
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  std::vector<uint8_t> buffer_; // if the file could not be mapped
+
+  bool is64_ = false;
+  bool little_ = true;
+  uint16_t machine_ = 0;
+  uint64_t imagebase_ = 0;
+  uint64_t entrypoint_ = 0;
+  uint64_t shoff_ = 0;
+  uint16_t shnum_ = 0;
+  std::vector<Segment> segments_;
+  std::vector<std::pair<uint64_t, uint64_t>> dynamic_; // tag -> value
+
+  SymbolTable dynsym_;
+  size_t nb_dynsyms_ = 0;
+  const uint8_t *versym_ = nullptr;       // DT_VERSYM
+  std::vector<std::string_view> versions_; // version index -> name
+  SymbolTable symtab_;
+
+  DISALLOW_COPY_AND_ASSIGN(ElfFile);
+};
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,258 @@
+#include "logging.hpp"
+#include <QBDL/engines/Cached.hpp>
+#include <QBDL/utils.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace QBDL::Engines {
+
+namespace {
+constexpr size_t CACHE_PAGE_SIZE = 0x1000;
+
+// Pages that are only partially covered by [addr, addr+len), and thus need to
+// be fetched before being written.
+void partial_pages(uint64_t addr, size_t len, std::vector<uint64_t> &out) {
+  if (len == 0) {
+    return;
+  }
+  const uint64_t end = addr + len;
+  const uint64_t first = page_start(addr, CACHE_PAGE_SIZE);
+  const uint64_t last = page_start(end - 1, CACHE_PAGE_SIZE);
+  if (addr != first || end < first + CACHE_PAGE_SIZE) {
+    out.push_back(first);
+  }
+  if (last != first && page_align(end, CACHE_PAGE_SIZE) != end) {
+    out.push_back(last);
+  }
+}
+
+void all_pages(uint64_t addr, size_t len, std::vector<uint64_t> &out) {
+  const uint64_t end = addr + len;
+  for (uint64_t page = page_start(addr, CACHE_PAGE_SIZE); page < end;
+       page += CACHE_PAGE_SIZE) {
+    out.push_back(page);
+  }
+}
+} // namespace
+
+CachedTargetMemory::CachedTargetMemory(QBDL::TargetMemory &backend)
+    : backend_(backend) {}
+
+CachedTargetMemory::~CachedTargetMemory() { flush(); }
+
+uint64_t CachedTargetMemory::mmap(uint64_t hint, size_t len) {
+  const uint64_t ret = backend_.mmap(hint, len);
+  if (ret != 0) {
+    add_zeros(ret, len);
+  }
+  return ret;
+}
+
+uint64_t CachedTargetMemory::reserve(uint64_t hint, size_t len) {
+  const uint64_t ret = backend_.reserve(hint, len);
+  if (ret != 0) {
+    add_zeros(ret, len);
+  }
+  return ret;
+}
+
+bool CachedTargetMemory::commit(uint64_t addr, size_t len, int prot) {
+  return backend_.commit(addr, len, prot);
+}
+
+void CachedTargetMemory::release(uint64_t addr, size_t len) {
+  // Pending writes to this region are pointless
+  forget(addr, len);
+  backend_.release(addr, len);
+}
+
+bool CachedTargetMemory::mprotect(uint64_t addr, size_t len, int prot) {
+  // The backend might not accept writes anymore afterward
+  flush();
+  return backend_.mprotect(addr, len, prot);
+}
+
+bool CachedTargetMemory::map_file(uint64_t addr, size_t len, const char *path,
+                                  uint64_t offset, int prot) {
+  forget(addr, len);
+  return backend_.map_file(addr, len, path, offset, prot);
+}
+
+void CachedTargetMemory::write(uint64_t addr, const void *buf, size_t len) {
+  std::vector<uint64_t> pages;
+  partial_pages(addr, len, pages);
+  fetch(pages);
+  write_cached(addr, buf, len);
+}
+
+void CachedTargetMemory::read(void *dst, uint64_t addr, size_t len) {
+  std::vector<uint64_t> pages;
+  all_pages(addr, len, pages);
+  fetch(pages);
+  read_cached(dst, addr, len);
+}
+
+void CachedTargetMemory::write_batch(std::vector<WriteSpan> const &spans) {
+  std::vector<uint64_t> pages;
+  for (const WriteSpan &span : spans) {
+    partial_pages(span.addr, span.len, pages);
+  }
+  fetch(pages);
+  for (const WriteSpan &span : spans) {
+    write_cached(span.addr, span.buf, span.len);
+  }
+}
+
+void CachedTargetMemory::read_batch(std::vector<ReadSpan> const &spans) {
+  std::vector<uint64_t> pages;
+  for (const ReadSpan &span : spans) {
+    all_pages(span.addr, span.len, pages);
+  }
+  fetch(pages);
+  for (const ReadSpan &span : spans) {
+    read_cached(span.buf, span.addr, span.len);
+  }
+}
+
+void CachedTargetMemory::flush() {
+  struct Run {
+    uint64_t addr;
+    size_t offset; // in data
+    size_t len;
+  };
+  std::vector<uint8_t> data;
+  std::vector<Run> runs;
+  for (const auto &[addr, page] : pages_) {
+    if (!page.dirty) {
+      continue;
+    }
+    if (!runs.empty() && runs.back().addr + runs.back().len == addr) {
+      runs.back().len += CACHE_PAGE_SIZE;
+    } else {
+      runs.push_back({addr, data.size(), CACHE_PAGE_SIZE});
+    }
+    data.insert(data.end(), page.data.get(),
+                page.data.get() + CACHE_PAGE_SIZE);
+  }
+
+  if (!runs.empty()) {
+    std::vector<WriteSpan> spans;
+    spans.reserve(runs.size());
+    for (const Run &run : runs) {
+      spans.push_back({run.addr, &data[run.offset], run.len});
+    }
+    Logger::debug("Flushing {:d} dirty pages in {:d} runs",
+                  data.size() / CACHE_PAGE_SIZE, runs.size());
+    backend_.write_batch(spans);
+  }
+  backend_.flush();
+
+  // The target can modify its memory from now on, so nothing can be
+  // assumed about it anymore.
+  pages_.clear();
+  zeros_.clear();
+}
+
+void CachedTargetMemory::fetch(std::vector<uint64_t> const &addrs) {
+  std::vector<ReadSpan> spans;
+  for (const uint64_t addr : addrs) {
+    if (pages_.count(addr) != 0) {
+      continue;
+    }
+    Page &page = pages_[addr];
+    page.dirty = false;
+    if (is_zero(addr)) {
+      page.data.reset(new uint8_t[CACHE_PAGE_SIZE]());
+    } else {
+      page.data.reset(new uint8_t[CACHE_PAGE_SIZE]);
+      spans.push_back({addr, page.data.get(), CACHE_PAGE_SIZE});
+    }
+  }
+  if (!spans.empty()) {
+    backend_.read_batch(spans);
+  }
+}
+
+uint8_t *CachedTargetMemory::page(uint64_t page_addr) {
+  Page &page = pages_[page_addr];
+  if (!page.data) {
+    // Only happens for pages that are about to be entirely overwritten
+    page.data.reset(new uint8_t[CACHE_PAGE_SIZE]);
+  }
+  page.dirty = true;
+  return page.data.get();
+}
+
+void CachedTargetMemory::add_zeros(uint64_t addr, size_t len) {
+  forget(addr, len);
+  const uint64_t start = page_align(addr, CACHE_PAGE_SIZE);
+  const uint64_t end = page_start(addr + len, CACHE_PAGE_SIZE);
+  if (start < end) {
+    zeros_.emplace(start, end);
+  }
+}
+
+bool CachedTargetMemory::is_zero(uint64_t page_addr) const {
+  auto it = zeros_.upper_bound(page_addr);
+  if (it == zeros_.begin()) {
+    return false;
+  }
+  --it;
+  return page_addr < it->second;
+}
+
+void CachedTargetMemory::forget(uint64_t addr, size_t len) {
+  const uint64_t start = page_start(addr, CACHE_PAGE_SIZE);
+  const uint64_t end = page_align(addr + len, CACHE_PAGE_SIZE);
+  pages_.erase(pages_.lower_bound(start), pages_.lower_bound(end));
+
+  auto it = zeros_.upper_bound(start);
+  if (it != zeros_.begin()) {
+    --it;
+  }
+  while (it != zeros_.end() && it->first < end) {
+    const uint64_t zstart = it->first;
+    const uint64_t zend = it->second;
+    if (zend <= start) {
+      ++it;
+      continue;
+    }
+    it = zeros_.erase(it);
+    if (zstart < start) {
+      zeros_.emplace(zstart, start);
+    }
+    if (zend > end) {
+      zeros_.emplace(end, zend);
+    }
+  }
+}
+
+void CachedTargetMemory::write_cached(uint64_t addr, const void *buf,
+                                      size_t len) {
+  const auto *src = reinterpret_cast<const uint8_t *>(buf);
+  while (len > 0) {
+    const uint64_t page_addr = page_start(addr, CACHE_PAGE_SIZE);
+    const size_t offset = addr - page_addr;
+    const size_t size = std::min(len, CACHE_PAGE_SIZE - offset);
+    memcpy(page(page_addr) + offset, src, size);
+    addr += size;
+    src += size;
+    len -= size;
+  }
+}
+
+void CachedTargetMemory::read_cached(void *dst, uint64_t addr, size_t len) {
+  auto *out = reinterpret_cast<uint8_t *>(dst);
+  while (len > 0) {
+    const uint64_t page_addr = page_start(addr, CACHE_PAGE_SIZE);
+    const size_t offset = addr - page_addr;
+    const size_t size = std::min(len, CACHE_PAGE_SIZE - offset);
+    memcpy(out, pages_.at(page_addr).data.get() + offset, size);
+    addr += size;
+    out += size;
+    len -= size;
+  }
+}
+
+} // namespace QBDL::Engines
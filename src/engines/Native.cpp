@@ -1,5 +1,14 @@
 #include "logging.hpp"
+#include "tls.hpp"
+#include "trampoline.hpp"
+#include <QBDL/Loader.hpp>
 #include <QBDL/engines/Native.hpp>
+#include <QBDL/loaders/PE.hpp>
+#include <QBDL/utils.hpp>
+
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
 
 static_assert(
     sizeof(uintptr_t) <= sizeof(uint64_t),
@@ -15,18 +24,128 @@ void TargetMemory::read(void *buf, uint64_t addr, size_t size) {
   memcpy(buf, reinterpret_cast<const void *>(addr), size);
 }
 
+uint64_t TargetMemory::take_free(size_t len, size_t align) {
+  std::lock_guard<std::mutex> lock(free_lock_);
+  // First fit
+  for (auto it = free_.begin(); it != free_.end(); ++it) {
+    const uint64_t start =
+        align != 0 ? page_align(it->first, align) : it->first;
+    const uint64_t end = it->second;
+    if (start >= end || end - start < len) {
+      continue;
+    }
+    const uint64_t region_start = it->first;
+    free_.erase(it);
+    if (region_start < start) {
+      free_.emplace(region_start, start);
+    }
+    if (start + len < end) {
+      free_.emplace(start + len, end);
+    }
+    return start;
+  }
+  return 0;
+}
+
+void TargetMemory::put_free(uint64_t addr, size_t len) {
+  std::lock_guard<std::mutex> lock(free_lock_);
+  uint64_t start = addr;
+  uint64_t end = addr + len;
+  // Coalesce with the adjacent regions
+  auto next = free_.lower_bound(start);
+  if (next != free_.end() && next->first == end) {
+    end = next->second;
+    next = free_.erase(next);
+  }
+  if (next != free_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->second == start) {
+      start = prev->first;
+      free_.erase(prev);
+    }
+  }
+  free_.emplace(start, end);
+}
+
 bool TargetSystem::supports(LIEF::Binary const &bin) {
   return Arch::from_bin(bin) == arch();
 }
 
+bool TargetSystem::supports_arch(Arch const &arch) {
+  return arch == Native::arch();
+}
+
+uint64_t TargetSystem::resolve_ifunc(Loader &loader, uint64_t resolver) {
+  if (loader.arch() != Native::arch()) {
+    return 0;
+  }
+  // Same arguments as the ones given by the glibc: none on x86, the hwcaps
+  // elsewhere.
+#if defined(__linux__) && defined(__aarch64__)
+  static constexpr uint64_t IFUNC_ARG_HWCAP = uint64_t{1} << 62;
+  struct {
+    unsigned long size;
+    unsigned long hwcap;
+    unsigned long hwcap2;
+  } arg = {sizeof(arg), getauxval(AT_HWCAP), getauxval(AT_HWCAP2)};
+  using resolver_t = uintptr_t (*)(uint64_t, void *);
+  return reinterpret_cast<resolver_t>(resolver)(arg.hwcap | IFUNC_ARG_HWCAP,
+                                                &arg);
+#elif defined(__linux__) && !defined(__i386__) && !defined(__x86_64__)
+  using resolver_t = uintptr_t (*)(unsigned long);
+  return reinterpret_cast<resolver_t>(resolver)(getauxval(AT_HWCAP));
+#else
+  using resolver_t = uintptr_t (*)();
+  return reinterpret_cast<resolver_t>(resolver)();
+#endif
+}
+
+TargetSystem::TlsModule TargetSystem::tls_register(Loader &loader,
+                                                   TlsImage const &image) {
+  // qbdl_tls_index only matches the layout of tls_index on 64-bit targets
+  if (loader.arch() != Native::arch() || !details::Is64Bit()) {
+    return {};
+  }
+  TlsModule module;
+  module.id = tls::register_module(
+      reinterpret_cast<const void *>(image.init_addr), image.init_size,
+      image.size, image.align);
+  if (module.id == 0) {
+    return {};
+  }
+  if (image.static_block) {
+    module.static_block = tls::reserve_static(module.id, module.tp_offset);
+  }
+  module.get_addr = reinterpret_cast<uintptr_t>(&_qbdl_tls_get_addr);
+#if defined(QBDL_HAS_TLSDESC)
+  init_trampolines();
+  module.tlsdesc = reinterpret_cast<uintptr_t>(&_qbdl_tlsdesc);
+#endif
+  return module;
+}
+
+void TargetSystem::tls_unregister(Loader &loader, TlsModule const &module) {
+  tls::unregister_module(module.id);
+}
+
+uint64_t TargetSystem::delay_load_helper(Loader &loader) {
+#if defined(QBDL_HAS_DELAY_LOAD)
+  if (loader.arch() == Native::arch()) {
+    return reinterpret_cast<uintptr_t>(&_qbdl_delay_load_helper);
+  }
+#endif
+  return 0;
+}
+
 uint64_t TargetSystem::base_address_hint(uint64_t binary_base_address,
                                          uint64_t virtual_size) {
   // Mean a random base address
   return 0;
 }
 
-QBDL_API std::unique_ptr<QBDL::TargetMemory> memory() {
-  QBDL::TargetMemory *Ret = new Native::TargetMemory{};
+QBDL_API std::unique_ptr<QBDL::TargetMemory>
+memory(MemoryPolicy const &policy) {
+  QBDL::TargetMemory *Ret = new Native::TargetMemory{policy};
   return std::unique_ptr<QBDL::TargetMemory>{Ret};
 }
 
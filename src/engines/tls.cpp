@@ -0,0 +1,208 @@
+#include "tls.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define QBDL_HAS_STATIC_TLS
+#define QBDL_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define QBDL_INITIAL_EXEC
+#endif
+
+// Blocks of the current thread, indexed by module id. The fast path only
+// reads these trivially destructible variables, and so does the one of the
+// TLSDESC resolver, hence their names and model.
+extern "C" {
+thread_local uint8_t **_qbdl_tls_dtv QBDL_INITIAL_EXEC = nullptr;
+thread_local size_t _qbdl_tls_dtv_size QBDL_INITIAL_EXEC = 0;
+}
+
+namespace QBDL::Engines::Native::tls {
+
+namespace {
+constexpr size_t MAX_MODULES = 4096;
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+// Static blocks of the modules. QBDL may be a dlopen()ed library, whose
+// initial-exec TLS comes from the small surplus of the libc: keep it small.
+constexpr size_t STATIC_SURPLUS = 512;
+constexpr size_t STATIC_ALIGN = 64;
+
+struct Template {
+  const uint8_t *init;
+  size_t init_size;
+  size_t size;
+  size_t align;
+  bool is_static;
+  int64_t tp_offset; // of the static block
+};
+
+std::mutex modules_lock;
+std::unique_ptr<Template> modules[MAX_MODULES];
+uint64_t next_module = 1;
+
+
+// Owner of the blocks of the current thread
+class ThreadBlocks {
+public:
+  ~ThreadBlocks() {
+    _qbdl_tls_dtv = nullptr;
+    _qbdl_tls_dtv_size = 0;
+  }
+
+  uint8_t *allocate(size_t size, size_t align);
+  void set(uint64_t id, uint8_t *block);
+
+private:
+  std::vector<uint8_t *> dtv_;
+  std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+  uint8_t *cur_ = nullptr;
+  uint8_t *end_ = nullptr;
+};
+
+thread_local ThreadBlocks t_blocks;
+
+#if defined(QBDL_HAS_STATIC_TLS)
+// With the initial-exec model, this area is at the same offset from the
+// thread pointer in every thread. Its template is zero.
+alignas(STATIC_ALIGN) thread_local uint8_t
+    t_static[STATIC_SURPLUS] QBDL_INITIAL_EXEC;
+size_t static_used = 0;
+
+uintptr_t thread_pointer() {
+  uintptr_t tp = 0;
+#if defined(__x86_64__)
+  asm("mov %%fs:0, %0" : "=r"(tp));
+#else
+  asm("mrs %0, tpidr_el0" : "=r"(tp));
+#endif
+  return tp;
+}
+#endif
+
+uint8_t *align_ptr(uint8_t *ptr, size_t align) {
+  const auto addr = reinterpret_cast<uintptr_t>(ptr);
+  return ptr + ((align - addr % align) % align);
+}
+
+uint8_t *ThreadBlocks::allocate(size_t size, size_t align) {
+  uint8_t *block = align_ptr(cur_, align);
+  if (cur_ == nullptr || size > static_cast<size_t>(end_ - block)) {
+    const size_t len = std::max(CHUNK_SIZE, size + align);
+    chunks_.emplace_back(new uint8_t[len]);
+    cur_ = chunks_.back().get();
+    end_ = cur_ + len;
+    block = align_ptr(cur_, align);
+  }
+  cur_ = block + size;
+  return block;
+}
+
+void ThreadBlocks::set(uint64_t id, uint8_t *block) {
+  if (id >= dtv_.size()) {
+    dtv_.resize(id + 1, nullptr);
+  }
+  dtv_[id] = block;
+  _qbdl_tls_dtv = dtv_.data();
+  _qbdl_tls_dtv_size = dtv_.size();
+}
+
+uint8_t *allocate_block(uint64_t id) {
+  std::lock_guard<std::mutex> lock(modules_lock);
+  const Template *tmpl = id < MAX_MODULES ? modules[id].get() : nullptr;
+  if (tmpl == nullptr) {
+    Logger::err("TLS access to the unknown module {}", id);
+    return nullptr;
+  }
+  uint8_t *block = nullptr;
+#if defined(QBDL_HAS_STATIC_TLS)
+  if (tmpl->is_static) {
+    // Already initialized, and maybe accessed through its offset
+    block = reinterpret_cast<uint8_t *>(thread_pointer() + tmpl->tp_offset);
+  }
+#endif
+  if (block == nullptr) {
+    block = t_blocks.allocate(tmpl->size, tmpl->align);
+    memcpy(block, tmpl->init, tmpl->init_size);
+    memset(block + tmpl->init_size, 0, tmpl->size - tmpl->init_size);
+  }
+  t_blocks.set(id, block);
+  return block;
+}
+} // namespace
+
+uint64_t register_module(const void *init, size_t init_size, size_t size,
+                         size_t align) {
+  auto tmpl = std::make_unique<Template>();
+  tmpl->init = static_cast<const uint8_t *>(init);
+  tmpl->init_size = init_size;
+  tmpl->size = std::max(size, init_size);
+  tmpl->align = std::max<size_t>(align, 1);
+  tmpl->is_static = false;
+  tmpl->tp_offset = 0;
+
+  std::lock_guard<std::mutex> lock(modules_lock);
+  if (next_module >= MAX_MODULES) {
+    Logger::err("Too many modules with thread-local storage");
+    return 0;
+  }
+  const uint64_t id = next_module++;
+  modules[id] = std::move(tmpl);
+  return id;
+}
+
+bool reserve_static(uint64_t id, int64_t &tp_offset) {
+#if defined(QBDL_HAS_STATIC_TLS)
+  std::lock_guard<std::mutex> lock(modules_lock);
+  Template *tmpl = id < MAX_MODULES ? modules[id].get() : nullptr;
+  if (tmpl == nullptr || STATIC_ALIGN % tmpl->align != 0) {
+    return false;
+  }
+  const size_t start =
+      (static_used + tmpl->align - 1) / tmpl->align * tmpl->align;
+  if (start > STATIC_SURPLUS || tmpl->size > STATIC_SURPLUS - start) {
+    return false;
+  }
+  static_used = start + tmpl->size;
+  tmpl->is_static = true;
+  tmpl->tp_offset = static_cast<int64_t>(
+      reinterpret_cast<uintptr_t>(&t_static[start]) - thread_pointer());
+  tp_offset = tmpl->tp_offset;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void unregister_module(uint64_t id) {
+  std::lock_guard<std::mutex> lock(modules_lock);
+  if (id < MAX_MODULES) {
+    modules[id].reset();
+  }
+}
+
+} // namespace QBDL::Engines::Native::tls
+
+using namespace QBDL::Engines::Native::tls;
+
+void *_qbdl_tls_get_addr(qbdl_tls_index *ti) {
+  const uint64_t id = ti->module;
+  uint8_t *block = id < _qbdl_tls_dtv_size ? _qbdl_tls_dtv[id] : nullptr;
+  if (block == nullptr) {
+    block = allocate_block(id);
+    if (block == nullptr) {
+      return nullptr;
+    }
+  }
+  return block + ti->offset;
+}
+
+void *_qbdl_tlsdesc_addr(uint64_t arg) {
+  qbdl_tls_index ti{arg >> 32, arg & 0xffffffff};
+  return _qbdl_tls_get_addr(&ti);
+}
@@ -0,0 +1,66 @@
+#ifndef QBDL_ENGINES_TLS_H_
+#define QBDL_ENGINES_TLS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Thread-local storage of the modules loaded in the current process.
+//
+// Each module gets an id, and each thread lazily allocates its blocks from a
+// per-thread pool the first time it accesses them. Accesses to an already
+// allocated block neither lock nor allocate.
+
+extern "C" {
+// Same layout as the tls_index of the ELF TLS ABI
+struct qbdl_tls_index {
+  uint64_t module;
+  uint64_t offset;
+};
+
+// Replacement for __tls_get_addr
+void *_qbdl_tls_get_addr(qbdl_tls_index *ti);
+
+// Address of the variable described by a TLSDESC argument, which is
+// (module << 32) | offset
+void *_qbdl_tlsdesc_addr(uint64_t arg);
+
+// TLSDESC resolver (see tlsdesc_*.S). It returns the offset of the variable
+// from the thread pointer, and preserves every other register.
+void _qbdl_tlsdesc();
+}
+
+namespace QBDL::Engines::Native::tls {
+
+/** Register the TLS template of a module: \p init_size bytes copied from
+ * \p init, followed by zeros up to \p size.
+ *
+ * \p init is read each time a thread allocates its block, and must stay
+ * valid until the module is unregistered.
+ *
+ * @returns the id of the module, or 0 if there are too many modules
+ */
+uint64_t register_module(const void *init, size_t init_size, size_t size,
+                         size_t align);
+
+/** Give the module \p id a static block, at the same offset from the thread
+ * pointer in every thread, for the static TLS models (initial and local
+ * exec). Dynamic accesses then resolve to this block too.
+ *
+ * Static blocks come from a fixed surplus area of the static TLS of QBDL,
+ * and are never reused: they are zero in every thread, existing or future,
+ * and only suit modules whose initialization image is zero.
+ *
+ * @returns false if the surplus area is exhausted, or if static TLS is not
+ * supported on this host. Otherwise, \p tp_offset is the offset of the block
+ * from the thread pointer.
+ */
+bool reserve_static(uint64_t id, int64_t &tp_offset);
+
+/** Unregister the module \p id. Blocks that threads already allocated for it
+ * are only released when these threads exit. Ids are never reused.
+ */
+void unregister_module(uint64_t id);
+
+} // namespace QBDL::Engines::Native::tls
+
+#endif
@@ -1,14 +1,360 @@
+#include "batch.hpp"
+#include "elf_file.hpp"
 #include "logging.hpp"
+#include "packed_relocs.hpp"
+#include "prelink.hpp"
+#include "protections.hpp"
+#include "relative.hpp"
+#include "reloc_plan.hpp"
+#include "symbol_index.hpp"
+#include "trampoline.hpp"
 #include <LIEF/ELF.hpp>
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
+#include <QBDL/engines/Native.hpp>
 #include <QBDL/loaders/ELF.hpp>
 #include <QBDL/utils.hpp>
 
+#include <algorithm>
+#include <fstream>
+
 using namespace LIEF::ELF;
 
 namespace QBDL::Loaders {
 
+namespace {
+int segment_prot(const Segment &segment) {
+  int prot = TargetMemory::NONE;
+  if (segment.has(ELF_SEGMENT_FLAGS::PF_R)) {
+    prot |= TargetMemory::READ;
+  }
+  if (segment.has(ELF_SEGMENT_FLAGS::PF_W)) {
+    prot |= TargetMemory::WRITE;
+  }
+  if (segment.has(ELF_SEGMENT_FLAGS::PF_X)) {
+    prot |= TargetMemory::EXEC;
+  }
+  return prot;
+}
+
+// How a relocation type is applied
+enum class Action {
+  UNSUPPORTED,
+  RELATIVE,
+  IRELATIVE,
+  SYMBOL,
+  SYMBOL_NO_ADDEND,
+  COPY,
+  TLS_MODULE,
+  TLS_OFFSET,
+  TLSDESC,
+  TLS_STATIC
+};
+
+Action reloc_action(ARCH machine, uint32_t type) {
+  if (machine == ARCH::EM_X86_64) {
+    switch (static_cast<RELOC_x86_64>(type)) {
+    case RELOC_x86_64::R_X86_64_RELATIVE:
+      return Action::RELATIVE;
+    case RELOC_x86_64::R_X86_64_IRELATIVE:
+      return Action::IRELATIVE;
+    case RELOC_x86_64::R_X86_64_64:
+      return Action::SYMBOL;
+    case RELOC_x86_64::R_X86_64_GLOB_DAT:
+    case RELOC_x86_64::R_X86_64_JUMP_SLOT:
+      return Action::SYMBOL_NO_ADDEND;
+    case RELOC_x86_64::R_X86_64_COPY:
+      return Action::COPY;
+    case RELOC_x86_64::R_X86_64_DTPMOD64:
+      return Action::TLS_MODULE;
+    case RELOC_x86_64::R_X86_64_DTPOFF64:
+      return Action::TLS_OFFSET;
+    case RELOC_x86_64::R_X86_64_TLSDESC:
+      return Action::TLSDESC;
+    case RELOC_x86_64::R_X86_64_TPOFF64:
+      return Action::TLS_STATIC;
+    default:
+      Logger::warn("Relocation type '{}' is not supported!",
+                   to_string(static_cast<RELOC_x86_64>(type)));
+      return Action::UNSUPPORTED;
+    }
+  }
+  if (machine == ARCH::EM_AARCH64) {
+    switch (static_cast<RELOC_AARCH64>(type)) {
+    case RELOC_AARCH64::R_AARCH64_RELATIVE:
+      return Action::RELATIVE;
+    case RELOC_AARCH64::R_AARCH64_IRELATIVE:
+      return Action::IRELATIVE;
+    case RELOC_AARCH64::R_AARCH64_ABS64:
+    case RELOC_AARCH64::R_AARCH64_GLOB_DAT:
+    case RELOC_AARCH64::R_AARCH64_JUMP_SLOT:
+      return Action::SYMBOL;
+    case RELOC_AARCH64::R_AARCH64_COPY:
+      return Action::COPY;
+    case RELOC_AARCH64::R_AARCH64_TLS_DTPMOD64:
+      return Action::TLS_MODULE;
+    case RELOC_AARCH64::R_AARCH64_TLS_DTPREL64:
+      return Action::TLS_OFFSET;
+    case RELOC_AARCH64::R_AARCH64_TLSDESC:
+      return Action::TLSDESC;
+    case RELOC_AARCH64::R_AARCH64_TLS_TPREL64:
+      return Action::TLS_STATIC;
+    default:
+      Logger::warn("Relocation type '{}' is not supported!",
+                   to_string(static_cast<RELOC_AARCH64>(type)));
+      return Action::UNSUPPORTED;
+    }
+  }
+  return Action::UNSUPPORTED;
+}
+
+// Version required by the import \p sym, or an empty string
+std::string_view import_version(const Symbol &sym) {
+  if (sym.shndx() != 0 || !sym.has_version()) {
+    return {};
+  }
+  const SymbolVersion &version = sym.symbol_version();
+  if (!version.has_auxiliary_version()) {
+    return {};
+  }
+  return version.symbol_version_auxiliary().name();
+}
+
+uint64_t rva_of(uint64_t imagebase, uint64_t addr) {
+  return addr >= imagebase ? addr - imagebase : addr;
+}
+
+// Compile a dynamic relocation at \p rva into \p out
+void add_reloc(ARCH machine, RelocPlan &plan, std::vector<PlanReloc> &out,
+               uint32_t type, uint64_t rva, const PlanSymbol *sym,
+               int64_t addend, bool rela) {
+  Action action = reloc_action(machine, type);
+  const bool tls = action == Action::TLS_MODULE ||
+                   action == Action::TLS_OFFSET || action == Action::TLSDESC ||
+                   action == Action::TLS_STATIC;
+  if (action != Action::UNSUPPORTED && action != Action::RELATIVE &&
+      action != Action::IRELATIVE && !tls && sym == nullptr) {
+    Logger::warn("Relocation at 0x{:x} has no symbol", rva);
+    action = Action::UNSUPPORTED;
+  }
+  // Without a symbol, TLS relocations refer to the module of the image
+  // (local-dynamic model).
+  if (tls && sym != nullptr && sym->tls < 0) {
+    if (action == Action::TLS_STATIC) {
+      // Its code would access whatever lies at the offset left in place
+      Logger::err("Static TLS variable {} of another module is not supported",
+                  sym->name);
+      plan.incomplete = true;
+    } else {
+      Logger::warn("TLS variable {} of another module is not supported",
+                   sym->name);
+    }
+    action = Action::UNSUPPORTED;
+  }
+
+  switch (action) {
+  case Action::UNSUPPORTED:
+    break;
+
+  case Action::RELATIVE:
+    out.push_back(
+        {rva, rela ? PlanReloc::RELATIVE : PlanReloc::REBASE, 0, addend});
+    break;
+
+  case Action::IRELATIVE:
+    out.push_back({rva, PlanReloc::IRELATIVE, 0, addend});
+    break;
+
+  case Action::TLS_MODULE:
+    out.push_back({rva, PlanReloc::TLS_MODULE, 0, 0});
+    break;
+
+  case Action::TLS_OFFSET:
+  case Action::TLSDESC:
+  case Action::TLS_STATIC:
+    out.push_back({rva,
+                   action == Action::TLS_OFFSET ? PlanReloc::TLS_OFFSET
+                   : action == Action::TLSDESC  ? PlanReloc::TLSDESC
+                                                : PlanReloc::TLS_STATIC,
+                   0, (sym != nullptr ? sym->tls : 0) + addend});
+    break;
+
+  case Action::COPY:
+    out.push_back({rva, PlanReloc::COPY,
+                   plan.name_id(sym->name, sym->version, sym->source),
+                   static_cast<int64_t>(sym->size)});
+    break;
+
+  case Action::SYMBOL_NO_ADDEND:
+    addend = 0;
+    // fallthrough
+  case Action::SYMBOL:
+    // Symbols exported by the binary itself are resolved right away, so that
+    // the plan does not depend on the base address.
+    if (sym->defined != 0 && sym->ifunc) {
+      if (addend != 0) {
+        Logger::warn("Addend of the reference to the IFUNC {} ignored",
+                     sym->name);
+      }
+      out.push_back({rva, PlanReloc::IRELATIVE, 0,
+                     static_cast<int64_t>(sym->defined)});
+      break;
+    }
+    if (sym->defined != 0) {
+      out.push_back({rva, PlanReloc::RELATIVE, 0,
+                     static_cast<int64_t>(sym->defined) + addend});
+      break;
+    }
+    out.push_back({rva, PlanReloc::SYMBOL,
+                   plan.name_id(sym->name, sym->version, sym->source), addend});
+    break;
+  }
+}
+
+// Compile the RELR and Android packed relocation tables. LIEF does not
+// decode them, so that they are missing from dynamic_relocations().
+//
+// \p read_table(tag, size_tag, std::vector<uint8_t>&) reads a table, and
+// \p symbol_at(index, PlanSymbol&) gives a dynamic symbol.
+template <class ReadTable, class SymbolAt>
+void add_packed(ARCH machine, bool is64, uint64_t imagebase, RelocPlan &plan,
+                ReadTable read_table, SymbolAt symbol_at) {
+  static constexpr uint64_t DT_RELRSZ = 35;
+  static constexpr uint64_t DT_RELR = 36;
+  static constexpr uint64_t DT_ANDROID_RELR = 0x6fffe000;
+  static constexpr uint64_t DT_ANDROID_RELRSZ = 0x6fffe001;
+  static constexpr auto DT_ANDROID_REL =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_ANDROID_REL);
+  static constexpr auto DT_ANDROID_RELSZ =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_ANDROID_RELSZ);
+  static constexpr auto DT_ANDROID_RELA =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_ANDROID_RELA);
+  static constexpr auto DT_ANDROID_RELASZ =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_ANDROID_RELASZ);
+
+  std::vector<uint8_t> table;
+  for (auto tags : {std::make_pair(DT_RELR, DT_RELRSZ),
+                    std::make_pair(DT_ANDROID_RELR, DT_ANDROID_RELRSZ)}) {
+    if (!read_table(tags.first, tags.second, table)) {
+      continue;
+    }
+    const bool ok =
+        for_each_relr(table.data(), table.size(), is64, [&](uint64_t offset) {
+          plan.relocs.push_back(
+              {rva_of(imagebase, offset), PlanReloc::REBASE, 0, 0});
+        });
+    if (!ok) {
+      Logger::warn("Truncated RELR table");
+    }
+  }
+
+  for (auto tags : {std::make_pair(DT_ANDROID_RELA, DT_ANDROID_RELASZ),
+                    std::make_pair(DT_ANDROID_REL, DT_ANDROID_RELSZ)}) {
+    if (!read_table(tags.first, tags.second, table)) {
+      continue;
+    }
+    const bool rela = tags.first == DT_ANDROID_RELA;
+    const bool ok = for_each_aps2(
+        table.data(), table.size(), [&](PackedReloc const &reloc) {
+          const uint32_t type = is64 ? reloc.info & 0xffffffff
+                                     : reloc.info & 0xff;
+          const uint64_t symidx = is64 ? reloc.info >> 32 : reloc.info >> 8;
+          PlanSymbol sym;
+          const bool has_sym = symidx != 0 && symbol_at(symidx, sym);
+          add_reloc(machine, plan, plan.relocs, type,
+                    rva_of(imagebase, reloc.offset), has_sym ? &sym : nullptr,
+                    reloc.addend, rela);
+        });
+    if (!ok) {
+      Logger::warn("Invalid Android packed relocation table");
+    }
+  }
+}
+
+// See "GNU hash ELF sections" (DT_GNU_HASH) and the System V ABI (DT_HASH)
+uint32_t gnu_hash(std::string_view name) {
+  uint32_t h = 5381;
+  for (const char c : name) {
+    h = h * 33 + static_cast<uint8_t>(c);
+  }
+  return h;
+}
+
+uint32_t sysv_hash(std::string_view name) {
+  uint32_t h = 0;
+  for (const char c : name) {
+    h = (h << 4) + static_cast<uint8_t>(c);
+    const uint32_t g = h & 0xf0000000;
+    if (g != 0) {
+      h ^= g >> 24;
+    }
+    h &= ~g;
+  }
+  return h;
+}
+
+const Symbol *gnu_lookup(const GnuHash &table,
+                         std::vector<const Symbol *> const &syms,
+                         std::string_view name, bool is64) {
+  const std::vector<uint32_t> &buckets = table.buckets();
+  if (buckets.empty()) {
+    return nullptr;
+  }
+  const uint32_t h = gnu_hash(name);
+
+  const std::vector<uint64_t> &bloom = table.bloom_filters();
+  if (!bloom.empty()) {
+    const uint32_t bits = is64 ? 64 : 32;
+    const uint64_t word = bloom[(h / bits) % bloom.size()];
+    const uint64_t mask = (uint64_t{1} << (h % bits)) |
+                          (uint64_t{1} << ((h >> table.shift2()) % bits));
+    if ((word & mask) != mask) {
+      return nullptr;
+    }
+  }
+
+  const uint32_t symndx = table.symbol_index();
+  const std::vector<uint32_t> &chain = table.hash_values();
+  uint32_t idx = buckets[h % buckets.size()];
+  if (idx < symndx) {
+    return nullptr;
+  }
+  for (; idx - symndx < chain.size() && idx < syms.size(); ++idx) {
+    const uint32_t h2 = chain[idx - symndx];
+    if ((h | 1) == (h2 | 1) && syms[idx]->name() == name) {
+      return syms[idx];
+    }
+    // The last entry of a chain has its lowest bit set
+    if (h2 & 1) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+const Symbol *sysv_lookup(const SysvHash &table,
+                          std::vector<const Symbol *> const &syms,
+                          std::string_view name) {
+  const std::vector<uint32_t> &buckets = table.buckets();
+  const std::vector<uint32_t> &chains = table.chains();
+  if (buckets.empty()) {
+    return nullptr;
+  }
+  uint32_t idx = buckets[sysv_hash(name) % buckets.size()];
+  // Bound the walk in case of a malformed (cyclic) chain
+  for (size_t i = 0; idx != 0 && i < chains.size(); ++i) {
+    if (idx >= syms.size() || idx >= chains.size()) {
+      return nullptr;
+    }
+    if (syms[idx]->name() == name) {
+      return syms[idx];
+    }
+    idx = chains[idx];
+  }
+  return nullptr;
+}
+} // namespace
+
 // This function is called by the _dl_resolve_internal()
 //
 // On x86-64 the plt/got push the **index** of the called function on
@@ -18,81 +364,383 @@ namespace QBDL::Loaders {
 uintptr_t ELF::dl_resolve(void *loader, uintptr_t hint) {
   static constexpr size_t GOT_RESERVED_ENTRIES_SIZE = 3;
   auto &ldr = *reinterpret_cast<QBDL::Loaders::ELF *>(loader);
-  const Binary &bin = ldr.get_binary();
 
-  const ARCH arch = ldr.get_binary().header().machine_type();
   uintptr_t plt_sym_idx = hint;
-  if (arch == ARCH::EM_AARCH64) {
-    const uintptr_t got_base = bin.get(DYNAMIC_TAGS::DT_PLTGOT).value();
-    plt_sym_idx =
-        (plt_sym_idx - ldr.base_address_ - got_base) / sizeof(uintptr_t);
+  if (ldr.arch_.arch == LIEF::ARCH_ARM64) {
+    plt_sym_idx = (plt_sym_idx - ldr.base_address_ - ldr.pltgot_rva_) /
+                  sizeof(uintptr_t);
     // We need to remove the first reserved entries to get the index
     plt_sym_idx -= GOT_RESERVED_ENTRIES_SIZE;
   }
 
-  auto pltgot = ldr.get_binary().pltgot_relocations();
-
-  if (plt_sym_idx >= pltgot.size()) {
+  if (plt_sym_idx >= ldr.plt_relocs_.size() ||
+      ldr.plt_relocs_[plt_sym_idx] == nullptr) {
     QBDL::Logger::err("PLT index out of range: {:d}", plt_sym_idx);
     return 0;
   }
 
-  const Relocation &plt_reloc = pltgot[plt_sym_idx];
+  const Relocation &plt_reloc = *ldr.plt_relocs_[plt_sym_idx];
   const Symbol &sym = plt_reloc.symbol();
-  const uintptr_t sym_addr = ldr.engine_->symlink(ldr, sym);
-  const uintptr_t addr_target = ldr.get_address(plt_reloc.address());
+  const uintptr_t sym_addr = ldr.resolve_or_symlink(sym);
+  const uintptr_t addr_target = ldr.base_address_ + plt_reloc.address();
 
   QBDL_INFO("Address of {}: 0x{:x}", sym.name(), sym_addr);
+  // The caller jumps to the symbol without going through a loader again: the
+  // slot must not stay in the cache of a deferring backend.
   ldr.engine_->mem().write_ptr(ldr.arch(), addr_target, sym_addr);
+  ldr.engine_->mem().flush();
   return sym_addr;
 }
 
 std::unique_ptr<ELF> ELF::from_file(const char *path, TargetSystem &engines,
                                     BIND binding) {
   Logger::info("Loading {}", path);
-  if (!is_elf(path)) {
+  auto file = std::make_unique<ElfFile>();
+  if (!file->open(path)) {
     Logger::err("{} is not an ELF file", path);
     return {};
   }
+  // TargetSystem::supports needs a parsed binary: the paths that don't parse
+  // it are only taken for the architectures accepted by
+  // TargetSystem::supports_arch.
+  const bool supported = engines.supports_arch(file->arch());
+  uint64_t file_key = 0;
+  if (binding == BIND::NOW && supported &&
+      !engines.prelink_cache_dir().empty()) {
+    file_key = prelink_key(path, file->build_id());
+    std::unique_ptr<ELF> loader = from_prelink(path, file_key, engines);
+    if (loader != nullptr) {
+      return loader;
+    }
+  }
+  std::string build_id;
+  if (binding == BIND::NOW && engines.cache_relocation_plans()) {
+    build_id = file->build_id();
+    if (supported && !build_id.empty()) {
+      std::unique_ptr<ELF> loader = from_plan(path, *file, build_id, engines);
+      if (loader != nullptr) {
+        return loader;
+      }
+    }
+  }
+  // Unless it is lazily bound, which needs the LIEF relocations, the binary
+  // is loaded from the mapped file and only parsed on demand.
+  if (binding != BIND::LAZY && supported) {
+    std::unique_ptr<ELF> loader(new ELF{nullptr, engines});
+    loader->path_ = path;
+    loader->file_key_ = file_key;
+    loader->build_id_ = build_id;
+    loader->arch_ = file->arch();
+    loader->file_ = std::move(file);
+    loader->index_file();
+    if (!loader->load(binding)) {
+      return {};
+    }
+    return loader;
+  }
+  file.reset();
+
   std::unique_ptr<Binary> bin = Parser::parse(path);
   if (bin == nullptr) {
     Logger::err("Can't parse {}", path);
     return {};
   }
-  return from_binary(std::move(bin), engines, binding);
+  return create(std::move(bin), engines, binding, path, file_key, build_id);
 }
 
 std::unique_ptr<ELF> ELF::from_binary(std::unique_ptr<Binary> bin,
                                       TargetSystem &engines, BIND binding) {
+  // The LIEF object might have been modified by the user, so its content
+  // can't be mapped from the original file.
+  return create(std::move(bin), engines, binding, nullptr);
+}
+
+std::unique_ptr<ELF> ELF::create(std::unique_ptr<Binary> bin,
+                                 TargetSystem &engines, BIND binding,
+                                 const char *path, uint64_t file_key,
+                                 std::string const &build_id) {
   if (!engines.supports(*bin)) {
     return {};
   }
   std::unique_ptr<ELF> loader(new ELF{std::move(bin), engines});
-  loader->load(binding);
+  if (path != nullptr) {
+    loader->path_ = path;
+    loader->file_key_ = file_key;
+    loader->build_id_ = build_id;
+  }
+  if (!loader->load(binding)) {
+    return {};
+  }
+  return loader;
+}
+
+std::unique_ptr<ELF> ELF::from_prelink(const char *path, uint64_t file_key,
+                                       TargetSystem &engines) {
+  const std::string cache_path =
+      PrelinkImage::path(engines.prelink_cache_dir(), file_key);
+  PrelinkImage img;
+  if (file_key == 0 || !img.read(cache_path) || img.file_key != file_key) {
+    return {};
+  }
+
+  TargetMemory &mem = engines.mem();
+  const uint64_t base_address = mem.reserve(img.base_address, img.mem_size);
+  if (base_address != img.base_address) {
+    Logger::debug("Prelinked base address 0x{:x} is not available",
+                  img.base_address);
+    if (base_address != 0) {
+      mem.release(base_address, img.mem_size);
+    }
+    return {};
+  }
+
+  std::unique_ptr<ELF> loader(new ELF{nullptr, engines});
+  loader->path_ = path;
+  loader->file_key_ = file_key;
+  loader->base_address_ = base_address;
+  loader->mem_size_ = img.mem_size;
+  loader->arch_ = img.arch;
+  loader->entrypoint_ = img.entrypoint;
+  loader->prelinked_ = true;
+
+  // The cached image is only valid if the imports still resolve to the same
+  // addresses.
+  for (const PrelinkImage::Entry &import : img.imports) {
+    const auto [name, version] = RelocPlan::split_name(import.first);
+    const Symbol sym{std::string{name}, ELF_SYMBOL_TYPES::STT_NOTYPE,
+                     SYMBOL_BINDINGS::STB_GLOBAL};
+    const uint64_t addr =
+        version.empty()
+            ? engines.symlink(*loader, sym)
+            : engines.symlink_versioned(*loader, sym, std::string{version});
+    if (addr != import.second) {
+      Logger::debug("{} resolves to another address, ignoring {}",
+                    import.first, cache_path);
+      return {};
+    }
+  }
+
+  Protections prots;
+  prots.set(0, img.mem_size, TargetMemory::NONE);
+  std::vector<uint8_t> content;
+  for (const PrelinkImage::Range &range : img.ranges) {
+    const uint64_t addr = base_address + range.rva;
+    prots.set(range.rva, range.rva + range.size, range.prot);
+    if (mem.map_file(addr, range.size, cache_path.c_str(), range.offset,
+                     range.prot)) {
+      continue;
+    }
+    if (!mem.commit(addr, range.size, range.prot) ||
+        !PrelinkImage::read_content(cache_path, range, content)) {
+      Logger::err("Can't load {} from {}", path, cache_path);
+      return {};
+    }
+    mem.write(addr, content.data(), content.size());
+  }
+  prots.apply(mem, base_address);
+  mem.flush();
+
+  for (PrelinkImage::Entry &sym : img.symbols) {
+    loader->prelinked_syms_.emplace(std::move(sym.first), sym.second);
+  }
+  for (PrelinkImage::Entry &import : img.imports) {
+    loader->imports_.emplace(std::move(import.first), import.second);
+  }
+  Logger::info("{} loaded from the prelink cache", path);
+  return loader;
+}
+
+void ELF::save_prelink(Protections const &prots) {
+  PrelinkImage img;
+  img.file_key = file_key_;
+  img.base_address = base_address_;
+  img.mem_size = mem_size_;
+  img.entrypoint = entrypoint() - base_address_;
+  img.arch = arch_;
+
+  bool readable = true;
+  prots.for_each([&](uint64_t start, uint64_t end, int prot) {
+    if (prot == TargetMemory::NONE) {
+      return;
+    }
+    readable &= (prot & TargetMemory::READ) != 0;
+    img.ranges.push_back({start, end - start, prot, 0});
+  });
+  if (!readable) {
+    Logger::debug("{} has unreadable segments, it can't be prelinked", path_);
+    return;
+  }
+
+  img.imports.assign(imports_.begin(), imports_.end());
+  img.symbols = exported_symbols();
+
+  const std::string cache_path =
+      PrelinkImage::path(engine_->prelink_cache_dir(), file_key_);
+  if (img.write(cache_path, engine_->mem())) {
+    Logger::debug("Prelinked image of {} saved to {}", path_, cache_path);
+  }
+}
+
+std::unique_ptr<ELF> ELF::from_plan(const char *path, ElfFile const &file,
+                                    std::string const &build_id,
+                                    TargetSystem &engines) {
+  const std::string plan_path = RelocPlan::path(path);
+  RelocPlan plan;
+  if (!plan.read(plan_path) || plan.build_id != build_id) {
+    return {};
+  }
+  // Segments are mapped from the file
+  for (const PlanSegment &segment : plan.segments) {
+    if (file.content(segment.offset, segment.file_size) == nullptr) {
+      Logger::debug("{} doesn't match {}", plan_path, path);
+      return {};
+    }
+  }
+
+  std::unique_ptr<ELF> loader(new ELF{nullptr, engines});
+  loader->path_ = path;
+  loader->arch_ = plan.arch;
+  if (!loader->map(plan)) {
+    Logger::err("Can't load {} from {}", path, plan_path);
+    return {};
+  }
+  if (!loader->register_tls(plan)) {
+    return {};
+  }
+  std::vector<uint64_t> imports;
+  loader->apply(plan, plan.relocs, imports);
+  loader->apply(plan, plan.plt, imports);
+  loader->run_ifuncs();
+  loader->protect(plan);
+  engines.mem().flush();
+
+  loader->entrypoint_ = plan.entrypoint;
+  loader->prelinked_ = true;
+  for (RelocPlan::Entry &sym : plan.symbols) {
+    loader->prelinked_syms_.emplace(std::move(sym.first), sym.second);
+  }
+  Logger::info("{} loaded from {}", path, plan_path);
   return loader;
 }
 
+void ELF::save_plan(RelocPlan &plan) {
+  plan.build_id = build_id_;
+  plan.symbols = exported_symbols();
+
+  const std::string plan_path = RelocPlan::path(path_);
+  if (plan.write(plan_path)) {
+    Logger::debug("Relocation plan of {} saved to {}", path_, plan_path);
+  }
+}
+
+std::vector<std::pair<std::string, uint64_t>> ELF::exported_symbols() const {
+  // Same lookup order as LIEF's has_symbol()/get_symbol()
+  std::unordered_map<std::string, uint64_t> symbols;
+  if (file_ != nullptr) {
+    file_->for_each_symbol([&](ElfFile::Symbol const &sym) {
+      symbols.emplace(sym.name, rva_of(file_->imagebase(), sym.value));
+    });
+  } else {
+    const Binary &binary = get_binary();
+    for (const Symbol &sym : binary.dynamic_symbols()) {
+      symbols.emplace(sym.name(), get_rva(binary, sym.value()));
+    }
+    for (const Symbol &sym : binary.static_symbols()) {
+      symbols.emplace(sym.name(), get_rva(binary, sym.value()));
+    }
+  }
+  return {symbols.begin(), symbols.end()};
+}
+
+void ELF::index_file() {
+  // Names are views over the mapping of the file. Dynamic symbols come
+  // first, so that they win over static ones.
+  file_->for_each_symbol([&](ElfFile::Symbol const &sym) {
+    if (sym.value > 0) {
+      symbols_->add(sym.name, rva_of(file_->imagebase(), sym.value));
+    }
+  });
+  symbols_->build();
+}
+
 ELF::ELF(std::unique_ptr<Binary> bin, TargetSystem &engines)
-    : Loader::Loader(engines), bin_{std::move(bin)} {
+    : Loader::Loader(engines), bin_{std::move(bin)},
+      dynindex_{std::make_unique<SymbolIndex>()},
+      symbols_{std::make_unique<SymbolIndex>()} {
+  if (bin_ == nullptr) {
+    return;
+  }
+  arch_ = Arch::from_bin(*bin_);
 
-  // Fill the symbol cache
-  for (Symbol &sym : get_binary().dynamic_symbols()) {
+  // Build the symbol index
+  const bool hashed = bin_->use_gnu_hash() || bin_->use_sysv_hash();
+  dynsyms_.reserve(bin_->dynamic_symbols().size());
+  for (const Symbol &sym : bin_->dynamic_symbols()) {
+    if (!hashed) {
+      dynindex_->add(sym.name(), dynsyms_.size());
+    }
+    dynsyms_.push_back(&sym);
+  }
+  for (const Symbol &sym : bin_->static_symbols()) {
     if (sym.value() > 0) {
-      sym_exp_[sym.name()] = &sym;
+      symbols_->add(sym.name(), sym.value());
     }
   }
+  dynindex_->build();
+  symbols_->build();
+}
+
+Binary &ELF::get_binary() {
+  if (bin_ == nullptr) {
+    bin_ = Parser::parse(path_);
+  }
+  return *bin_;
+}
+
+const Binary &ELF::get_binary() const {
+  if (bin_ == nullptr) {
+    bin_ = Parser::parse(path_);
+  }
+  return *bin_;
 }
 
 uint64_t ELF::get_address(const std::string &sym) const {
+  if (prelinked_) {
+    const auto it = prelinked_syms_.find(sym);
+    if (it == prelinked_syms_.end()) {
+      return 0;
+    }
+    return base_address_ + it->second;
+  }
+  if (file_ != nullptr) {
+    uint64_t rva = 0;
+    return symbols_->find(sym, rva) ? base_address_ + rva : 0;
+  }
   const Binary &binary = get_binary();
-  const LIEF::Symbol *symbol = nullptr;
-  if (binary.has_symbol(sym)) {
-    symbol = &binary.get_symbol(sym);
+  const Symbol *dynsym = find_dynamic(sym);
+  if (dynsym != nullptr && dynsym->value() > 0) {
+    return base_address_ + get_rva(binary, dynsym->value());
   }
-  if (symbol == nullptr) {
-    return 0;
+  uint64_t value = 0;
+  if (symbols_->find(sym, value)) {
+    return base_address_ + get_rva(binary, value);
+  }
+  return 0;
+}
+
+const Symbol *ELF::find_dynamic(std::string_view name) const {
+  const Binary &binary = get_binary();
+  if (binary.use_gnu_hash()) {
+    return gnu_lookup(binary.gnu_hash(), dynsyms_, name, arch_.is64);
   }
-  return base_address_ + get_rva(binary, symbol->value());
+  if (binary.use_sysv_hash()) {
+    return sysv_lookup(binary.sysv_hash(), dynsyms_, name);
+  }
+  uint64_t idx = 0;
+  if (dynindex_->find(name, idx)) {
+    return dynsyms_[idx];
+  }
+  return nullptr;
 }
 
 uint64_t ELF::get_address(uint64_t offset) const {
@@ -100,195 +748,759 @@ uint64_t ELF::get_address(uint64_t offset) const {
 }
 
 uint64_t ELF::entrypoint() const {
+  if (prelinked_ || file_ != nullptr) {
+    return base_address_ + entrypoint_;
+  }
   const Binary &binary = get_binary();
   return base_address_ + (binary.entrypoint() - binary.imagebase());
 }
 
-void ELF::load(BIND binding) {
-  Binary &binary = get_binary();
+void ELF::describe(RelocPlan &plan) const {
+  const Binary &binary = get_binary();
+  plan.arch = arch_;
+  plan.imagebase = binary.imagebase();
+  plan.mem_size =
+      page_align(binary.virtual_size() - page_offset(binary.imagebase()));
+  plan.entrypoint = binary.entrypoint() - binary.imagebase();
 
-  uint64_t virtual_size = binary.virtual_size();
-  virtual_size -= page_offset(binary.imagebase());
-  virtual_size = page_align(virtual_size);
-  mem_size_ = virtual_size;
+  for (const Segment &segment : binary.segments()) {
+    if (segment.type() != SEGMENT_TYPES::PT_LOAD) {
+      continue;
+    }
+    plan.segments.push_back({get_rva(binary, segment.virtual_address()),
+                             segment.virtual_size(), segment.file_offset(),
+                             segment.physical_size(), segment_prot(segment)});
+  }
+  if (binary.has(SEGMENT_TYPES::PT_GNU_RELRO)) {
+    const Segment &relro = binary.get(SEGMENT_TYPES::PT_GNU_RELRO);
+    plan.relro_rva = get_rva(binary, relro.virtual_address());
+    plan.relro_size = relro.virtual_size();
+  }
+  if (binary.has(SEGMENT_TYPES::PT_TLS)) {
+    const Segment &tls = binary.get(SEGMENT_TYPES::PT_TLS);
+    plan.tls_rva = get_rva(binary, tls.virtual_address());
+    plan.tls_init_size = tls.physical_size();
+    plan.tls_size = tls.virtual_size();
+    plan.tls_align = tls.alignment();
+  }
+}
 
-  Logger::debug("Virtual size: 0x{:x}", virtual_size);
+bool ELF::map(RelocPlan const &plan) {
+  mem_size_ = plan.mem_size;
+  Logger::debug("Virtual size: 0x{:x}", mem_size_);
 
   const uint64_t base_address_hint =
-      engine_->base_address_hint(binary.imagebase(), virtual_size);
+      engine_->base_address_hint(plan.imagebase, mem_size_);
   const uint64_t base_address =
-      engine_->mem().mmap(base_address_hint, virtual_size);
+      engine_->mem().reserve(base_address_hint, mem_size_);
   if (base_address == 0) {
-    Logger::err("mmap() failed! Abort.");
-    return;
+    Logger::err("reserve() failed! Abort.");
+    return false;
   }
   base_address_ = base_address;
 
-  // Map segments
-  // =======================================================
-  for (const Segment &segment : binary.segments()) {
-    if (segment.type() != SEGMENT_TYPES::PT_LOAD) {
-      continue;
+  // Only the pages covered by a PT_LOAD segment are committed, the padding
+  // between segments stays reserved. Pages mapped from the file are removed
+  // from this layout before committing it.
+  Protections layout;
+  for (const PlanSegment &segment : plan.segments) {
+    layout.add(page_start(segment.rva),
+               page_align(segment.rva + segment.mem_size), segment.prot);
+  }
+
+  // Segments are mapped with their final protection, unless relocations
+  // are applied to read-only segments (text relocations).
+  int extra_prot = TargetMemory::NONE;
+  for (const std::vector<PlanReloc> *list : {&plan.relocs, &plan.plt}) {
+    for (size_t i = 0; i < list->size() && extra_prot == TargetMemory::NONE;
+         ++i) {
+      for (const PlanSegment &segment : plan.segments) {
+        if (!(segment.prot & TargetMemory::WRITE) &&
+            (*list)[i].rva - segment.rva < segment.mem_size) {
+          extra_prot = TargetMemory::WRITE;
+        }
+      }
     }
-    const uint64_t rva = get_rva(binary, segment.virtual_address());
+  }
 
-    Logger::debug("Mapping {} - 0x{:x}", to_string(segment.type()), rva);
-    const std::vector<uint8_t> &content = segment.content();
-    if (content.size() > 0) {
-      engine_->mem().write(base_address + rva, content.data(), content.size());
+  std::vector<PlanSegment> to_copy;
+  uint64_t mapped_end = 0;
+  for (const PlanSegment &segment : plan.segments) {
+    Logger::debug("Mapping PT_LOAD - 0x{:x}", segment.rva);
+    // A segment starting in the last page of the previous one can't be
+    // mapped without overwriting it.
+    const bool can_map = page_start(segment.rva) >= mapped_end;
+    mapped_end = page_align(segment.rva + segment.mem_size);
+    if (!can_map || !map_from_file(segment, segment.prot | extra_prot)) {
+      to_copy.push_back(segment);
+      continue;
+    }
+    // The last page also contains whatever follows the segment in the file,
+    // whereas it must be zero (.bss or padding): it is copied.
+    const uint64_t file_end = segment.rva + segment.file_size;
+    layout.set(page_start(segment.rva), page_start(file_end),
+               TargetMemory::NONE);
+    if (page_offset(file_end) != 0) {
+      const uint64_t mapped = page_start(file_end) - segment.rva;
+      to_copy.push_back({segment.rva + mapped, segment.mem_size - mapped,
+                         segment.offset + mapped, segment.file_size - mapped,
+                         segment.prot});
     }
   }
 
-  using relocation_fcn_t = decltype(&ELF::reloc_x86_64);
-  relocation_fcn_t relocator = nullptr;
-  const LIEF::ELF::ARCH arch = get_binary().header().machine_type();
-  switch (arch) {
-  case LIEF::ELF::ARCH::EM_AARCH64: {
-    relocator = &ELF::reloc_aarch64;
-    break;
+  if (!layout.commit(engine_->mem(), base_address)) {
+    Logger::err("commit() failed! Abort.");
+    return false;
   }
 
-  case LIEF::ELF::ARCH::EM_X86_64: {
-    relocator = &ELF::reloc_x86_64;
-    break;
+  std::vector<uint8_t> content;
+  for (const PlanSegment &segment : to_copy) {
+    if (segment.prot == TargetMemory::NONE) {
+      // Never committed, nor accessible
+      continue;
+    }
+    if (!segment_content(segment, content)) {
+      Logger::err("Can't read the segment at 0x{:x}", segment.rva);
+      return false;
+    }
+    if (content.size() > 0) {
+      engine_->mem().write(base_address + segment.rva, content.data(),
+                           content.size());
+    }
   }
+  return true;
+}
 
-  default: {
-    Logger::err("Relocations not supported for the architecture: {}",
-                LIEF::ELF::to_string(arch));
-    break;
+bool ELF::segment_content(PlanSegment const &segment,
+                          std::vector<uint8_t> &out) const {
+  if (file_ != nullptr) {
+    const uint8_t *content = file_->content(segment.offset, segment.file_size);
+    if (content == nullptr) {
+      return false;
+    }
+    out.assign(content, content + segment.file_size);
+    return true;
   }
+  if (bin_ != nullptr) {
+    for (const Segment &lief_segment : bin_->segments()) {
+      if (lief_segment.type() == SEGMENT_TYPES::PT_LOAD &&
+          get_rva(*bin_, lief_segment.virtual_address()) == segment.rva) {
+        out = lief_segment.content();
+        return true;
+      }
+    }
+    return false;
   }
+  std::ifstream in(path_, std::ios::binary);
+  out.resize(segment.file_size);
+  in.seekg(segment.offset);
+  in.read(reinterpret_cast<char *>(out.data()), out.size());
+  return static_cast<bool>(in);
+}
 
-  if (relocator == nullptr) {
-    return;
+bool ELF::load(BIND binding) {
+  RelocPlan plan;
+  if (file_ != nullptr) {
+    if (!compile(*file_, plan)) {
+      return false;
+    }
+  } else {
+    // The relocations are needed to map the segments they patch writable
+    // (text relocations).
+    describe(plan);
+    if (!compile(plan)) {
+      return false;
+    }
+  }
+  if (plan.incomplete) {
+    Logger::err("{} uses unsupported relocations, it can't be loaded", path_);
+    return false;
+  }
+  if (!map(plan) || !register_tls(plan)) {
+    return false;
   }
 
   // Perform relocations
   // =======================================================
-  for (const Relocation &reloc : binary.dynamic_relocations()) {
-    (*this.*relocator)(reloc);
-  }
+  std::vector<uint64_t> imports;
+  apply(plan, plan.relocs, imports);
 
   // Bind symbols
   switch (binding) {
   case BIND::NOW:
-    bind_now(relocator);
+    apply(plan, plan.plt, imports);
     break;
 
-  case BIND::NOT_BIND:
   case BIND::LAZY:
+    bind_lazy(plan, imports);
     break;
+
+  case BIND::NOT_BIND:
+    break;
+  }
+  run_ifuncs();
+
+  const Protections prots = protect(plan);
+  engine_->mem().flush();
+
+  // Prelinked images are not registered in the TLS of the target
+  if (binding == BIND::NOW && file_key_ != 0 && plan.tls_size == 0) {
+    save_prelink(prots);
+  }
+  if (binding == BIND::NOW && !build_id_.empty()) {
+    save_plan(plan);
   }
+  return true;
 }
 
-void ELF::bind_now(ELF::relocator_t relocator) {
-  for (const Relocation &reloc : get_binary().pltgot_relocations()) {
-    (*this.*relocator)(reloc);
+Protections ELF::protect(RelocPlan const &plan) {
+  Protections prots;
+  // Padding between segments is left inaccessible
+  prots.set(0, mem_size_, TargetMemory::NONE);
+  for (const PlanSegment &segment : plan.segments) {
+    prots.add(page_start(segment.rva),
+              page_align(segment.rva + segment.mem_size), segment.prot);
   }
+
+  // Relocated data that is read-only afterward. As in the glibc, the end of
+  // the region is rounded down so that a partially covered page stays
+  // writable.
+  if (plan.relro_size != 0) {
+    prots.set(page_start(plan.relro_rva),
+              page_start(plan.relro_rva + plan.relro_size),
+              TargetMemory::READ);
+  }
+  prots.apply(engine_->mem(), base_address_);
+  return prots;
 }
 
-uintptr_t ELF::resolve(const LIEF::ELF::Symbol &sym) {
-  // Check if the given symbol is not exported by the binary itself.
-  // This could append in the case of a static link
-  // where the linker produces all the plt/got mechanism
-  // even though the symbol is in the final binary
-  const auto it_sym = sym_exp_.find(sym.name());
-  if (it_sym == std::end(sym_exp_)) {
-    return 0;
+bool ELF::map_from_file(PlanSegment const &segment, int prot) {
+  if (path_.empty() || segment.file_size == 0) {
+    return false;
   }
-  return get_address(it_sym->second->value());
+  const uint64_t rva = segment.rva;
+  const uint64_t offset = segment.offset;
+  if (page_offset(offset) != page_offset(rva)) {
+    return false;
+  }
+  // Only the pages entirely covered by the file content are mapped
+  const uint64_t map_start = page_start(rva);
+  const uint64_t map_end = page_start(rva + segment.file_size);
+  if (map_end <= map_start) {
+    return false;
+  }
+  return engine_->mem().map_file(base_address_ + map_start,
+                                 map_end - map_start, path_.c_str(),
+                                 page_start(offset), prot);
 }
 
-uintptr_t ELF::resolve_or_symlink(const LIEF::ELF::Symbol &sym) {
-  // First check if the symbol is not exported by the binary itself:
-  uintptr_t ret = resolve(sym);
-  if (ret == 0) {
-    ret = engine_->symlink(*this, sym);
+bool ELF::read_table(uint64_t tag, uint64_t size_tag,
+                     std::vector<uint8_t> &out) const {
+  const Binary &binary = get_binary();
+  const auto table_tag = static_cast<DYNAMIC_TAGS>(tag);
+  const auto table_size_tag = static_cast<DYNAMIC_TAGS>(size_tag);
+  if (!binary.has(table_tag) || !binary.has(table_size_tag)) {
+    return false;
   }
-  return ret;
+  const uint64_t addr = binary.get(table_tag).value();
+  const uint64_t size = binary.get(table_size_tag).value();
+  // Relocations are compiled before the image is mapped: the table is read
+  // from the segment that contains it.
+  for (const Segment &segment : binary.segments()) {
+    if (segment.type() != SEGMENT_TYPES::PT_LOAD ||
+        addr < segment.virtual_address()) {
+      continue;
+    }
+    const auto content = segment.content();
+    const uint64_t offset = addr - segment.virtual_address();
+    if (offset <= content.size() && size <= content.size() - offset) {
+      out.assign(content.begin() + offset, content.begin() + offset + size);
+      return true;
+    }
+  }
+  Logger::warn("Relocation table out of the image");
+  return false;
 }
 
-void ELF::reloc_x86_64(const LIEF::ELF::Relocation &reloc) {
-  const Arch binarch = arch();
-  const auto type = static_cast<RELOC_x86_64>(reloc.type());
-  const uintptr_t addr_target = base_address_ + reloc.address();
-  switch (type) {
-  case RELOC_x86_64::R_X86_64_64: {
-    const uintptr_t sym_addr = resolve_or_symlink(reloc.symbol());
-    engine_->mem().write_ptr(binarch, addr_target, sym_addr + reloc.addend());
-    break;
+bool ELF::compile(RelocPlan &plan) {
+  const Binary &binary = get_binary();
+  const ARCH machine = binary.header().machine_type();
+  if (machine != ARCH::EM_X86_64 && machine != ARCH::EM_AARCH64) {
+    Logger::err("Relocations not supported for the architecture: {}",
+                to_string(machine));
+    return false;
   }
 
-  case RELOC_x86_64::R_X86_64_RELATIVE: {
-    engine_->mem().write_ptr(binarch, addr_target,
-                             base_address_ + reloc.addend());
-    break;
+  plan.relocs.reserve(binary.dynamic_relocations().size());
+  for (const Relocation &reloc : binary.dynamic_relocations()) {
+    plan_reloc(plan, plan.relocs, reloc.type(), reloc.address(),
+               reloc.has_symbol() ? &reloc.symbol() : nullptr, reloc.addend(),
+               reloc.is_rela());
+  }
+  plan_packed(plan);
+  for (const Relocation &reloc : binary.pltgot_relocations()) {
+    plan_reloc(plan, plan.plt, reloc.type(), reloc.address(),
+               reloc.has_symbol() ? &reloc.symbol() : nullptr, reloc.addend(),
+               reloc.is_rela());
   }
+  return true;
+}
 
-  case RELOC_x86_64::R_X86_64_GLOB_DAT:
-  case RELOC_x86_64::R_X86_64_JUMP_SLOT: {
-    const uintptr_t sym_addr = resolve_or_symlink(reloc.symbol());
-    engine_->mem().write_ptr(binarch, addr_target, sym_addr);
-    break;
+bool ELF::compile(ElfFile const &file, RelocPlan &plan) {
+  static constexpr auto PT_LOAD = static_cast<uint32_t>(SEGMENT_TYPES::PT_LOAD);
+  static constexpr auto PT_GNU_RELRO =
+      static_cast<uint32_t>(SEGMENT_TYPES::PT_GNU_RELRO);
+  static constexpr auto PT_TLS = static_cast<uint32_t>(SEGMENT_TYPES::PT_TLS);
+  static constexpr auto DT_RELA = static_cast<uint64_t>(DYNAMIC_TAGS::DT_RELA);
+  static constexpr auto DT_RELASZ =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_RELASZ);
+  static constexpr auto DT_REL = static_cast<uint64_t>(DYNAMIC_TAGS::DT_REL);
+  static constexpr auto DT_RELSZ =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_RELSZ);
+  static constexpr auto DT_JMPREL =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_JMPREL);
+  static constexpr auto DT_PLTRELSZ =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_PLTRELSZ);
+  static constexpr auto DT_PLTREL =
+      static_cast<uint64_t>(DYNAMIC_TAGS::DT_PLTREL);
+
+  const auto machine = static_cast<ARCH>(file.machine());
+  if (machine != ARCH::EM_X86_64 && machine != ARCH::EM_AARCH64) {
+    Logger::err("Relocations not supported for the architecture: {}",
+                to_string(machine));
+    return false;
   }
 
-  case RELOC_x86_64::R_X86_64_COPY: {
-    const uintptr_t sym_addr = engine_->symlink(*this, reloc.symbol());
-    engine_->mem().write(addr_target, reinterpret_cast<const void *>(sym_addr),
-                         reloc.symbol().size());
-    break;
+  // Layout, as computed by describe() from the LIEF binary
+  const uint64_t imagebase = file.imagebase();
+  plan.arch = arch_;
+  plan.imagebase = imagebase;
+  plan.entrypoint = file.entrypoint() - imagebase;
+  entrypoint_ = plan.entrypoint;
+  uint64_t end = 0;
+  for (const ElfFile::Segment &segment : file.segments()) {
+    if (segment.type == PT_GNU_RELRO) {
+      plan.relro_rva = rva_of(imagebase, segment.vaddr);
+      plan.relro_size = segment.mem_size;
+      continue;
+    }
+    if (segment.type == PT_TLS) {
+      plan.tls_rva = rva_of(imagebase, segment.vaddr);
+      plan.tls_init_size = segment.file_size;
+      plan.tls_size = segment.mem_size;
+      plan.tls_align = segment.align;
+      continue;
+    }
+    if (segment.type != PT_LOAD) {
+      continue;
+    }
+    int prot = TargetMemory::NONE;
+    prot |= (segment.flags & 4) ? TargetMemory::READ : 0;
+    prot |= (segment.flags & 2) ? TargetMemory::WRITE : 0;
+    prot |= (segment.flags & 1) ? TargetMemory::EXEC : 0;
+    plan.segments.push_back({rva_of(imagebase, segment.vaddr),
+                             segment.mem_size, segment.offset,
+                             segment.file_size, prot});
+    end = std::max(end, segment.vaddr + segment.mem_size);
+  }
+  const uint64_t virtual_size = page_align(end) - imagebase;
+  plan.mem_size = page_align(virtual_size - page_offset(imagebase));
+
+  const auto symbol_at = [&](uint64_t idx, PlanSymbol &out) {
+    ElfFile::Symbol sym;
+    if (!file.dynamic_symbol(idx, sym)) {
+      return false;
+    }
+    static constexpr uint8_t STT_TLS = 6;
+    static constexpr uint8_t STT_GNU_IFUNC = 10;
+    out = PlanSymbol{sym.name, sym.version, sym.size, 0, false, -1, nullptr};
+    out.ifunc = sym.type == STT_GNU_IFUNC;
+    if (sym.type == STT_TLS) {
+      // The value of TLS symbols is an offset in the TLS block
+      if (sym.shndx != 0) {
+        out.tls = static_cast<int64_t>(sym.value);
+      }
+    } else if (sym.shndx != 0 && sym.value != 0) {
+      out.defined = rva_of(imagebase, sym.value);
+    }
+    return true;
+  };
+  std::vector<ElfFile::Reloc> relocs;
+  const auto add_table = [&](std::vector<PlanReloc> &out, uint64_t tag,
+                             uint64_t size_tag, bool rela) {
+    relocs.clear();
+    if (!file.relocations(tag, size_tag, rela, relocs)) {
+      return;
+    }
+    out.reserve(out.size() + relocs.size());
+    for (const ElfFile::Reloc &reloc : relocs) {
+      PlanSymbol sym;
+      const bool has_sym = reloc.symbol != 0 && symbol_at(reloc.symbol, sym);
+      add_reloc(machine, plan, out, reloc.type,
+                rva_of(imagebase, reloc.offset), has_sym ? &sym : nullptr,
+                reloc.addend, rela);
+    }
+  };
+
+  add_table(plan.relocs, DT_RELA, DT_RELASZ, true);
+  add_table(plan.relocs, DT_REL, DT_RELSZ, false);
+  add_packed(
+      machine, file.is64(), imagebase, plan,
+      [&](uint64_t tag, uint64_t size_tag, std::vector<uint8_t> &out) {
+        uint64_t addr = 0, size = 0;
+        if (!file.dynamic(tag, addr) || !file.dynamic(size_tag, size)) {
+          return false;
+        }
+        const uint8_t *table = file.at(addr, size);
+        if (table == nullptr) {
+          Logger::warn("Relocation table out of the file");
+          return false;
+        }
+        out.assign(table, table + size);
+        return true;
+      },
+      symbol_at);
+  uint64_t pltrel = DT_RELA;
+  file.dynamic(DT_PLTREL, pltrel);
+  add_table(plan.plt, DT_JMPREL, DT_PLTRELSZ, pltrel == DT_RELA);
+  return true;
+}
+
+PlanSymbol ELF::plan_symbol(const Symbol &sym) const {
+  PlanSymbol target{sym.name(), import_version(sym), sym.size(), 0, false, -1,
+                    &sym};
+  if (sym.type() == ELF_SYMBOL_TYPES::STT_TLS) {
+    // The value of TLS symbols is an offset in the TLS block
+    if (sym.shndx() != 0) {
+      target.tls = static_cast<int64_t>(sym.value());
+    }
+    return target;
+  }
+  const Symbol *exported = find_dynamic(sym.name());
+  if (exported != nullptr && exported->value() != 0) {
+    target.defined = get_rva(get_binary(), exported->value());
+    target.ifunc = exported->type() == ELF_SYMBOL_TYPES::STT_GNU_IFUNC;
   }
+  return target;
+}
 
-  default: {
-    Logger::warn("Relocation type '{}' is not supported!", to_string(type));
+void ELF::plan_reloc(RelocPlan &plan, std::vector<PlanReloc> &out,
+                     uint32_t type, uint64_t address, const Symbol *sym,
+                     int64_t addend, bool rela) const {
+  const Binary &binary = get_binary();
+  PlanSymbol target{};
+  if (sym != nullptr) {
+    target = plan_symbol(*sym);
   }
+  add_reloc(binary.header().machine_type(), plan, out, type,
+            get_rva(binary, address), sym != nullptr ? &target : nullptr,
+            addend, rela);
+}
+
+void ELF::plan_packed(RelocPlan &plan) {
+  const Binary &binary = get_binary();
+  add_packed(
+      binary.header().machine_type(), arch_.is64, binary.imagebase(), plan,
+      [this](uint64_t tag, uint64_t size_tag, std::vector<uint8_t> &out) {
+        return read_table(tag, size_tag, out);
+      },
+      [&](uint64_t idx, PlanSymbol &out) {
+        if (idx >= dynsyms_.size()) {
+          return false;
+        }
+        out = plan_symbol(*dynsyms_[idx]);
+        return true;
+      });
+}
+
+void ELF::apply(RelocPlan const &plan, std::vector<PlanReloc> const &relocs,
+                std::vector<uint64_t> &imports) {
+  // Each (name, version) is only given once to symlink()
+  static constexpr uint64_t UNRESOLVED = ~uint64_t{0};
+  imports.resize(plan.names.size(), UNRESOLVED);
+  const auto import = [&](uint32_t id) {
+    if (imports[id] == UNRESOLVED) {
+      const auto [name, version] = RelocPlan::split_name(plan.names[id]);
+      if (plan.sources[id] != nullptr) {
+        imports[id] = symlink(*plan.sources[id], version);
+      } else {
+        imports[id] = symlink(Symbol{std::string{name},
+                                     ELF_SYMBOL_TYPES::STT_NOTYPE,
+                                     SYMBOL_BINDINGS::STB_GLOBAL},
+                              version);
+      }
+    }
+    return imports[id];
+  };
+
+  // Relative relocations are applied first, and in bulk. The WriteBatch
+  // holding the other ones is flushed afterward.
+  WriteBatch batch{engine_->mem(), arch()};
+  RelativeRelocs relatives;
+  relatives.reserve(relocs.size());
+  for (const PlanReloc &reloc : relocs) {
+    const uint64_t addr = base_address_ + reloc.rva;
+    switch (reloc.kind) {
+    case PlanReloc::RELATIVE:
+      relatives.add(addr, base_address_ + reloc.addend);
+      break;
+    case PlanReloc::REBASE:
+      relatives.add_implicit(addr);
+      break;
+    case PlanReloc::SYMBOL:
+      batch.write_ptr(addr, import(reloc.symbol) + reloc.addend);
+      break;
+    case PlanReloc::COPY:
+      batch.write(addr, reinterpret_cast<const void *>(import(reloc.symbol)),
+                  reloc.addend);
+      break;
+    case PlanReloc::IRELATIVE:
+      // Resolvers may use relocated data and imports, they run once the
+      // image is bound (see run_ifuncs()).
+      ifuncs_.push_back(reloc);
+      break;
+    case PlanReloc::TLS_MODULE:
+      if (tls_.id != 0) {
+        batch.write_ptr(addr, tls_.id);
+      }
+      break;
+    case PlanReloc::TLS_OFFSET:
+      batch.write_ptr(addr, reloc.addend);
+      break;
+    case PlanReloc::TLSDESC:
+      // Resolver, followed by its argument
+      if (tls_.id != 0 && tls_.tlsdesc != 0) {
+        batch.write_ptr(addr, tls_.tlsdesc);
+        batch.write_ptr(addr + (arch().is64 ? 8 : 4),
+                        (tls_.id << 32) | static_cast<uint32_t>(reloc.addend));
+      }
+      break;
+    case PlanReloc::TLS_STATIC:
+      // register_tls() made sure that the module has a static block
+      batch.write_ptr(addr,
+                      static_cast<uint64_t>(tls_.tp_offset + reloc.addend));
+      break;
+    }
   }
+  relatives.apply(engine_->mem(), arch(), base_address_,
+                  engine_->relocation_threads());
+  batch.flush();
 }
 
-Arch ELF::arch() const { return Arch::from_bin(get_binary()); }
+void ELF::bind_lazy(RelocPlan &plan, std::vector<uint64_t> &imports) {
+#if defined(QBDL_HAS_DL_RESOLVE)
+  static constexpr size_t GOT_RESERVED_ENTRIES_SIZE = 3;
+  const Binary &binary = get_binary();
 
-void ELF::reloc_aarch64(const LIEF::ELF::Relocation &reloc) {
-  const Arch binarch = arch();
-  const auto type = static_cast<RELOC_AARCH64>(reloc.type());
-  const uintptr_t addr_target = base_address_ + reloc.address();
-  switch (type) {
-  case RELOC_AARCH64::R_AARCH64_RELATIVE: {
-    engine_->mem().write_ptr(binarch, addr_target,
-                             base_address_ + reloc.addend());
-    break;
+  // The .got.plt of an image linked with -z now may be covered by
+  // PT_GNU_RELRO, and it would be read-only by the time _dl_resolve() writes
+  // the resolved address.
+  const bool now =
+      (binary.has(DYNAMIC_TAGS::DT_FLAGS) &&
+       (binary.get(DYNAMIC_TAGS::DT_FLAGS).value() &
+        static_cast<uint64_t>(DYNAMIC_FLAGS::DF_BIND_NOW))) ||
+      (binary.has(DYNAMIC_TAGS::DT_FLAGS_1) &&
+       (binary.get(DYNAMIC_TAGS::DT_FLAGS_1).value() &
+        static_cast<uint64_t>(DYNAMIC_FLAGS_1::DF_1_NOW)));
+  if (now || !binary.has(DYNAMIC_TAGS::DT_PLTGOT)) {
+    apply(plan, plan.plt, imports);
+    return;
   }
 
-  case RELOC_AARCH64::R_AARCH64_JUMP_SLOT: {
-    const uintptr_t sym_addr = resolve_or_symlink(reloc.symbol());
-    engine_->mem().write_ptr(binarch, addr_target, sym_addr + reloc.addend());
-    break;
+  const ARCH machine = binary.header().machine_type();
+  uint32_t jump_slot = 0;
+  if (machine == ARCH::EM_X86_64) {
+    jump_slot = static_cast<uint32_t>(RELOC_x86_64::R_X86_64_JUMP_SLOT);
+  } else if (machine == ARCH::EM_AARCH64) {
+    jump_slot = static_cast<uint32_t>(RELOC_AARCH64::R_AARCH64_JUMP_SLOT);
   }
-  case RELOC_AARCH64::R_AARCH64_GLOB_DAT: {
-    const uintptr_t sym_addr = resolve_or_symlink(reloc.symbol());
-    engine_->mem().write_ptr(binarch, addr_target, sym_addr + reloc.addend());
-    break;
+  if (jump_slot == 0 || arch() != Engines::Native::arch()) {
+    Logger::warn("Lazy binding is not supported for this binary, binding "
+                 "now");
+    apply(plan, plan.plt, imports);
+    return;
   }
 
-  case RELOC_AARCH64::R_AARCH64_COPY: {
-    const uintptr_t sym_addr = engine_->symlink(*this, reloc.symbol());
-    engine_->mem().write(addr_target, reinterpret_cast<const void *>(sym_addr),
-                         reloc.symbol().size());
-    break;
+  pltgot_rva_ = get_rva(binary, binary.get(DYNAMIC_TAGS::DT_PLTGOT).value());
+  const uint64_t pltgot = base_address_ + pltgot_rva_;
+
+  // The PLT0 stub pushes GOT[1] and jumps to GOT[2]
+  init_trampolines();
+  WriteBatch batch{engine_->mem(), arch()};
+  batch.write_ptr(pltgot + 1 * sizeof(uintptr_t),
+                  reinterpret_cast<uintptr_t>(this));
+  batch.write_ptr(pltgot + 2 * sizeof(uintptr_t),
+                  reinterpret_cast<uintptr_t>(&_dl_resolve_internal));
+
+  // The JUMP_SLOT entries initially point into the PLT, and only need to be
+  // rebased. The other PLT relocations (IRELATIVE, ...) are processed now.
+  std::vector<PlanReloc> others;
+  std::vector<const Relocation *> slots;
+  std::vector<uint64_t> slot_addrs;
+  for (const Relocation &reloc : binary.pltgot_relocations()) {
+    if (reloc.type() != jump_slot) {
+      plan_reloc(plan, others, reloc.type(), reloc.address(),
+                 reloc.has_symbol() ? &reloc.symbol() : nullptr,
+                 reloc.addend(), reloc.is_rela());
+      continue;
+    }
+    slots.push_back(&reloc);
+    slot_addrs.push_back(base_address_ + reloc.address());
   }
+  const std::vector<uint64_t> stubs =
+      read_ptrs(engine_->mem(), arch(), slot_addrs);
 
-  case RELOC_AARCH64::R_AARCH64_ABS64: {
-    const uintptr_t sym_addr = resolve_or_symlink(reloc.symbol());
-    engine_->mem().write_ptr(binarch, addr_target, sym_addr + reloc.addend());
-    break;
+  plt_relocs_.clear();
+  plt_relocs_.reserve(slots.size());
+  for (size_t i = 0; i < slots.size(); ++i) {
+    const Relocation &reloc = *slots[i];
+    batch.write_ptr(slot_addrs[i], base_address_ + get_rva(binary, stubs[i]));
+
+    // x86-64 stubs push their index in .rela.plt, whereas AArch64 ones give
+    // the address of their GOT entry.
+    size_t idx = i;
+    if (machine == ARCH::EM_AARCH64) {
+      idx = (reloc.address() - pltgot_rva_) / sizeof(uintptr_t) -
+            GOT_RESERVED_ENTRIES_SIZE;
+    }
+    if (idx >= plt_relocs_.size()) {
+      plt_relocs_.resize(idx + 1, nullptr);
+    }
+    plt_relocs_[idx] = &reloc;
+  }
+  batch.flush();
+  apply(plan, others, imports);
+#else
+  Logger::warn("Lazy binding is not supported on this host, binding now");
+  apply(plan, plan.plt, imports);
+#endif
+}
+
+uintptr_t ELF::resolve(const LIEF::ELF::Symbol &sym) {
+  // Check if the given symbol is not exported by the binary itself.
+  // This could append in the case of a static link
+  // where the linker produces all the plt/got mechanism
+  // even though the symbol is in the final binary
+  const Symbol *exported = find_dynamic(sym.name());
+  if (exported == nullptr || exported->value() == 0) {
+    return 0;
+  }
+  const uint64_t addr = get_address(get_rva(get_binary(), exported->value()));
+  if (exported->type() == ELF_SYMBOL_TYPES::STT_GNU_IFUNC) {
+    return resolve_ifunc(addr);
+  }
+  return addr;
+}
+
+uint64_t ELF::resolve_ifunc(uint64_t resolver) {
+  const uint64_t addr = engine_->resolve_ifunc(*this, resolver);
+  if (addr == 0) {
+    Logger::warn("IFUNC resolver at 0x{:x} can't be run", resolver);
+  }
+  return addr;
+}
+
+void ELF::run_ifuncs() {
+  if (ifuncs_.empty()) {
+    return;
   }
+  WriteBatch batch{engine_->mem(), arch()};
+  for (const PlanReloc &reloc : ifuncs_) {
+    const uint64_t addr = resolve_ifunc(base_address_ + reloc.addend);
+    if (addr != 0) {
+      batch.write_ptr(base_address_ + reloc.rva, addr);
+    }
+  }
+  batch.flush();
+  ifuncs_.clear();
+}
 
-  default: {
-    Logger::warn("Relocation type '{}' is not supported!", to_string(type));
+bool ELF::register_tls(RelocPlan const &plan) {
+  bool static_block = false;
+  for (const std::vector<PlanReloc> *list : {&plan.relocs, &plan.plt}) {
+    for (const PlanReloc &reloc : *list) {
+      static_block |= reloc.kind == PlanReloc::TLS_STATIC;
+    }
+  }
+  if (plan.tls_size == 0) {
+    if (static_block) {
+      Logger::err("{} uses static TLS but has no TLS segment", path_);
+    }
+    return !static_block;
   }
+  if (static_block && !static_tls_zero(plan)) {
+    Logger::err("Initialized static TLS of {} is not supported", path_);
+    return false;
   }
+
+  // The initialization image is only read by the target once the image is
+  // relocated, when threads first access their block.
+  TargetSystem::TlsImage image{base_address_ + plan.tls_rva,
+                               plan.tls_init_size, plan.tls_size,
+                               plan.tls_align};
+  image.static_block = static_block;
+  tls_ = engine_->tls_register(*this, image);
+  if (static_block && !tls_.static_block) {
+    Logger::err("No static TLS block for {}, it can't be loaded", path_);
+    return false;
+  }
+  if (tls_.id == 0) {
+    Logger::warn("Thread-local storage of {} is not supported by the target, "
+                 "its TLS relocations are left unresolved",
+                 path_);
+  } else if (tls_.tlsdesc == 0) {
+    Logger::debug("TLS descriptors of {} are left unresolved", path_);
+  }
+  return true;
 }
 
+bool ELF::static_tls_zero(RelocPlan const &plan) const {
+  // Static blocks are zero in every thread: they are not initialized from
+  // the image, which must stay zero once relocated.
+  for (const std::vector<PlanReloc> *list : {&plan.relocs, &plan.plt}) {
+    for (const PlanReloc &reloc : *list) {
+      if (reloc.rva + 8 > plan.tls_rva &&
+          reloc.rva < plan.tls_rva + plan.tls_init_size) {
+        return false;
+      }
+    }
+  }
+  std::vector<uint8_t> init(plan.tls_init_size);
+  engine_->mem().read(init.data(), base_address_ + plan.tls_rva, init.size());
+  return std::all_of(init.begin(), init.end(),
+                     [](uint8_t byte) { return byte == 0; });
+}
+
+uintptr_t ELF::resolve_or_symlink(const LIEF::ELF::Symbol &sym) {
+  // First check if the symbol is not exported by the binary itself:
+  uintptr_t ret = resolve(sym);
+  if (ret == 0) {
+    // Called by dl_resolve() from the threads of the application: lazily
+    // bound images are never prelinked, so imports_ is left untouched.
+    ret = symlink(sym, import_version(sym), false);
+  }
+  return ret;
+}
+
+uintptr_t ELF::symlink(const LIEF::Symbol &sym, std::string_view version,
+                       bool record) {
+  // Accesses to the TLS of the image go through the target's allocator
+  if (tls_.get_addr != 0 && sym.name() == "__tls_get_addr") {
+    return tls_.get_addr;
+  }
+  const uintptr_t ret =
+      version.empty()
+          ? engine_->symlink(*this, sym)
+          : engine_->symlink_versioned(*this, sym, std::string{version});
+  if (record) {
+    // Recorded for the prelink cache
+    imports_[RelocPlan::versioned_name(sym.name(), version)] = ret;
+  }
+  return ret;
+}
+
+Arch ELF::arch() const { return arch_; }
+
 uint64_t ELF::get_rva(const Binary &bin, uint64_t addr) const {
   if (addr >= bin.imagebase()) {
     return addr - bin.imagebase();
@@ -296,6 +1508,18 @@ uint64_t ELF::get_rva(const Binary &bin, uint64_t addr) const {
   return addr;
 }
 
-ELF::~ELF() = default;
+ELF::~ELF() {
+  if (tls_.id != 0) {
+    engine_->tls_unregister(*this, tls_);
+  }
+  if (base_address_ != 0) {
+    engine_->mem().release(base_address_, mem_size_);
+  }
+}
 
 } // namespace QBDL::Loaders
+
+// Called by _dl_resolve_internal(), which can't name a C++ member function
+uintptr_t _dl_resolve(void *loader, uintptr_t hint) {
+  return QBDL::Loaders::ELF::dl_resolve(loader, hint);
+}
@@ -1,16 +1,212 @@
+#include "batch.hpp"
+#include "chained_fixups.hpp"
+#include "intmem.hpp"
 #include "logging.hpp"
+#include "macho_file.hpp"
+#include "protections.hpp"
+#include "relative.hpp"
+#include "reloc_plan.hpp"
+#include "symbol_index.hpp"
+#include "trampoline.hpp"
 #include <LIEF/MachO.hpp>
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
+#include <QBDL/engines/Native.hpp>
 #include <QBDL/loaders/MachO.hpp>
 #include <QBDL/utils.hpp>
 
-// Return this address of the ImageCache
-// See: dyld_stub_binder_dry.s for the implementation
-extern "C" uintptr_t __dyld_stub_binder_dry_call();
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
 
 namespace QBDL::Loaders {
 
+namespace {
+int segment_prot(const LIEF::MachO::SegmentCommand &segment) {
+  // See <mach-o/loader.h>
+  static constexpr uint32_t VM_PROT_READ = 0x1;
+  static constexpr uint32_t VM_PROT_WRITE = 0x2;
+  static constexpr uint32_t VM_PROT_EXECUTE = 0x4;
+  static constexpr uint32_t SG_READ_ONLY = 0x10;
+
+  const uint32_t initprot = segment.init_protection();
+  int prot = TargetMemory::NONE;
+  if (initprot & VM_PROT_READ) {
+    prot |= TargetMemory::READ;
+  }
+  // Segments such as __DATA_CONST are only writable during binding
+  if ((initprot & VM_PROT_WRITE) && !(segment.flags() & SG_READ_ONLY)) {
+    prot |= TargetMemory::WRITE;
+  }
+  if (initprot & VM_PROT_EXECUTE) {
+    prot |= TargetMemory::EXEC;
+  }
+  return prot;
+}
+
+// Size of the image in memory, from its image base
+uint64_t image_size(const LIEF::MachO::Binary &binary) {
+  // TODO(romain): Could be moved in LIEF
+  uint64_t virtual_size = 0;
+  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+    virtual_size = std::max(virtual_size,
+                            segment.virtual_address() + segment.virtual_size());
+  }
+  return page_align(virtual_size - binary.imagebase());
+}
+
+// See <mach-o/loader.h>
+constexpr uint8_t BIND_IMMEDIATE_MASK = 0x0F;
+constexpr uint8_t BIND_OPCODE_MASK = 0xF0;
+constexpr uint8_t BIND_OPCODE_DONE = 0x00;
+constexpr uint8_t BIND_OPCODE_SET_DYLIB_ORDINAL_IMM = 0x10;
+constexpr uint8_t BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB = 0x20;
+constexpr uint8_t BIND_OPCODE_SET_DYLIB_SPECIAL_IMM = 0x30;
+constexpr uint8_t BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM = 0x40;
+constexpr uint8_t BIND_OPCODE_SET_TYPE_IMM = 0x50;
+constexpr uint8_t BIND_OPCODE_SET_ADDEND_SLEB = 0x60;
+constexpr uint8_t BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB = 0x70;
+constexpr uint8_t BIND_OPCODE_ADD_ADDR_ULEB = 0x80;
+constexpr uint8_t BIND_OPCODE_DO_BIND = 0x90;
+constexpr uint8_t BIND_OPCODE_THREADED = 0xD0;
+constexpr uint8_t BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB =
+    0x00;
+constexpr uint8_t BIND_SUBOPCODE_THREADED_APPLY = 0x01;
+constexpr uint8_t BIND_SYMBOL_FLAGS_WEAK_IMPORT = 0x1;
+
+// State of the bind opcodes interpreter
+struct BindState {
+  ChainedImport import{{}, 0, false, 0};
+  size_t segment = 0;
+  uint64_t offset = 0;
+};
+
+// Run the bind opcodes from \p p that only update \p state, and return the
+// next one that binds (or BIND_OPCODE_DONE), its immediate being in \p imm.
+// Returns -1 if the opcodes are truncated.
+int next_bind_action(const uint8_t *&p, const uint8_t *end, BindState &state,
+                     uint8_t &imm) {
+  while (p < end) {
+    imm = *p & BIND_IMMEDIATE_MASK;
+    const uint8_t opcode = *p & BIND_OPCODE_MASK;
+    ++p;
+    uint64_t value = 0;
+    switch (opcode) {
+    case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+      state.import.lib_ordinal = imm;
+      break;
+    case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:
+      if (!read_uleb128(p, end, value)) {
+        return -1;
+      }
+      state.import.lib_ordinal = static_cast<int>(value);
+      break;
+    case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+      state.import.lib_ordinal =
+          imm == 0 ? 0 : static_cast<int8_t>(BIND_OPCODE_MASK | imm);
+      break;
+    case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM: {
+      const char *name = reinterpret_cast<const char *>(p);
+      const size_t len = strnlen(name, end - p);
+      if (p + len == end) {
+        return -1;
+      }
+      state.import.name = std::string_view{name, len};
+      state.import.weak = (imm & BIND_SYMBOL_FLAGS_WEAK_IMPORT) != 0;
+      p += len + 1;
+      break;
+    }
+    case BIND_OPCODE_SET_TYPE_IMM:
+      break;
+    case BIND_OPCODE_SET_ADDEND_SLEB:
+      if (!read_sleb128(p, end, state.import.addend)) {
+        return -1;
+      }
+      break;
+    case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+      state.segment = imm;
+      if (!read_uleb128(p, end, state.offset)) {
+        return -1;
+      }
+      break;
+    case BIND_OPCODE_ADD_ADDR_ULEB:
+      if (!read_uleb128(p, end, value)) {
+        return -1;
+      }
+      state.offset += value;
+      break;
+    default:
+      return opcode;
+    }
+  }
+  return BIND_OPCODE_DONE;
+}
+
+// Lazily bound images, by base address. The stub helper gives
+// dyld_stub_binder the address of the __dyld_private slot of the calling
+// image, which is looked up here.
+struct LazyImages {
+  std::mutex mutex;
+  std::map<uint64_t, MachO *> images;
+};
+
+LazyImages &lazy_images() {
+  static LazyImages images;
+  return images;
+}
+
+// Apply the pointers decoded from fixup chains. Rebases are queued in
+// \p rebases, and binds are written to \p binds (if not null) with the
+// address of their import, each import being resolved once.
+class ChainFixer {
+public:
+  ChainFixer(uint64_t base, std::vector<ChainedImport> const &imports,
+             RelativeRelocs &rebases, WriteBatch *binds,
+             std::function<uint64_t(ChainedImport const &)> resolve)
+      : base_(base), imports_(imports), rebases_(rebases), binds_(binds),
+        resolve_(std::move(resolve)) {}
+
+  void apply(ChainedFixup const &fixup) {
+    const uint64_t addr = base_ + fixup.rva;
+    if (!fixup.bind) {
+      rebases_.add(addr, (base_ + fixup.target) |
+                             (static_cast<uint64_t>(fixup.high8) << 56));
+      return;
+    }
+    if (binds_ == nullptr) {
+      return;
+    }
+    if (fixup.ordinal >= imports_.size()) {
+      Logger::warn("Invalid import #{} bound at 0x{:x}", fixup.ordinal, addr);
+      return;
+    }
+    // The import table may grow while the chains are walked (threaded binds)
+    if (addrs_.size() < imports_.size()) {
+      addrs_.resize(imports_.size());
+      resolved_.resize(imports_.size(), false);
+    }
+    if (!resolved_[fixup.ordinal]) {
+      addrs_[fixup.ordinal] = resolve_(imports_[fixup.ordinal]);
+      resolved_[fixup.ordinal] = true;
+    }
+    const uint64_t target = addrs_[fixup.ordinal];
+    // Missing weak imports stay null
+    binds_->write_ptr(addr, target == 0 ? 0 : target + fixup.addend);
+  }
+
+private:
+  uint64_t base_;
+  std::vector<ChainedImport> const &imports_;
+  RelativeRelocs &rebases_;
+  WriteBatch *binds_;
+  std::function<uint64_t(ChainedImport const &)> resolve_;
+  std::vector<uint64_t> addrs_;
+  std::vector<bool> resolved_;
+};
+} // namespace
+
 std::unique_ptr<MachO> MachO::from_file(const char *path, Arch const &arch,
                                         TargetSystem &engine, BIND binding) {
   Logger::info("Loading {}", path);
@@ -18,13 +214,48 @@ std::unique_ptr<MachO> MachO::from_file(const char *path, Arch const &arch,
     Logger::err("{} is not a Mach-O file", path);
     return {};
   }
-  std::unique_ptr<LIEF::MachO::FatBinary> fat =
-      LIEF::MachO::Parser::parse(path);
-  if (fat == nullptr || fat->size() == 0) {
-    Logger::err("Can't parse {}", path);
+  // Only the slice of arch is parsed. If the relocation plan of this slice
+  // is cached, LIEF doesn't decode its rebases and binds.
+  const bool use_plan =
+      binding == BIND::NOW && engine.cache_relocation_plans();
+  const std::string plan_path = RelocPlan::path(path);
+  const auto accept = [&arch](Arch const &slice) { return slice == arch; };
+  std::string uuid;
+  RelocPlan plan;
+  bool cached = false;
+  auto bin = parse_macho_slice(
+      path, accept, [&](const uint8_t *data, size_t size) {
+        if (!use_plan) {
+          return false;
+        }
+        uuid = macho_uuid(data, size);
+        cached = !uuid.empty() && plan.read(plan_path) &&
+                 plan.build_id == uuid && plan.arch == arch;
+        return cached;
+      });
+  if (bin && cached &&
+      (plan.imagebase != bin->imagebase() ||
+       plan.mem_size != image_size(*bin))) {
+    Logger::debug("{} doesn't match {}", plan_path, path);
+    cached = false;
+    bin = parse_macho_slice(path, accept);
+  }
+  if (!bin) {
+    Logger::err("Unable to find a binary that match given architecture");
     return {};
   }
-  auto bin = take_arch_binary(*fat, arch);
+  if (cached) {
+    Logger::info("Relocations of {} replayed from {}", path, plan_path);
+  }
+  return create(std::move(bin), engine, binding, path, uuid,
+                cached ? &plan : nullptr);
+}
+
+std::unique_ptr<MachO> MachO::from_buffer(const uint8_t *data, size_t size,
+                                          Arch const &arch,
+                                          TargetSystem &engine, BIND binding) {
+  auto bin = parse_macho_slice(
+      data, size, [&arch](Arch const &slice) { return slice == arch; });
   if (!bin) {
     Logger::err("Unable to find a binary that match given architecture");
     return {};
@@ -35,12 +266,23 @@ std::unique_ptr<MachO> MachO::from_file(const char *path, Arch const &arch,
 std::unique_ptr<MachO>
 MachO::from_binary(std::unique_ptr<LIEF::MachO::Binary> bin,
                    TargetSystem &engine, BIND binding) {
+  return create(std::move(bin), engine, binding);
+}
+
+std::unique_ptr<MachO>
+MachO::create(std::unique_ptr<LIEF::MachO::Binary> bin, TargetSystem &engine,
+              BIND binding, const char *path, std::string const &uuid,
+              const RelocPlan *cached) {
   if (!engine.supports(*bin)) {
     Logger::err("Engine does not support binary!");
     return {};
   }
   std::unique_ptr<MachO> loader(new MachO{std::move(bin), engine});
-  loader->load(binding);
+  if (path != nullptr) {
+    loader->path_ = path;
+    loader->uuid_ = uuid;
+  }
+  loader->load(binding, cached);
   return loader;
 }
 
@@ -56,15 +298,50 @@ MachO::take_arch_binary(LIEF::MachO::FatBinary &fatbin, Arch const &arch) {
 }
 
 MachO::MachO(std::unique_ptr<LIEF::MachO::Binary> bin, TargetSystem &engine)
-    : Loader::Loader(engine), bin_{std::move(bin)} {}
+    : Loader::Loader(engine), bin_{std::move(bin)},
+      symbols_{std::make_unique<SymbolIndex>()} {
+  export_trie(*bin_, export_trie_, export_trie_size_);
+  for (const LIEF::MachO::Symbol &sym : bin_->symbols()) {
+    if (sym.value() > 0) {
+      symbols_->add(sym.name(), sym.value());
+    }
+  }
+  symbols_->build();
+}
 
 uint64_t MachO::get_address(const std::string &sym) const {
-  const LIEF::MachO::Binary &binary = get_binary();
-  const LIEF::MachO::Symbol *symbol = binary.get_symbol(sym);
-  if (!symbol) {
+  const uint64_t addr = find_export(sym);
+  if (addr != 0) {
+    return addr;
+  }
+  uint64_t value = 0;
+  if (!symbols_->find(sym, value)) {
+    return 0;
+  }
+  return base_address_ + get_rva(get_binary(), value);
+}
+
+uint64_t MachO::find_export(std::string_view name) const {
+  // See <mach-o/loader.h>
+  static constexpr uint64_t EXPORT_SYMBOL_FLAGS_KIND_MASK = 0x03;
+  static constexpr uint64_t EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE = 0x02;
+  static constexpr uint64_t EXPORT_SYMBOL_FLAGS_REEXPORT = 0x08;
+
+  uint64_t flags = 0;
+  uint64_t value = 0;
+  if (!trie_lookup(export_trie_, export_trie_size_, name, flags, value)) {
     return 0;
   }
-  return base_address_ + get_rva(binary, symbol->value());
+  // Re-exported symbols live in another library
+  if (flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+    return 0;
+  }
+  if ((flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) ==
+      EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE) {
+    return value;
+  }
+  // Offset from the Mach-O header (the stub for resolvers)
+  return base_address_ + value;
 }
 
 uint64_t MachO::get_address(uint64_t offset) const {
@@ -81,18 +358,11 @@ uint64_t MachO::entrypoint() const {
   return base_address_ + (binary.entrypoint() - binary.imagebase());
 }
 
-bool MachO::load(BIND binding) {
+bool MachO::load(BIND binding, const RelocPlan *cached) {
   LIEF::MachO::Binary &binary = get_binary();
   const Arch binarch = arch();
 
-  // TODO(romain): Could be moved in LIEF
-  uint64_t virtual_size = 0;
-  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
-    virtual_size = std::max(virtual_size,
-                            segment.virtual_address() + segment.virtual_size());
-  }
-  virtual_size -= binary.imagebase();
-  virtual_size = page_align(virtual_size);
+  const uint64_t virtual_size = image_size(binary);
   mem_size_ = virtual_size;
 
   Logger::debug("Virtual size: 0x{:x}", virtual_size);
@@ -100,15 +370,39 @@ bool MachO::load(BIND binding) {
   const uint64_t base_address_hint =
       engine_->base_address_hint(binary.imagebase(), virtual_size);
   const uint64_t base_address =
-      engine_->mem().mmap(base_address_hint, virtual_size);
+      engine_->mem().reserve(base_address_hint, virtual_size);
+  if (base_address == 0) {
+    Logger::err("reserve() failed! Abort.");
+    return false;
+  }
   base_address_ = base_address;
 
   // Map segments
   // =======================================================
+  // Only the segments above the image base are committed: __PAGEZERO stays
+  // reserved.
+  Protections layout;
+  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+    if (segment.virtual_address() < binary.imagebase()) {
+      continue;
+    }
+    const uint64_t rva = get_rva(binary, segment.virtual_address());
+    layout.add(page_start(rva), page_align(rva + segment.virtual_size()),
+               segment_prot(segment));
+  }
+  if (!layout.commit(engine_->mem(), base_address)) {
+    Logger::err("commit() failed! Abort.");
+    return false;
+  }
+
   for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
     if (segment.size() == 0) { // __PAGEZERO for instance
       continue;
     }
+    if (segment.virtual_address() < binary.imagebase() ||
+        segment_prot(segment) == TargetMemory::NONE) {
+      continue;
+    }
     const uint64_t rva = get_rva(binary, segment.virtual_address());
 
     Logger::debug("Mapping {} - 0x{:x}", segment.name(), rva);
@@ -121,6 +415,71 @@ bool MachO::load(BIND binding) {
 
   // Perform relocations
   // =======================================================
+  // Binds of the fixup chains are flushed after the rebases, which rewrite
+  // whole regions (see RelativeRelocs::apply).
+  RelativeRelocs rebases;
+  WriteBatch binds{engine_->mem(), binarch};
+  // Fixup chains have no lazy binding: their binds are applied now
+  WriteBatch *chained_binds = binding != BIND::NOT_BIND ? &binds : nullptr;
+  if (!chained_fixups(rebases, chained_binds) ||
+      !threaded_fixups(rebases, chained_binds)) {
+    Logger::err("Invalid fixup chains! Abort.");
+    return false;
+  }
+
+  // The rebases and binds of LC_DYLD_INFO come from the cached plan, if
+  // any, or are compiled from the LIEF object
+  RelocPlan compiled;
+  if (cached == nullptr) {
+    compile(compiled);
+  }
+  const RelocPlan &plan = cached != nullptr ? *cached : compiled;
+  for (const PlanReloc &reloc : plan.relocs) {
+    if (reloc.kind == PlanReloc::REBASE) {
+      rebases.add_implicit(base_address + reloc.rva);
+    }
+  }
+
+  rebases.apply(engine_->mem(), binarch, base_address - binary.imagebase(),
+                engine_->relocation_threads());
+  binds.flush();
+
+  // Bind symbols
+  switch (binding) {
+  case BIND::NOW: {
+    bind_now(plan);
+    break;
+  }
+
+  case BIND::LAZY: {
+    bind_lazy(plan);
+    break;
+  }
+
+  case BIND::NOT_BIND:
+  default:
+    break;
+  }
+
+  protect();
+  engine_->mem().flush();
+
+  if (binding == BIND::NOW && cached == nullptr && !uuid_.empty()) {
+    compiled.build_id = uuid_;
+    const std::string plan_path = RelocPlan::path(path_);
+    if (compiled.write(plan_path)) {
+      Logger::debug("Relocation plan of {} saved to {}", path_, plan_path);
+    }
+  }
+  return true;
+}
+
+void MachO::compile(RelocPlan &plan) const {
+  const LIEF::MachO::Binary &binary = get_binary();
+  plan.arch = arch();
+  plan.imagebase = binary.imagebase();
+  plan.mem_size = mem_size_;
+
   for (const LIEF::MachO::Relocation &relocation : binary.relocations()) {
     if (relocation.origin() ==
         LIEF::MachO::RELOCATION_ORIGINS::ORIGIN_RELOC_TABLE) {
@@ -132,14 +491,8 @@ bool MachO::load(BIND binding) {
         static_cast<LIEF::MachO::REBASE_TYPES>(relocation.type());
     switch (rtype) {
     case LIEF::MachO::REBASE_TYPES::REBASE_TYPE_POINTER: {
-      const uint64_t rva = get_rva(binary, relocation.address());
-      const uint64_t rel_ptr = base_address + rva;
-      uint64_t rel_ptr_val = engine_->mem().read_ptr(binarch, rel_ptr);
-      if (rel_ptr_val >= binary.imagebase()) {
-        rel_ptr_val -= binary.imagebase();
-      }
-      rel_ptr_val += base_address;
-      engine_->mem().write_ptr(binarch, rel_ptr, rel_ptr_val);
+      plan.relocs.push_back(
+          {get_rva(binary, relocation.address()), PlanReloc::REBASE, 0, 0});
       break;
     }
 
@@ -150,45 +503,317 @@ bool MachO::load(BIND binding) {
     }
   }
 
-  // Bind symbols
-  switch (binding) {
-  case BIND::NOW: {
-    bind_now();
-    break;
+  if (!binary.has_dyld_info()) {
+    return;
   }
+  // Lazy bindings go to plan.plt, so that lazily bound images can skip them
+  for (const LIEF::MachO::BindingInfo &info : binary.dyld_info().bindings()) {
+    // BIND_CLASS_THREADED binds are applied by threaded_fixups()
+    const LIEF::MachO::BINDING_CLASS bclass = info.binding_class();
+    if (bclass != LIEF::MachO::BINDING_CLASS::BIND_CLASS_LAZY &&
+        bclass != LIEF::MachO::BINDING_CLASS::BIND_CLASS_STANDARD) {
+      continue;
+    }
+    if (!info.has_symbol()) {
+      Logger::warn("Lazy bindings isn't linked to a symbol!");
+      continue;
+    }
+    const LIEF::MachO::Symbol &sym = info.symbol();
+    std::vector<PlanReloc> &out =
+        bclass == LIEF::MachO::BINDING_CLASS::BIND_CLASS_LAZY ? plan.plt
+                                                               : plan.relocs;
+    out.push_back({get_rva(binary, info.address()), PlanReloc::SYMBOL,
+                   plan.name_id(sym.name(), {}, &sym), info.addend()});
+  }
+}
 
-  case BIND::NOT_BIND:
-  default:
-    break;
+void MachO::protect() {
+  const LIEF::MachO::Binary &binary = get_binary();
+  Protections prots;
+  prots.set(0, mem_size_, TargetMemory::NONE);
+  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+    // __PAGEZERO for instance
+    if (segment.virtual_address() < binary.imagebase()) {
+      continue;
+    }
+    const uint64_t rva = get_rva(binary, segment.virtual_address());
+    prots.add(page_start(rva), page_align(rva + segment.virtual_size()),
+              segment_prot(segment));
+  }
+  prots.apply(engine_->mem(), base_address_);
+}
+
+void MachO::bind_now(RelocPlan const &plan, bool skip_lazy) {
+  // The same import is usually bound at several places (__got,
+  // __la_symbol_ptr, __data, ...): each name of the plan is resolved once.
+  std::vector<uint64_t> addrs(plan.names.size());
+  std::vector<bool> resolved(plan.names.size(), false);
+  WriteBatch batch{engine_->mem(), arch()};
+  const auto bind = [&](std::vector<PlanReloc> const &relocs) {
+    for (const PlanReloc &reloc : relocs) {
+      if (reloc.kind != PlanReloc::SYMBOL) {
+        continue;
+      }
+      if (!resolved[reloc.symbol]) {
+        addrs[reloc.symbol] = resolve_name(plan, reloc.symbol);
+        resolved[reloc.symbol] = true;
+      }
+      const uint64_t target = addrs[reloc.symbol];
+      batch.write_ptr(base_address_ + reloc.rva,
+                      target == 0 ? 0 : target + reloc.addend);
+    }
+  };
+  bind(plan.relocs);
+  if (!skip_lazy) {
+    bind(plan.plt);
+  }
+  batch.flush();
+}
+
+uint64_t MachO::resolve_name(RelocPlan const &plan, uint32_t id) {
+  const std::string &name = plan.names[id];
+  uint64_t addr = 0;
+  if (stub_binder_ != 0 && name == "dyld_stub_binder") {
+    addr = stub_binder_;
+  } else if (id < plan.sources.size() && plan.sources[id] != nullptr) {
+    addr = engine_->symlink(*this, *plan.sources[id]);
+  } else {
+    // Replayed plans only have the names of their imports
+    addr = engine_->symlink(*this, LIEF::Symbol{name});
   }
+  Logger::debug("Symbol {} resolves to address 0x{:x}", name, addr);
+  return addr;
+}
 
+void MachO::bind_lazy(RelocPlan const &plan) {
+#if defined(QBDL_HAS_DYLD_STUB_BINDER)
+  const uint8_t *opcodes = nullptr;
+  size_t size = 0;
+  if (!dyld_info_data(get_binary(), DyldInfoPart::LAZY_BIND, opcodes, size) ||
+      size == 0) {
+    bind_now(plan);
+    return;
+  }
+  if (arch() != Engines::Native::arch()) {
+    Logger::warn("Lazy binding is not supported for this binary, binding "
+                 "now");
+    bind_now(plan);
+    return;
+  }
+
+  // The lazy pointers initially point to the stub helper, which pushes the
+  // offset of their lazy binding info and jumps to dyld_stub_binder.
+  init_trampolines();
+  stub_binder_ = reinterpret_cast<uintptr_t>(&_qbdl_stub_binder);
+  {
+    LazyImages &lazy = lazy_images();
+    std::lock_guard<std::mutex> lock{lazy.mutex};
+    lazy.images[base_address_] = this;
+  }
+  bind_now(plan, /* skip_lazy */ true);
+#else
+  Logger::warn("Lazy binding is not supported on this host, binding now");
+  bind_now(plan);
+#endif
+}
+
+// This function is called by _qbdl_stub_binder(), with the address of the
+// __dyld_private slot of the calling image and the offset of the lazy
+// binding info of the called symbol.
+uintptr_t MachO::stub_bind(uintptr_t cache, uintptr_t lazy_offset) {
+  MachO *ldr = nullptr;
+  {
+    LazyImages &lazy = lazy_images();
+    std::lock_guard<std::mutex> lock{lazy.mutex};
+    auto it = lazy.images.upper_bound(cache);
+    if (it != lazy.images.begin()) {
+      --it;
+      if (cache - it->first < it->second->mem_size_) {
+        ldr = it->second;
+      }
+    }
+  }
+  if (ldr == nullptr) {
+    Logger::err("No lazily bound image at 0x{:x}", cache);
+    return 0;
+  }
+
+  const LIEF::MachO::Binary &binary = ldr->get_binary();
+  const uint8_t *opcodes = nullptr;
+  size_t size = 0;
+  if (!dyld_info_data(binary, DyldInfoPart::LAZY_BIND, opcodes, size) ||
+      lazy_offset >= size) {
+    Logger::err("Lazy binding info offset out of range: 0x{:x}", lazy_offset);
+    return 0;
+  }
+  const uint8_t *p = opcodes + lazy_offset;
+  BindState state;
+  uint8_t imm = 0;
+  const LIEF::MachO::SegmentCommand *segment = nullptr;
+  if (next_bind_action(p, opcodes + size, state, imm) == BIND_OPCODE_DO_BIND) {
+    size_t idx = 0;
+    for (const LIEF::MachO::SegmentCommand &seg : binary.segments()) {
+      if (idx++ == state.segment) {
+        segment = &seg;
+        break;
+      }
+    }
+  }
+  if (segment == nullptr) {
+    Logger::err("Invalid lazy binding info at offset 0x{:x}", lazy_offset);
+    return 0;
+  }
+
+  const uintptr_t sym_addr = ldr->resolve_import(state.import);
+  const uint64_t ptr_addr = ldr->base_address_ +
+                            ldr->get_rva(binary, segment->virtual_address()) +
+                            state.offset;
+  QBDL_INFO("Address of {}: 0x{:x}", state.import.name, sym_addr);
+  if (sym_addr == 0) {
+    // Keep the stub helper in the pointer rather than a null pointer
+    Logger::err("Can't resolve the lazy import {}", state.import.name);
+    return 0;
+  }
+  ldr->engine_->mem().write_ptr(ldr->arch(), ptr_addr, sym_addr);
+  ldr->engine_->mem().flush();
+  return sym_addr;
+}
+
+bool MachO::chained_fixups(RelativeRelocs &rebases, WriteBatch *binds) {
+  const LIEF::MachO::Binary &binary = get_binary();
+  const LIEF::MachO::LoadCommand *command = find_command(
+      binary, static_cast<uint32_t>(
+                  LIEF::MachO::LOAD_COMMAND_TYPES::LC_DYLD_CHAINED_FIXUPS));
+  if (command == nullptr) {
+    return true;
+  }
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  if (!linkedit_data(binary, *command, data, size)) {
+    Logger::err("LC_DYLD_CHAINED_FIXUPS payload is out of __LINKEDIT");
+    return false;
+  }
+  ChainedFixups fixups;
+  if (!fixups.parse(data, size)) {
+    return false;
+  }
+  Logger::debug("{} chained imports", fixups.imports().size());
+
+  ChainFixer fixer{base_address_, fixups.imports(), rebases, binds,
+                   [this](ChainedImport const &import) {
+                     return resolve_import(import);
+                   }};
+  // Chains are read from the file content of the segments, the pointers
+  // they go through being fixed in the target memory.
+  size_t idx = 0;
+  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+    const std::vector<uint8_t> &content = segment.content();
+    if (!fixups.for_each_fixup(
+            idx++, content.data(), content.size(), binary.imagebase(),
+            [&fixer](ChainedFixup const &fixup) { fixer.apply(fixup); })) {
+      Logger::err("Fixup chain out of segment {}", segment.name());
+      return false;
+    }
+  }
   return true;
 }
 
-void MachO::bind_now() {
+bool MachO::threaded_fixups(RelativeRelocs &rebases, WriteBatch *binds) {
   const LIEF::MachO::Binary &binary = get_binary();
-  const Arch binarch = arch();
-  for (const LIEF::MachO::BindingInfo &info : binary.dyld_info().bindings()) {
-    // TODO(romain): Add BIND_CLASS_THREADED when moving to LIEF 0.12.0
-    if (info.binding_class() != LIEF::MachO::BINDING_CLASS::BIND_CLASS_LAZY &&
-        info.binding_class() !=
-            LIEF::MachO::BINDING_CLASS::BIND_CLASS_STANDARD) {
-      continue;
+  if (!binary.has_dyld_info()) {
+    return true;
+  }
+  std::vector<const LIEF::MachO::SegmentCommand *> segments;
+  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+    segments.push_back(&segment);
+  }
+
+  // With threaded binds, the opcodes first build a table of the imports
+  // (BIND_OPCODE_DO_BIND), then give the start of each chain of pointers
+  // (BIND_SUBOPCODE_THREADED_APPLY). These chains also hold the rebases.
+  std::vector<ChainedImport> table;
+  ChainFixer fixer{base_address_, table, rebases, binds,
+                   [this](ChainedImport const &import) {
+                     return resolve_import(import);
+                   }};
+  bool threaded = false;
+  BindState state;
+  const uint8_t *p = nullptr;
+  size_t size = 0;
+  if (!dyld_info_data(binary, DyldInfoPart::BIND, p, size)) {
+    Logger::err("LC_DYLD_INFO bind opcodes are out of __LINKEDIT");
+    return false;
+  }
+  const uint8_t *end = p + size;
+  while (p < end) {
+    uint8_t imm = 0;
+    const int opcode = next_bind_action(p, end, state, imm);
+    uint64_t value = 0;
+    switch (opcode) {
+    case BIND_OPCODE_DONE:
+      return true;
+    case BIND_OPCODE_DO_BIND:
+      // Regular binds are applied from the LIEF bindings (see compile())
+      if (!threaded) {
+        return true;
+      }
+      table.push_back(state.import);
+      break;
+    case BIND_OPCODE_THREADED:
+      if (imm == BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB) {
+        if (!read_uleb128(p, end, value)) {
+          return false;
+        }
+        threaded = true;
+        table.clear();
+        table.reserve(value);
+      } else if (imm == BIND_SUBOPCODE_THREADED_APPLY) {
+        if (state.segment >= segments.size()) {
+          return false;
+        }
+        const LIEF::MachO::SegmentCommand &segment = *segments[state.segment];
+        const std::vector<uint8_t> &content = segment.content();
+        if (!ChainedFixups::for_each_in_chain(
+                ChainedFixups::PTR_ARM64E, content.data(), content.size(),
+                state.offset, get_rva(binary, segment.virtual_address()),
+                binary.imagebase(),
+                [&fixer](ChainedFixup const &fixup) { fixer.apply(fixup); })) {
+          Logger::err("Fixup chain out of segment {}", segment.name());
+          return false;
+        }
+      }
+      break;
+    case -1:
+      return false;
+    default:
+      // Other opcodes are not used along with threaded binds
+      if (!threaded) {
+        return true;
+      }
+      Logger::err("Unexpected bind opcode 0x{:x}", opcode);
+      return false;
     }
-    if (!info.has_symbol()) {
-      Logger::warn("Lazy bindings isn't linked to a symbol!");
-      continue;
+  }
+  return true;
+}
+
+uint64_t MachO::resolve_import(ChainedImport const &import) {
+  const std::string name{import.name};
+  uint64_t addr = 0;
+  if (import.lib_ordinal == 0) { // BIND_SPECIAL_DYLIB_SELF
+    addr = find_export(name);
+  }
+  if (addr == 0) {
+    addr = engine_->symlink(*this, LIEF::Symbol{name});
+  }
+  if (addr == 0) {
+    if (!import.weak) {
+      Logger::warn("Can't resolve {}", name);
     }
-    const auto &sym = info.symbol();
-    const uint64_t ptrRVA = get_rva(binary, info.address());
-    const uint64_t ptrAddr = base_address_ + ptrRVA;
-    const uint64_t symAddr = engine_->symlink(*this, sym);
-    Logger::info(
-        "Symbol {} resolves to address 0x{:x}, stored at address 0x{:x}",
-        sym.name(), symAddr, ptrAddr);
-    // Store the address of the resolved symbol into ptrAddr
-    engine_->mem().write_ptr(binarch, ptrAddr, symAddr);
+    return 0;
   }
+  Logger::debug("Symbol {} resolves to address 0x{:x}", name, addr);
+  return addr + import.addend;
 }
 
 uint64_t MachO::get_rva(const LIEF::MachO::Binary &bin, uint64_t addr) const {
@@ -198,6 +823,28 @@ uint64_t MachO::get_rva(const LIEF::MachO::Binary &bin, uint64_t addr) const {
   return addr;
 }
 
-MachO::~MachO() = default;
+MachO::~MachO() {
+  if (stub_binder_ != 0) {
+    LazyImages &lazy = lazy_images();
+    std::lock_guard<std::mutex> lock{lazy.mutex};
+    lazy.images.erase(base_address_);
+  }
+  if (base_address_ != 0) {
+    engine_->mem().release(base_address_, mem_size_);
+  }
+}
 
 } // namespace QBDL::Loaders
+
+// Called by _qbdl_stub_binder(), which can't name a C++ member function.
+// The binder jumps to the returned address, so there is no way to report an
+// unresolved symbol to the caller: abort rather than jumping to 0.
+uintptr_t _qbdl_stub_bind(uintptr_t cache, uintptr_t lazy_offset) {
+  const uintptr_t addr = QBDL::Loaders::MachO::stub_bind(cache, lazy_offset);
+  if (addr == 0) {
+    QBDL::Logger::err("Lazy binding at offset 0x{:x} failed, aborting",
+                      lazy_offset);
+    std::abort();
+  }
+  return addr;
+}
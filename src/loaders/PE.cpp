@@ -1,14 +1,80 @@
+#include "batch.hpp"
+#include "intmem.hpp"
 #include "logging.hpp"
+#include "pe_file.hpp"
+#include "protections.hpp"
+#include "relative.hpp"
 #include <LIEF/PE.hpp>
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
 #include <QBDL/loaders/PE.hpp>
 #include <QBDL/utils.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
 using namespace LIEF::PE;
 
 namespace QBDL::Loaders {
 
+namespace {
+int section_prot(const Section &section) {
+  int prot = TargetMemory::NONE;
+  if (section.has_characteristic(SECTION_CHARACTERISTICS::IMAGE_SCN_MEM_READ)) {
+    prot |= TargetMemory::READ;
+  }
+  if (section.has_characteristic(
+          SECTION_CHARACTERISTICS::IMAGE_SCN_MEM_WRITE)) {
+    prot |= TargetMemory::WRITE;
+  }
+  if (section.has_characteristic(
+          SECTION_CHARACTERISTICS::IMAGE_SCN_MEM_EXECUTE)) {
+    prot |= TargetMemory::EXEC;
+  }
+  return prot;
+}
+
+// Imports by ordinal are named "#<ordinal>", as in the forwarders
+bool is_ordinal(std::string const &name) {
+  return !name.empty() && name[0] == '#';
+}
+
+// Forwarder chains longer than this are considered as loops
+constexpr unsigned MAX_FORWARDS = 16;
+
+// Delay-load thunks (x86-64), 16 bytes each:
+//   lea rax, [rip + slot]
+//   jmp [rip + helper]
+// The address of the helper is stored in the first 16 bytes of the thunks.
+constexpr uint64_t DELAY_THUNK_SIZE = 16;
+constexpr Arch DELAY_THUNK_ARCH{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, true};
+
+// PE images loaded by QBDL, by target system and DLL name, so that imports
+// are resolved against the DLLs loaded in the same target. Images whose
+// delay-load imports go through the native helper are also indexed by base
+// address.
+struct LoadedDlls {
+  std::mutex mutex;
+  std::map<std::pair<const TargetSystem *, std::string>, const PE *> images;
+  std::map<uint64_t, PE *> delayed;
+};
+
+LoadedDlls &loaded_dlls() {
+  static LoadedDlls dlls;
+  return dlls;
+}
+
+const PE *find_dll(const TargetSystem *engine, std::string const &dll) {
+  LoadedDlls &dlls = loaded_dlls();
+  std::lock_guard<std::mutex> lock{dlls.mutex};
+  const auto it = dlls.images.find({engine, dll});
+  return it != dlls.images.end() ? it->second : nullptr;
+}
+} // namespace
+
 std::unique_ptr<PE> PE::from_file(const char *path, TargetSystem &engines,
                                   BIND binding) {
   Logger::info("Loading {}", path);
@@ -35,18 +101,18 @@ std::unique_ptr<PE> PE::from_binary(std::unique_ptr<Binary> bin,
 }
 
 PE::PE(std::unique_ptr<Binary> bin, TargetSystem &engines)
-    : Loader::Loader(engines), bin_{std::move(bin)} {}
+    : Loader::Loader(engines), bin_{std::move(bin)},
+      exports_{std::make_unique<PEExports>()} {
+  exports_->parse(*bin_);
+}
 
 uint64_t PE::get_address(const std::string &sym) const {
-  const Binary &binary = get_binary();
-  const LIEF::Symbol *symbol = nullptr;
-  if (binary.has_symbol(sym)) {
-    symbol = &binary.get_symbol(sym);
-  }
-  if (symbol == nullptr) {
+  // Forwarded exports are resolved by the DLL they point to
+  const PEExports::Function *function = exports_->find(sym);
+  if (function == nullptr || !function->forward.empty()) {
     return 0;
   }
-  return base_address_ + get_rva(binary, symbol->value());
+  return base_address_ + function->rva;
 }
 
 uint64_t PE::get_address(uint64_t offset) const {
@@ -63,8 +129,23 @@ void PE::load(BIND binding) {
   Binary &binary = get_binary();
   const uint64_t imagebase = binary.optional_header().imagebase();
 
+  // Delay-load imports of x86-64 images are resolved on their first call,
+  // through thunks appended to the image. Other ones are resolved now.
+  if (!pe_delay_imports(binary, delay_imports_)) {
+    delay_imports_.clear();
+  }
+  uint64_t delay_helper = 0;
+  if (!delay_imports_.empty() && arch() == DELAY_THUNK_ARCH) {
+    delay_helper = engine_->delay_load_helper(*this);
+  }
+
   uint64_t virtual_size = binary.virtual_size();
   virtual_size = page_align(virtual_size);
+  if (delay_helper != 0) {
+    delay_thunks_ = virtual_size;
+    virtual_size +=
+        page_align((delay_imports_.size() + 1) * DELAY_THUNK_SIZE);
+  }
   mem_size_ = virtual_size;
 
   Logger::debug("Virtual size: 0x{:x}", virtual_size);
@@ -72,15 +153,35 @@ void PE::load(BIND binding) {
   const uint64_t base_address_hint =
       engine_->base_address_hint(imagebase, virtual_size);
   const uint64_t base_address =
-      engine_->mem().mmap(base_address_hint, virtual_size);
+      engine_->mem().reserve(base_address_hint, virtual_size);
   if (base_address == 0 || base_address == -1ull) {
-    Logger::err("mmap() failed! Abort.");
+    Logger::err("reserve() failed! Abort.");
     return;
   }
   base_address_ = base_address;
 
   // Map sections
   // =======================================================
+  // Only the headers and the sections are committed. Sections are at least
+  // committed as readable since their content is copied in any case.
+  Protections layout;
+  layout.add(0, page_align(binary.optional_header().sizeof_headers()),
+             TargetMemory::READ);
+  for (const Section &section : binary.sections()) {
+    const uint64_t rva = section.virtual_address();
+    const uint64_t size =
+        std::max<uint64_t>(section.virtual_size(), section.size());
+    layout.add(page_start(rva), page_align(rva + size),
+               section_prot(section) | TargetMemory::READ);
+  }
+  if (delay_thunks_ != 0) {
+    layout.add(delay_thunks_, virtual_size, TargetMemory::READ);
+  }
+  if (!layout.commit(engine_->mem(), base_address_)) {
+    Logger::err("commit() failed! Abort.");
+    return;
+  }
+
   for (const Section &section : binary.sections()) {
     QBDL_DEBUG("Mapping: {:<10}: (0x{:06x} - 0x{:06x})", section.name(),
                section.virtual_address(),
@@ -97,16 +198,13 @@ void PE::load(BIND binding) {
   if (binary.has_relocations()) {
     const Arch binarch = arch();
     const uint64_t fixup = base_address_ - imagebase;
+    RelativeRelocs fixups;
     for (const Relocation &relocation : binary.relocations()) {
       const uint64_t rva = relocation.virtual_address();
       for (const RelocationEntry &entry : relocation.entries()) {
         switch (entry.type()) {
         case RELOCATIONS_BASE_TYPES::IMAGE_REL_BASED_DIR64: {
-          const uint64_t relocation_addr =
-              base_address_ + rva + entry.position();
-          const uint64_t value =
-              engine_->mem().read_ptr(binarch, relocation_addr);
-          engine_->mem().write_ptr(binarch, relocation_addr, value + fixup);
+          fixups.add_implicit(base_address_ + rva + entry.position());
           break;
         }
 
@@ -118,25 +216,194 @@ void PE::load(BIND binding) {
         }
       }
     }
+
+    fixups.apply(engine_->mem(), binarch, fixup,
+                 engine_->relocation_threads());
   }
 
   // Perform symbol resolution
   // =======================================================
-  // TODO(romain): Find a mechanism to support import by ordinal
+  bind_imports(delay_helper);
+
+  protect();
+  engine_->mem().flush();
+
+  // Make the exports of this image available to the DLLs loaded after it
+  LoadedDlls &dlls = loaded_dlls();
+  std::lock_guard<std::mutex> lock{dlls.mutex};
+  dlls.images.emplace(std::make_pair(engine_, dll_key(binary.name())), this);
+  if (binary.has_exports() && !binary.get_export().name().empty()) {
+    dlls.images.emplace(
+        std::make_pair(engine_, dll_key(binary.get_export().name())), this);
+  }
+  if (delay_thunks_ != 0) {
+    dlls.delayed.emplace(base_address_, this);
+  }
+}
+
+void PE::bind_imports(uint64_t delay_helper) {
+  const Binary &binary = get_binary();
+  // Each (DLL, name or ordinal) is resolved once, whatever the number of IAT
+  // slots that import it
+  std::map<std::pair<std::string, std::string>, uint64_t> resolved;
+  const auto resolve = [&](std::string const &dll, std::string const &name,
+                           uint32_t hint) {
+    const auto [it, inserted] = resolved.try_emplace({dll, name}, 0);
+    if (inserted) {
+      it->second = resolve_import(dll, name, hint);
+    }
+    return it->second;
+  };
+
+  WriteBatch batch{engine_->mem(), arch()};
   if (binary.has_imports()) {
-    const Arch binarch = arch();
     for (const Import &imp : binary.imports()) {
+      const std::string dll = dll_key(imp.name());
       for (const ImportEntry &entry : imp.entries()) {
+        const std::string name = entry.is_ordinal()
+                                     ? "#" + std::to_string(entry.ordinal())
+                                     : entry.name();
         const uint64_t iat_addr = entry.iat_address();
-        QBDL_DEBUG("Resolving: {}:{} (0x{:x})", imp.name(), entry.name(),
-                   iat_addr);
-        LIEF::Symbol sym{entry.name()};
-        const uintptr_t sym_addr = engine_->symlink(*this, sym);
+        const uint64_t sym_addr = resolve(dll, name, entry.hint());
+        QBDL_DEBUG("Resolving: {}:{} (0x{:x}) -> 0x{:x}", dll, name, iat_addr,
+                   sym_addr);
         // Write the value in the IAT:
-        engine_->mem().write_ptr(binarch, base_address_ + iat_addr, sym_addr);
+        batch.write_ptr(base_address_ + iat_addr, sym_addr);
+      }
+    }
+  }
+
+  // The delay IAT slots initially point to the thunks of the image, which
+  // call __delayLoadHelper2 (and thus LoadLibrary and GetProcAddress).
+  // They are either resolved now, or redirected to QBDL's thunks.
+  if (delay_thunks_ == 0) {
+    for (const PEDelayImport &import : delay_imports_) {
+      batch.write_ptr(base_address_ + import.slot,
+                      resolve(import.dll, import.name, import.hint));
+    }
+  } else {
+    std::vector<uint8_t> thunks(
+        (delay_imports_.size() + 1) * DELAY_THUNK_SIZE, 0xCC);
+    intmem::storeu_le<uint64_t>(thunks.data(), delay_helper);
+    for (size_t i = 0; i < delay_imports_.size(); ++i) {
+      const uint64_t rva = delay_thunks_ + (i + 1) * DELAY_THUNK_SIZE;
+      uint8_t *thunk = thunks.data() + (i + 1) * DELAY_THUNK_SIZE;
+      thunk[0] = 0x48; // lea rax, [rip + rel32]
+      thunk[1] = 0x8D;
+      thunk[2] = 0x05;
+      intmem::storeu_le<int32_t>(
+          thunk + 3, static_cast<int32_t>(delay_imports_[i].slot - (rva + 7)));
+      thunk[7] = 0xFF; // jmp [rip + rel32]
+      thunk[8] = 0x25;
+      intmem::storeu_le<int32_t>(
+          thunk + 9, static_cast<int32_t>(delay_thunks_ - (rva + 13)));
+      batch.write_ptr(base_address_ + delay_imports_[i].slot,
+                      base_address_ + rva);
+    }
+    batch.write(base_address_ + delay_thunks_, thunks.data(), thunks.size());
+    Logger::debug("{} delay-load imports are resolved on demand",
+                  delay_imports_.size());
+  }
+  batch.flush();
+}
+
+uint64_t PE::delay_bind(uint64_t slot) {
+  const uint64_t rva = slot - base_address_;
+  const auto it = std::lower_bound(
+      delay_imports_.begin(), delay_imports_.end(), rva,
+      [](PEDelayImport const &import, uint64_t rva) {
+        return import.slot < rva;
+      });
+  if (it == delay_imports_.end() || it->slot != rva) {
+    Logger::err("No delay-load import at 0x{:x}", slot);
+    return 0;
+  }
+  const uint64_t addr = resolve_import(it->dll, it->name, it->hint);
+  QBDL_INFO("Address of {}:{}: 0x{:x}", it->dll, it->name, addr);
+  if (addr == 0) {
+    // Keep the thunk in the slot rather than a null pointer
+    Logger::err("Can't resolve the delay-load import {}:{}", it->dll,
+                it->name);
+    return 0;
+  }
+  engine_->mem().write_ptr(arch(), slot, addr);
+  // Next calls read the slot directly
+  engine_->mem().flush();
+  return addr;
+}
+
+// This function is called by _qbdl_delay_load_helper(), with the address of
+// the delay IAT slot of the called import.
+uintptr_t PE::delay_load(uintptr_t slot) {
+  PE *ldr = nullptr;
+  {
+    LoadedDlls &dlls = loaded_dlls();
+    std::lock_guard<std::mutex> lock{dlls.mutex};
+    auto it = dlls.delayed.upper_bound(slot);
+    if (it != dlls.delayed.begin()) {
+      --it;
+      if (slot - it->first < it->second->mem_size_) {
+        ldr = it->second;
       }
     }
   }
+  if (ldr == nullptr) {
+    Logger::err("No image with delay-load imports at 0x{:x}", slot);
+    return 0;
+  }
+  return ldr->delay_bind(slot);
+}
+
+uint64_t PE::resolve_import(std::string dll, std::string name,
+                            uint32_t hint) {
+  // Look the import up in the export directory of the DLL if it has been
+  // loaded by QBDL in the same target, following the forwarders
+  for (unsigned depth = 0; depth < MAX_FORWARDS; ++depth) {
+    const PE *lib = find_dll(engine_, dll);
+    if (lib == nullptr) {
+      break;
+    }
+    const PEExports::Function *function =
+        is_ordinal(name)
+            ? lib->exports_->find_ordinal(
+                  std::strtoul(name.c_str() + 1, nullptr, 10))
+            : lib->exports_->find(name, hint);
+    if (function == nullptr) {
+      Logger::warn("{} is not exported by {}", name, dll);
+      break;
+    }
+    if (function->forward.empty()) {
+      return lib->base_address_ + function->rva;
+    }
+    if (!PEExports::split_forward(function->forward, dll, name)) {
+      Logger::err("Invalid forwarder {} of {}", function->forward, dll);
+      return 0;
+    }
+    hint = 0;
+  }
+
+  // External symbol. Ordinals have no name, so that the DLL is given as well.
+  LIEF::Symbol sym{is_ordinal(name) ? dll + name : name};
+  return engine_->symlink(*this, sym);
+}
+
+void PE::protect() {
+  const Binary &binary = get_binary();
+  Protections prots;
+  prots.set(0, mem_size_, TargetMemory::NONE);
+  prots.add(0, page_align(binary.optional_header().sizeof_headers()),
+            TargetMemory::READ);
+  for (const Section &section : binary.sections()) {
+    const uint64_t rva = section.virtual_address();
+    const uint64_t size =
+        std::max<uint64_t>(section.virtual_size(), section.size());
+    prots.add(page_start(rva), page_align(rva + size), section_prot(section));
+  }
+  if (delay_thunks_ != 0) {
+    prots.add(delay_thunks_, mem_size_,
+              TargetMemory::READ | TargetMemory::EXEC);
+  }
+  prots.apply(engine_->mem(), base_address_);
 }
 
 Arch PE::arch() const { return Arch::from_bin(get_binary()); }
@@ -149,6 +416,33 @@ uint64_t PE::get_rva(const Binary &bin, uint64_t addr) const {
   return addr;
 }
 
-PE::~PE() = default;
+PE::~PE() {
+  {
+    LoadedDlls &dlls = loaded_dlls();
+    std::lock_guard<std::mutex> lock{dlls.mutex};
+    for (auto it = dlls.images.begin(); it != dlls.images.end();) {
+      it = it->second == this ? dlls.images.erase(it) : std::next(it);
+    }
+    if (delay_thunks_ != 0) {
+      dlls.delayed.erase(base_address_);
+    }
+  }
+  if (base_address_ != 0) {
+    engine_->mem().release(base_address_, mem_size_);
+  }
+}
 
 } // namespace QBDL::Loaders
+
+// Called by _qbdl_delay_load_helper(), which can't name a C++ member function.
+// The helper jumps to the returned address, so there is no way to report an
+// unresolved import to the caller: abort rather than jumping to 0.
+uintptr_t _qbdl_delay_load(uintptr_t slot) {
+  const uintptr_t addr = QBDL::Loaders::PE::delay_load(slot);
+  if (addr == 0) {
+    QBDL::Logger::err("Delay-load import at 0x{:x} can't be resolved, aborting",
+                      slot);
+    std::abort();
+  }
+  return addr;
+}
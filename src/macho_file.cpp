@@ -0,0 +1,435 @@
+#include "macho_file.hpp"
+#include "intmem.hpp"
+#include "logging.hpp"
+
+#include <LIEF/MachO.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace QBDL {
+
+namespace {
+// See <mach-o/loader.h> and <mach-o/fat.h>
+constexpr uint32_t MH_MAGIC = 0xfeedface;
+constexpr uint32_t MH_MAGIC_64 = 0xfeedfacf;
+constexpr uint32_t FAT_MAGIC = 0xcafebabe;
+constexpr uint32_t FAT_MAGIC_64 = 0xcafebabf;
+constexpr uint32_t CPU_ARCH_ABI64 = 0x01000000;
+constexpr uint32_t CPU_TYPE_X86 = 7;
+constexpr uint32_t CPU_TYPE_ARM = 12;
+constexpr uint32_t CPU_TYPE_POWERPC = 18;
+
+// Slices are page-aligned, so that the fat header always is in the first
+// page of the file
+constexpr size_t HEADER_READ_SIZE = 4096;
+
+Arch cpu_arch(uint32_t cputype) {
+  const bool is64 = (cputype & CPU_ARCH_ABI64) != 0;
+  switch (cputype & ~CPU_ARCH_ABI64) {
+  case CPU_TYPE_X86:
+    return {LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, is64};
+  case CPU_TYPE_ARM:
+    return {is64 ? LIEF::ARCH_ARM64 : LIEF::ARCH_ARM, LIEF::ENDIAN_LITTLE,
+            is64};
+  case CPU_TYPE_POWERPC:
+    return {LIEF::ARCH_PPC, LIEF::ENDIAN_BIG, is64};
+  }
+  return {LIEF::ARCH_NONE, LIEF::ENDIAN_NONE, is64};
+}
+
+std::unique_ptr<LIEF::MachO::Binary>
+parse_slice(std::vector<uint8_t> const &content, std::string const &name,
+            bool deep = true) {
+  std::unique_ptr<LIEF::MachO::FatBinary> fat = LIEF::MachO::Parser::parse(
+      content, name,
+      deep ? LIEF::MachO::ParserConfig::deep()
+           : LIEF::MachO::ParserConfig::quick());
+  if (fat == nullptr || fat->size() != 1) {
+    return {};
+  }
+  return fat->take(0);
+}
+
+const MachOSlice *
+select(std::vector<MachOSlice> const &slices,
+       std::function<bool(Arch const &)> const &accept) {
+  for (const MachOSlice &slice : slices) {
+    if (slice.arch.arch != LIEF::ARCH_NONE && accept(slice.arch)) {
+      return &slice;
+    }
+  }
+  return nullptr;
+}
+
+// View over the \p size bytes at \p offset in the file, which must lie in
+// __LINKEDIT
+bool linkedit_range(LIEF::MachO::Binary const &bin, uint64_t offset,
+                    uint64_t size, const uint8_t *&data) {
+  const LIEF::MachO::SegmentCommand *linkedit = bin.get_segment("__LINKEDIT");
+  if (linkedit == nullptr) {
+    return false;
+  }
+  const std::vector<uint8_t> &content = linkedit->content();
+  if (offset < linkedit->file_offset() ||
+      offset - linkedit->file_offset() > content.size() ||
+      size > content.size() - (offset - linkedit->file_offset())) {
+    return false;
+  }
+  data = content.data() + (offset - linkedit->file_offset());
+  return true;
+}
+} // namespace
+
+bool macho_slices(const uint8_t *data, size_t size, uint64_t file_size,
+                  std::vector<MachOSlice> &slices) {
+  slices.clear();
+  if (size < 8) {
+    return false;
+  }
+  const uint32_t magic = intmem::loadu_be<uint32_t>(data);
+  if (magic == FAT_MAGIC || magic == FAT_MAGIC_64) {
+    // fat_header, followed by fat_arch or fat_arch_64 entries (big endian)
+    const bool is64 = magic == FAT_MAGIC_64;
+    const uint64_t count = intmem::loadu_be<uint32_t>(data + 4);
+    const uint64_t entry_size = is64 ? 32 : 20;
+    if (count == 0 || (size - 8) / entry_size < count) {
+      return false;
+    }
+    slices.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+      const uint8_t *entry = data + 8 + i * entry_size;
+      const uint32_t cputype = intmem::loadu_be<uint32_t>(entry);
+      MachOSlice slice{0, 0, cpu_arch(cputype)};
+      if (is64) {
+        slice.offset = intmem::loadu_be<uint64_t>(entry + 8);
+        slice.size = intmem::loadu_be<uint64_t>(entry + 16);
+      } else {
+        slice.offset = intmem::loadu_be<uint32_t>(entry + 8);
+        slice.size = intmem::loadu_be<uint32_t>(entry + 12);
+      }
+      if (slice.offset > file_size || file_size - slice.offset < slice.size) {
+        return false;
+      }
+      slices.push_back(slice);
+    }
+    return true;
+  }
+
+  // Thin file, in the endianness of its architecture
+  bool little = true;
+  if (magic == MH_MAGIC || magic == MH_MAGIC_64) {
+    little = false;
+  } else if (intmem::bswap(magic) != MH_MAGIC &&
+             intmem::bswap(magic) != MH_MAGIC_64) {
+    return false;
+  }
+  const uint32_t cputype = little ? intmem::loadu_le<uint32_t>(data + 4)
+                                  : intmem::loadu_be<uint32_t>(data + 4);
+  slices.push_back({0, file_size, cpu_arch(cputype)});
+  return true;
+}
+
+std::string macho_uuid(const uint8_t *data, size_t size) {
+  static constexpr uint32_t LC_UUID = 0x1b;
+  if (size < 28) {
+    return {};
+  }
+  // Magic numbers are read in big endian, see macho_slices()
+  const uint32_t magic = intmem::loadu_be<uint32_t>(data);
+  const bool little = magic != MH_MAGIC && magic != MH_MAGIC_64;
+  const auto u32 = [little](const uint8_t *p) {
+    return little ? intmem::loadu_le<uint32_t>(p)
+                  : intmem::loadu_be<uint32_t>(p);
+  };
+  const bool is64 =
+      magic == MH_MAGIC_64 || intmem::bswap(magic) == MH_MAGIC_64;
+  // mach_header(_64), followed by the load commands
+  uint64_t offset = is64 ? 32 : 28;
+  const uint32_t ncmds = u32(data + 16);
+  for (uint32_t i = 0; i < ncmds && offset + 8 <= size; ++i) {
+    const uint32_t cmd = u32(data + offset);
+    const uint32_t cmdsize = u32(data + offset + 4);
+    if (cmdsize < 8 || cmdsize > size - offset) {
+      return {};
+    }
+    // uuid_command: cmd, cmdsize, uint8_t uuid[16]
+    if (cmd == LC_UUID && cmdsize >= 24) {
+      return {reinterpret_cast<const char *>(data + offset + 8), 16};
+    }
+    offset += cmdsize;
+  }
+  return {};
+}
+
+bool read_uleb128(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+  value = 0;
+  unsigned shift = 0;
+  while (p < end) {
+    const uint8_t byte = *p++;
+    if (shift < 64) {
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    }
+    shift += 7;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool read_sleb128(const uint8_t *&p, const uint8_t *end, int64_t &value) {
+  uint64_t v = 0;
+  unsigned shift = 0;
+  while (p < end) {
+    const uint8_t byte = *p++;
+    if (shift < 64) {
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    }
+    shift += 7;
+    if ((byte & 0x80) == 0) {
+      if (shift < 64 && (byte & 0x40)) {
+        v |= ~uint64_t{0} << shift;
+      }
+      value = static_cast<int64_t>(v);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool trie_lookup(const uint8_t *trie, size_t size, std::string_view name,
+                 uint64_t &flags, uint64_t &value) {
+  const uint8_t *start = trie;
+  const uint8_t *end = start + size;
+  const uint8_t *p = start;
+  size_t matched = 0;
+  // A well-formed trie is not deeper than the name
+  for (size_t depth = 0; depth <= name.size() && p < end; ++depth) {
+    uint64_t terminal_size = 0;
+    if (!read_uleb128(p, end, terminal_size) ||
+        terminal_size > static_cast<uint64_t>(end - p)) {
+      return false;
+    }
+    if (matched == name.size()) {
+      return terminal_size > 0 && read_uleb128(p, end, flags) &&
+             read_uleb128(p, end, value);
+    }
+    p += terminal_size;
+    if (p >= end) {
+      return false;
+    }
+    const uint8_t *next = nullptr;
+    for (uint8_t nb_children = *p++; nb_children > 0 && next == nullptr;
+         --nb_children) {
+      const uint8_t *label = p;
+      while (p < end && *p != 0) {
+        ++p;
+      }
+      if (p >= end) {
+        return false;
+      }
+      const std::string_view edge{reinterpret_cast<const char *>(label),
+                                  static_cast<size_t>(p - label)};
+      ++p;
+      uint64_t child = 0;
+      if (!read_uleb128(p, end, child) || child >= size) {
+        return false;
+      }
+      if (name.substr(matched, edge.size()) == edge) {
+        matched += edge.size();
+        next = start + child;
+      }
+    }
+    if (next == nullptr) {
+      return false;
+    }
+    p = next;
+  }
+  return false;
+}
+
+std::vector<std::string> trie_exports(const uint8_t *trie, size_t size) {
+  std::vector<std::string> names;
+  std::vector<bool> visited(size, false);
+  // Nodes to visit, with the prefix of the names below them
+  std::vector<std::pair<uint64_t, std::string>> nodes;
+  if (size > 0) {
+    nodes.emplace_back(0, std::string{});
+  }
+  const uint8_t *end = trie + size;
+  while (!nodes.empty()) {
+    const auto [node, prefix] = std::move(nodes.back());
+    nodes.pop_back();
+    if (node >= size || visited[node]) {
+      continue;
+    }
+    visited[node] = true;
+    const uint8_t *p = trie + node;
+    uint64_t terminal_size = 0;
+    if (!read_uleb128(p, end, terminal_size) ||
+        terminal_size >= static_cast<uint64_t>(end - p)) {
+      continue;
+    }
+    if (terminal_size > 0) {
+      names.push_back(prefix);
+    }
+    p += terminal_size;
+    for (uint8_t nb_children = *p++; nb_children > 0 && p < end;
+         --nb_children) {
+      const char *label = reinterpret_cast<const char *>(p);
+      const size_t len = strnlen(label, end - p);
+      p += len + 1;
+      uint64_t child = 0;
+      if (p > end || !read_uleb128(p, end, child)) {
+        break;
+      }
+      nodes.emplace_back(child, prefix + std::string{label, len});
+    }
+  }
+  return names;
+}
+
+const LIEF::MachO::LoadCommand *find_command(LIEF::MachO::Binary const &bin,
+                                             uint32_t type) {
+  for (const LIEF::MachO::LoadCommand &cmd : bin.commands()) {
+    if (static_cast<uint32_t>(cmd.command()) == type) {
+      return &cmd;
+    }
+  }
+  return nullptr;
+}
+
+bool linkedit_data(LIEF::MachO::Binary const &bin,
+                   LIEF::MachO::LoadCommand const &command,
+                   const uint8_t *&data, size_t &size) {
+  // linkedit_data_command: cmd, cmdsize, dataoff, datasize
+  const std::vector<uint8_t> &raw = command.data();
+  if (raw.size() < 16) {
+    return false;
+  }
+  const uint64_t dataoff = intmem::loadu_le<uint32_t>(raw.data() + 8);
+  const uint64_t datasize = intmem::loadu_le<uint32_t>(raw.data() + 12);
+  if (!linkedit_range(bin, dataoff, datasize, data)) {
+    return false;
+  }
+  size = datasize;
+  return true;
+}
+
+bool dyld_info_data(LIEF::MachO::Binary const &bin, DyldInfoPart part,
+                    const uint8_t *&data, size_t &size) {
+  static constexpr uint32_t LC_DYLD_INFO = 0x22;
+  static constexpr uint32_t LC_DYLD_INFO_ONLY = 0x80000022;
+  data = nullptr;
+  size = 0;
+  const LIEF::MachO::LoadCommand *command =
+      find_command(bin, LC_DYLD_INFO_ONLY);
+  if (command == nullptr) {
+    command = find_command(bin, LC_DYLD_INFO);
+  }
+  // dyld_info_command: cmd, cmdsize, then the offset and size of each part
+  const auto pos = static_cast<uint32_t>(part);
+  if (command == nullptr || command->data().size() < 48) {
+    return false;
+  }
+  const uint8_t *raw = command->data().data();
+  const uint64_t offset = intmem::loadu_le<uint32_t>(raw + pos);
+  const uint64_t part_size = intmem::loadu_le<uint32_t>(raw + pos + 4);
+  if (part_size == 0) {
+    return true;
+  }
+  if (!linkedit_range(bin, offset, part_size, data)) {
+    data = nullptr;
+    return false;
+  }
+  size = part_size;
+  return true;
+}
+
+void export_trie(LIEF::MachO::Binary const &bin, const uint8_t *&data,
+                 size_t &size) {
+  static constexpr uint32_t LC_DYLD_EXPORTS_TRIE = 0x80000033;
+  data = nullptr;
+  size = 0;
+  const LIEF::MachO::LoadCommand *command =
+      find_command(bin, LC_DYLD_EXPORTS_TRIE);
+  if (command != nullptr) {
+    if (!linkedit_data(bin, *command, data, size)) {
+      Logger::warn("LC_DYLD_EXPORTS_TRIE is out of __LINKEDIT");
+      data = nullptr;
+      size = 0;
+    }
+    return;
+  }
+  if (bin.has_dyld_info() &&
+      !dyld_info_data(bin, DyldInfoPart::EXPORT, data, size)) {
+    Logger::warn("The export trie of LC_DYLD_INFO is out of __LINKEDIT");
+  }
+}
+
+std::vector<Arch> macho_archs() {
+  return {cpu_arch(CPU_TYPE_X86), cpu_arch(CPU_TYPE_X86 | CPU_ARCH_ABI64),
+          cpu_arch(CPU_TYPE_ARM), cpu_arch(CPU_TYPE_ARM | CPU_ARCH_ABI64),
+          cpu_arch(CPU_TYPE_POWERPC),
+          cpu_arch(CPU_TYPE_POWERPC | CPU_ARCH_ABI64)};
+}
+
+std::unique_ptr<LIEF::MachO::Binary> parse_macho_slice(
+    std::string const &path, std::function<bool(Arch const &)> const &accept,
+    std::function<bool(const uint8_t *, size_t)> const &skip_dyld_info) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return {};
+  }
+  const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+  std::vector<uint8_t> header(
+      std::min<uint64_t>(file_size, HEADER_READ_SIZE));
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(header.data()), header.size());
+  std::vector<MachOSlice> slices;
+  if (!in || !macho_slices(header.data(), header.size(), file_size, slices)) {
+    Logger::err("{} is not a Mach-O file", path);
+    return {};
+  }
+  const MachOSlice *slice = select(slices, accept);
+  if (slice == nullptr) {
+    return {};
+  }
+  Logger::debug("Parsing the slice of {} at 0x{:x} (0x{:x} bytes)", path,
+                slice->offset, slice->size);
+
+  std::vector<uint8_t> content;
+  if (slice->offset == 0 && slice->size == header.size()) {
+    content = std::move(header);
+  } else {
+    content.resize(slice->size);
+    in.seekg(slice->offset);
+    in.read(reinterpret_cast<char *>(content.data()), content.size());
+    if (!in) {
+      return {};
+    }
+  }
+  const bool deep =
+      !skip_dyld_info || !skip_dyld_info(content.data(), content.size());
+  return parse_slice(content, path, deep);
+}
+
+std::unique_ptr<LIEF::MachO::Binary>
+parse_macho_slice(const uint8_t *data, size_t size,
+                  std::function<bool(Arch const &)> const &accept,
+                  std::string const &name) {
+  std::vector<MachOSlice> slices;
+  if (!macho_slices(data, size, size, slices)) {
+    return {};
+  }
+  const MachOSlice *slice = select(slices, accept);
+  if (slice == nullptr) {
+    return {};
+  }
+  const uint8_t *begin = data + slice->offset;
+  return parse_slice({begin, begin + slice->size}, name);
+}
+
+} // namespace QBDL
@@ -0,0 +1,145 @@
+#ifndef QBDL_MACHO_FILE_H_
+#define QBDL_MACHO_FILE_H_
+
+#include <QBDL/arch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LIEF::MachO {
+class Binary;
+class LoadCommand;
+} // namespace LIEF::MachO
+
+namespace QBDL {
+
+/** Architecture slice of a Mach-O file. A thin file has a single slice,
+ * which covers the whole file.
+ */
+struct MachOSlice {
+  uint64_t offset;
+  uint64_t size;
+  Arch arch;
+};
+
+/** Decode the slices of the Mach-O file whose first \p size bytes are
+ * \p data, the whole file being \p file_size bytes long.
+ *
+ * Only the fat header (or the Mach-O header of a thin file) is read, so
+ * \p data may be limited to it.
+ *
+ * @returns false if \p data is not the start of a Mach-O file
+ */
+bool macho_slices(const uint8_t *data, size_t size, uint64_t file_size,
+                  std::vector<MachOSlice> &slices);
+
+/** Architectures of the Mach-O slices that can be selected by
+ * ::QBDL::parse_macho_slice.
+ */
+std::vector<Arch> macho_archs();
+
+/** Parse the first slice of the (potentially universal) Mach-O file \p path
+ * whose architecture is accepted by \p accept.
+ *
+ * Contrary to `LIEF::MachO::Parser::parse`, which parses every slice, only
+ * the fat header and the selected slice are read from the file.
+ *
+ * \p skip_dyld_info, if set, is given the content of the selected slice
+ * before it is parsed. If it returns true, the rebase, bind and export
+ * records of LC_DYLD_INFO are not decoded by LIEF (see
+ * ::QBDL::dyld_info_data to read them).
+ *
+ * @returns nullptr if \p path is not a Mach-O file, has no accepted slice or
+ * can't be parsed
+ */
+std::unique_ptr<LIEF::MachO::Binary> parse_macho_slice(
+    std::string const &path, std::function<bool(Arch const &)> const &accept,
+    std::function<bool(const uint8_t *, size_t)> const &skip_dyld_info = {});
+
+/** Same as above, for a Mach-O file in memory. \p name is given to LIEF.
+ */
+std::unique_ptr<LIEF::MachO::Binary>
+parse_macho_slice(const uint8_t *data, size_t size,
+                  std::function<bool(Arch const &)> const &accept,
+                  std::string const &name = {});
+
+/** UUID of the thin Mach-O file whose first \p size bytes are \p data: the
+ * 16 bytes of its LC_UUID command, or an empty string if it has none.
+ */
+std::string macho_uuid(const uint8_t *data, size_t size);
+
+/** Read the unsigned LEB128 at \p p, and move \p p after it.
+ *
+ * @returns false if it goes beyond \p end
+ */
+bool read_uleb128(const uint8_t *&p, const uint8_t *end, uint64_t &value);
+
+/** Read the signed LEB128 at \p p, and move \p p after it.
+ *
+ * @returns false if it goes beyond \p end
+ */
+bool read_sleb128(const uint8_t *&p, const uint8_t *end, int64_t &value);
+
+/** First load command of \p bin whose type is \p type (a LC_* value), or
+ * nullptr if there is none.
+ */
+const LIEF::MachO::LoadCommand *find_command(LIEF::MachO::Binary const &bin,
+                                             uint32_t type);
+
+/** Payload of the linkedit_data_command \p command (LC_DYLD_CHAINED_FIXUPS,
+ * LC_DYLD_EXPORTS_TRIE, ...), as a view over the content of __LINKEDIT.
+ *
+ * @returns false if the command is invalid or its payload is out of
+ * __LINKEDIT
+ */
+bool linkedit_data(LIEF::MachO::Binary const &bin,
+                   LIEF::MachO::LoadCommand const &command,
+                   const uint8_t *&data, size_t &size);
+
+/** Parts of LC_DYLD_INFO, by offset of their location in the command */
+enum class DyldInfoPart : uint32_t {
+  REBASE = 8,
+  BIND = 16,
+  WEAK_BIND = 24,
+  LAZY_BIND = 32,
+  EXPORT = 40,
+};
+
+/** Payload of the \p part of the LC_DYLD_INFO(_ONLY) command of \p bin, as
+ * a view over the content of __LINKEDIT. Contrary to
+ * `LIEF::MachO::DyldInfo`, it doesn't depend on how deeply \p bin was
+ * parsed.
+ *
+ * @returns false if \p bin has no such command or if the payload is out of
+ * __LINKEDIT. \p size is 0 if the command has no such part.
+ */
+bool dyld_info_data(LIEF::MachO::Binary const &bin, DyldInfoPart part,
+                    const uint8_t *&data, size_t &size);
+
+/** Export trie of \p bin: the payload of LC_DYLD_EXPORTS_TRIE (images with
+ * fixup chains) or the export trie of LC_DYLD_INFO. \p data is set to
+ * nullptr if \p bin has none.
+ */
+void export_trie(LIEF::MachO::Binary const &bin, const uint8_t *&data,
+                 size_t &size);
+
+/** Walk the export trie down to the terminal node of \p name, and read its
+ * flags and value. See "dyld_info_command" in <mach-o/loader.h>.
+ *
+ * @returns false if \p name is not exported
+ */
+bool trie_lookup(const uint8_t *trie, size_t size, std::string_view name,
+                 uint64_t &flags, uint64_t &value);
+
+/** Names of the symbols exported by the export trie.
+ */
+std::vector<std::string> trie_exports(const uint8_t *trie, size_t size);
+
+} // namespace QBDL
+
+#endif
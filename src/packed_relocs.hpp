@@ -0,0 +1,168 @@
+#ifndef QBDL_PACKED_RELOCS_H_
+#define QBDL_PACKED_RELOCS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace QBDL {
+
+/** Relocation decoded from an Android packed (APS2) table.
+ */
+struct PackedReloc {
+  uint64_t offset;
+  uint64_t info;
+  int64_t addend; // 0 for DT_ANDROID_REL tables
+};
+
+/** Sequential reader over the little-endian content of a relocation table.
+ */
+class PackedReader {
+public:
+  PackedReader(const uint8_t *data, size_t size)
+      : cur_(data), end_(data + size) {}
+
+  bool ok() const { return ok_; }
+  bool at_end() const { return cur_ == end_; }
+
+  uint64_t word(size_t len) {
+    if (static_cast<size_t>(end_ - cur_) < len) {
+      ok_ = false;
+      cur_ = end_;
+      return 0;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; ++i) {
+      v |= static_cast<uint64_t>(cur_[i]) << (8 * i);
+    }
+    cur_ += len;
+    return v;
+  }
+
+  int64_t sleb128() {
+    uint64_t v = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+      if (cur_ == end_ || shift >= 64) {
+        ok_ = false;
+        return 0;
+      }
+      byte = *cur_++;
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    if (shift < 64 && (byte & 0x40)) {
+      v |= ~uint64_t{0} << shift;
+    }
+    return static_cast<int64_t>(v);
+  }
+
+  bool magic(const char (&m)[5]) {
+    if (static_cast<size_t>(end_ - cur_) < 4 || memcmp(cur_, m, 4) != 0) {
+      return false;
+    }
+    cur_ += 4;
+    return true;
+  }
+
+private:
+  const uint8_t *cur_;
+  const uint8_t *end_;
+  bool ok_ = true;
+};
+
+/** Call \p F(offset) on each word relocated by the DT_RELR table \p data.
+ *
+ * The table is a sequence of addresses (even entries) each followed by
+ * bitmaps (odd entries) of the next words to relocate.
+ *
+ * @returns false if the table is truncated
+ */
+template <class Func>
+bool for_each_relr(const uint8_t *data, size_t size, bool is64, Func F) {
+  const size_t wordsize = is64 ? 8 : 4;
+  const size_t bits = wordsize * 8 - 1;
+  PackedReader reader{data, size};
+  uint64_t where = 0;
+  while (!reader.at_end()) {
+    uint64_t entry = reader.word(wordsize);
+    if (!reader.ok()) {
+      return false;
+    }
+    if ((entry & 1) == 0) {
+      F(entry);
+      where = entry + wordsize;
+      continue;
+    }
+    for (uint64_t offset = where; (entry >>= 1) != 0; offset += wordsize) {
+      if (entry & 1) {
+        F(offset);
+      }
+    }
+    where += bits * wordsize;
+  }
+  return true;
+}
+
+/** Call \p F(PackedReloc const&) on each relocation of the Android packed
+ * table \p data (DT_ANDROID_REL or DT_ANDROID_RELA).
+ *
+ * After the "APS2" magic, the table gives the number of relocations and the
+ * initial offset, followed by groups of relocations that may share their
+ * offset delta, info or addend (all of them sleb128-encoded).
+ *
+ * @returns false if the table is not a valid APS2 table
+ */
+template <class Func>
+bool for_each_aps2(const uint8_t *data, size_t size, Func F) {
+  static constexpr uint64_t GROUPED_BY_INFO = 1;
+  static constexpr uint64_t GROUPED_BY_OFFSET_DELTA = 2;
+  static constexpr uint64_t GROUPED_BY_ADDEND = 4;
+  static constexpr uint64_t GROUP_HAS_ADDEND = 8;
+
+  PackedReader reader{data, size};
+  if (!reader.magic("APS2")) {
+    return false;
+  }
+  uint64_t remaining = reader.sleb128();
+  PackedReloc reloc{static_cast<uint64_t>(reader.sleb128()), 0, 0};
+  while (remaining != 0 && reader.ok()) {
+    const uint64_t group_size = reader.sleb128();
+    const uint64_t flags = reader.sleb128();
+    if (group_size == 0 || group_size > remaining) {
+      return false;
+    }
+    uint64_t offset_delta = 0;
+    if (flags & GROUPED_BY_OFFSET_DELTA) {
+      offset_delta = reader.sleb128();
+    }
+    if (flags & GROUPED_BY_INFO) {
+      reloc.info = reader.sleb128();
+    }
+    if ((flags & GROUP_HAS_ADDEND) == 0) {
+      reloc.addend = 0;
+    } else if (flags & GROUPED_BY_ADDEND) {
+      reloc.addend += reader.sleb128();
+    }
+    for (uint64_t i = 0; i < group_size && reader.ok(); ++i) {
+      reloc.offset += (flags & GROUPED_BY_OFFSET_DELTA) ? offset_delta
+                                                        : reader.sleb128();
+      if ((flags & GROUPED_BY_INFO) == 0) {
+        reloc.info = reader.sleb128();
+      }
+      if ((flags & GROUP_HAS_ADDEND) && (flags & GROUPED_BY_ADDEND) == 0) {
+        reloc.addend += reader.sleb128();
+      }
+      if (reader.ok()) {
+        F(static_cast<PackedReloc const &>(reloc));
+      }
+    }
+    remaining -= group_size;
+  }
+  return reader.ok();
+}
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,268 @@
+#include "pe_file.hpp"
+#include "intmem.hpp"
+#include "logging.hpp"
+#include <LIEF/PE.hpp>
+#include <QBDL/arch.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace QBDL {
+
+namespace {
+// Reads the raw content of the sections of a PE image by RVA. Sections are
+// copied out of LIEF once, when they are first read.
+class RvaReader {
+public:
+  explicit RvaReader(LIEF::PE::Binary const &bin) : bin_(bin) {}
+
+  // Content from \p rva to the end of its section
+  bool get(uint64_t rva, const uint8_t *&data, size_t &size) {
+    for (const auto &[va, content] : sections_) {
+      if (rva >= va && rva - va < content.size()) {
+        data = content.data() + (rva - va);
+        size = content.size() - (rva - va);
+        return true;
+      }
+    }
+    for (const LIEF::PE::Section &section : bin_.sections()) {
+      const uint64_t va = section.virtual_address();
+      const uint64_t vsize =
+          std::max<uint64_t>(section.virtual_size(), section.size());
+      if (rva < va || rva - va >= vsize) {
+        continue;
+      }
+      sections_.emplace_back(va, section.content());
+      const std::vector<uint8_t> &content = sections_.back().second;
+      if (rva - va >= content.size()) {
+        return false;
+      }
+      data = content.data() + (rva - va);
+      size = content.size() - (rva - va);
+      return true;
+    }
+    return false;
+  }
+
+  template <class T> bool read(uint64_t rva, T &value) {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    if (!get(rva, data, size) || size < sizeof(T)) {
+      return false;
+    }
+    value = intmem::loadu_le<T>(data);
+    return true;
+  }
+
+  bool read_string(uint64_t rva, std::string &str) {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    if (!get(rva, data, size)) {
+      return false;
+    }
+    const char *begin = reinterpret_cast<const char *>(data);
+    str.assign(begin, strnlen(begin, size));
+    return true;
+  }
+
+private:
+  LIEF::PE::Binary const &bin_;
+  std::vector<std::pair<uint64_t, std::vector<uint8_t>>> sections_;
+};
+} // namespace
+
+std::string dll_key(std::string const &name) {
+  const size_t pos = name.find_last_of("/\\");
+  std::string key = pos == std::string::npos ? name : name.substr(pos + 1);
+  std::transform(key.begin(), key.end(), key.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return key;
+}
+
+bool PEExports::parse(LIEF::PE::Binary const &bin) {
+  const LIEF::PE::DataDirectory &dir =
+      bin.data_directory(LIEF::PE::DATA_DIRECTORY::EXPORT_TABLE);
+  if (dir.RVA() == 0 || dir.size() == 0) {
+    return false;
+  }
+
+  // IMAGE_EXPORT_DIRECTORY
+  RvaReader reader{bin};
+  const uint64_t rva = dir.RVA();
+  uint32_t functions_count = 0;
+  uint32_t names_count = 0;
+  uint32_t functions_rva = 0;
+  uint32_t names_rva = 0;
+  uint32_t ordinals_rva = 0;
+  if (!reader.read(rva + 16, ordinal_base_) ||
+      !reader.read(rva + 20, functions_count) ||
+      !reader.read(rva + 24, names_count) ||
+      !reader.read(rva + 28, functions_rva) ||
+      !reader.read(rva + 32, names_rva) ||
+      !reader.read(rva + 36, ordinals_rva)) {
+    Logger::err("Truncated export directory");
+    return false;
+  }
+
+  // Export address table. Entries that point into the export directory are
+  // forwarders.
+  functions_.clear();
+  functions_.resize(functions_count);
+  for (uint32_t i = 0; i < functions_count; ++i) {
+    Function &function = functions_[i];
+    if (!reader.read(functions_rva + uint64_t{i} * 4, function.rva)) {
+      Logger::err("Truncated export address table");
+      return false;
+    }
+    if (function.rva >= rva && function.rva - rva < dir.size() &&
+        !reader.read_string(function.rva, function.forward)) {
+      return false;
+    }
+  }
+
+  // Name pointer and ordinal tables
+  names_.clear();
+  names_.reserve(names_count);
+  for (uint32_t i = 0; i < names_count; ++i) {
+    uint32_t name_rva = 0;
+    uint16_t index = 0;
+    std::string name;
+    if (!reader.read(names_rva + uint64_t{i} * 4, name_rva) ||
+        !reader.read(ordinals_rva + uint64_t{i} * 2, index) ||
+        !reader.read_string(name_rva, name)) {
+      Logger::err("Truncated export name table");
+      return false;
+    }
+    if (index < functions_count) {
+      names_.emplace_back(std::move(name), index);
+    }
+  }
+  // The table is sorted by the linker. Since hints are checked against the
+  // name, sorting a broken one only costs them.
+  const auto by_name = [](auto const &lhs, auto const &rhs) {
+    return lhs.first < rhs.first;
+  };
+  if (!std::is_sorted(names_.begin(), names_.end(), by_name)) {
+    std::stable_sort(names_.begin(), names_.end(), by_name);
+  }
+  return true;
+}
+
+const PEExports::Function *PEExports::find(std::string_view name,
+                                           uint32_t hint) const {
+  uint32_t index = 0;
+  if (hint < names_.size() && names_[hint].first == name) {
+    index = names_[hint].second;
+  } else {
+    const auto it = std::lower_bound(
+        names_.begin(), names_.end(), name,
+        [](auto const &entry, std::string_view name) {
+          return std::string_view{entry.first} < name;
+        });
+    if (it == names_.end() || it->first != name) {
+      return nullptr;
+    }
+    index = it->second;
+  }
+  const Function &function = functions_[index];
+  return function.rva != 0 ? &function : nullptr;
+}
+
+const PEExports::Function *PEExports::find_ordinal(uint32_t ordinal) const {
+  if (ordinal < ordinal_base_ || ordinal - ordinal_base_ >= functions_.size()) {
+    return nullptr;
+  }
+  const Function &function = functions_[ordinal - ordinal_base_];
+  return function.rva != 0 ? &function : nullptr;
+}
+
+bool PEExports::split_forward(std::string const &forward, std::string &dll,
+                              std::string &name) {
+  // As the Windows loader, split at the first dot: DLL names of forwarders
+  // have no extension
+  const size_t pos = forward.find('.');
+  if (pos == 0 || pos == std::string::npos || pos + 1 == forward.size()) {
+    return false;
+  }
+  dll = dll_key(forward.substr(0, pos) + ".dll");
+  name = forward.substr(pos + 1);
+  return true;
+}
+
+bool pe_delay_imports(LIEF::PE::Binary const &bin,
+                      std::vector<PEDelayImport> &imports) {
+  imports.clear();
+  const LIEF::PE::DataDirectory &dir =
+      bin.data_directory(LIEF::PE::DATA_DIRECTORY::DELAY_IMPORT_DESCRIPTOR);
+  if (dir.RVA() == 0 || dir.size() == 0) {
+    return true;
+  }
+  const bool is64 = Arch::from_bin(bin).is64;
+  const uint64_t entry_size = is64 ? 8 : 4;
+  const uint64_t ordinal_flag = uint64_t{1} << (entry_size * 8 - 1);
+
+  // The table of IMAGE_DELAYLOAD_DESCRIPTOR ends with a null entry
+  RvaReader reader{bin};
+  for (uint64_t desc = dir.RVA();; desc += 32) {
+    uint32_t attributes = 0;
+    uint32_t name_rva = 0;
+    uint32_t iat_rva = 0;
+    uint32_t int_rva = 0;
+    if (!reader.read(desc, attributes) || !reader.read(desc + 4, name_rva) ||
+        !reader.read(desc + 12, iat_rva) || !reader.read(desc + 16, int_rva)) {
+      Logger::err("Truncated delay-load import table");
+      return false;
+    }
+    if (name_rva == 0) {
+      break;
+    }
+    // Descriptors emitted by Visual C++ 6.0 hold VAs instead of RVAs
+    // (dlattrRva is not set)
+    const uint64_t bias =
+        (attributes & 1) != 0 ? 0 : bin.optional_header().imagebase();
+    std::string dll;
+    if (!reader.read_string(name_rva - bias, dll)) {
+      Logger::err("Invalid delay-load DLL name");
+      return false;
+    }
+    dll = dll_key(dll);
+
+    // Import name table, parallel to the delay IAT
+    for (uint64_t i = 0;; ++i) {
+      uint64_t entry = 0;
+      bool valid = false;
+      if (is64) {
+        valid = reader.read(int_rva - bias + i * entry_size, entry);
+      } else {
+        uint32_t entry32 = 0;
+        valid = reader.read(int_rva - bias + i * entry_size, entry32);
+        entry = entry32;
+      }
+      if (!valid) {
+        Logger::err("Truncated delay-load import name table of {}", dll);
+        return false;
+      }
+      if (entry == 0) {
+        break;
+      }
+      PEDelayImport import{
+          dll, {}, 0, static_cast<uint32_t>(iat_rva - bias + i * entry_size)};
+      if ((entry & ordinal_flag) != 0) {
+        import.name = "#" + std::to_string(entry & 0xFFFF);
+      } else if (!reader.read(entry - bias, import.hint) ||
+                 !reader.read_string(entry - bias + 2, import.name)) {
+        Logger::err("Invalid delay-load import of {}", dll);
+        return false;
+      }
+      imports.push_back(std::move(import));
+    }
+  }
+  std::sort(imports.begin(), imports.end(),
+            [](PEDelayImport const &lhs, PEDelayImport const &rhs) {
+              return lhs.slot < rhs.slot;
+            });
+  return true;
+}
+
+} // namespace QBDL
@@ -0,0 +1,88 @@
+#ifndef QBDL_PE_FILE_H_
+#define QBDL_PE_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace LIEF::PE {
+class Binary;
+} // namespace LIEF::PE
+
+namespace QBDL {
+
+/** Key of the DLL \p name: its file name, in lower case, as DLL names are
+ * case-insensitive.
+ */
+std::string dll_key(std::string const &name);
+
+/** Export directory of a PE image, as the Windows loader reads it.
+ *
+ * Contrary to `LIEF::PE::Export`, the name pointer table is kept in file
+ * order, so that the hint of an import (its index in this table) can be
+ * checked before falling back to a binary search.
+ */
+class PEExports {
+public:
+  /** Exported function. Forwarded exports (`NTDLL.RtlAllocateHeap`,
+   * `WS2_32.#23`) have a non-empty ::QBDL::PEExports::Function::forward.
+   */
+  struct Function {
+    uint32_t rva;
+    std::string forward;
+  };
+
+  /** Read the export directory of \p bin.
+   *
+   * @returns false if \p bin has no export directory or if it is invalid
+   */
+  bool parse(LIEF::PE::Binary const &bin);
+
+  /** Export of \p name. \p hint is tried first.
+   *
+   * @returns nullptr if \p name is not exported
+   */
+  const Function *find(std::string_view name, uint32_t hint = 0) const;
+
+  /** Export of \p ordinal (biased by the ordinal base, as in the imports).
+   *
+   * @returns nullptr if \p ordinal is not exported
+   */
+  const Function *find_ordinal(uint32_t ordinal) const;
+
+  /** Split the forwarder \p forward into the DLL it points to (with its
+   * `.dll` extension, lower case) and the exported name, or `#<ordinal>`.
+   *
+   * @returns false if \p forward is not `<dll>.<name>`
+   */
+  static bool split_forward(std::string const &forward, std::string &dll,
+                            std::string &name);
+
+private:
+  uint32_t ordinal_base_{0};
+  std::vector<Function> functions_;                     // by ordinal
+  std::vector<std::pair<std::string, uint32_t>> names_; // -> functions_
+};
+
+/** Import of the delay-load import table of a PE image.
+ */
+struct PEDelayImport {
+  std::string dll;  // see ::QBDL::dll_key
+  std::string name; // or `#<ordinal>`
+  uint16_t hint;
+  uint32_t slot; // RVA of its delay IAT slot
+};
+
+/** Read the delay-load import table (IMAGE_DELAYLOAD_DESCRIPTOR) of \p bin,
+ * which LIEF does not parse. \p imports are sorted by slot.
+ *
+ * @returns false if the table is invalid
+ */
+bool pe_delay_imports(LIEF::PE::Binary const &bin,
+                      std::vector<PEDelayImport> &imports);
+
+} // namespace QBDL
+
+#endif
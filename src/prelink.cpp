@@ -0,0 +1,217 @@
+#include "prelink.hpp"
+#include "logging.hpp"
+#include "serialize.hpp"
+#include <QBDL/Engine.hpp>
+#include <QBDL/utils.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <vector>
+
+namespace QBDL {
+
+namespace {
+constexpr char MAGIC[8] = {'Q', 'B', 'D', 'L', 'P', 'R', 'E', 'L'};
+constexpr uint32_t VERSION = 2;
+
+void write_entries(Writer &w, std::vector<PrelinkImage::Entry> const &entries) {
+  for (const PrelinkImage::Entry &entry : entries) {
+    w.str(entry.first);
+    w.u64(entry.second);
+  }
+}
+
+bool read_entries(Reader &r, uint64_t count,
+                  std::vector<PrelinkImage::Entry> &entries) {
+  // An entry is at least the length of its name and its value
+  if (!r.fits(count, sizeof(uint32_t) + sizeof(uint64_t))) {
+    return false;
+  }
+  entries.reserve(count);
+  for (uint64_t i = 0; i < count && r.ok(); ++i) {
+    std::string name = r.str();
+    const uint64_t value = r.u64();
+    entries.emplace_back(std::move(name), value);
+  }
+  return r.ok();
+}
+
+std::vector<char> serialize(PrelinkImage const &img) {
+  Writer w;
+  w.raw(MAGIC, sizeof(MAGIC));
+  w.u32(VERSION);
+  w.u32(img.arch.arch);
+  w.u32(img.arch.endianness);
+  w.u32(img.arch.is64);
+  w.u64(img.file_key);
+  w.u64(img.base_address);
+  w.u64(img.mem_size);
+  w.u64(img.entrypoint);
+  w.u64(img.ranges.size());
+  w.u64(img.imports.size());
+  w.u64(img.symbols.size());
+  for (const PrelinkImage::Range &range : img.ranges) {
+    w.u64(range.rva);
+    w.u64(range.size);
+    w.u64(range.prot);
+    w.u64(range.offset);
+  }
+  write_entries(w, img.imports);
+  write_entries(w, img.symbols);
+  return w.buf();
+}
+} // namespace
+
+std::string PrelinkImage::path(std::string const &dir, uint64_t file_key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.prelink",
+           static_cast<unsigned long long>(file_key));
+  return dir + "/" + name;
+}
+
+bool PrelinkImage::read(std::string const &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  char magic[sizeof(MAGIC)];
+  in.read(magic, sizeof(magic));
+  Reader r{in};
+  if (!in || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || r.u32() != VERSION) {
+    Logger::debug("{} is not a valid prelink cache entry", path);
+    return false;
+  }
+  const auto arch_id = static_cast<LIEF::ARCHITECTURES>(r.u32());
+  const auto endianness = static_cast<LIEF::ENDIANNESS>(r.u32());
+  const bool is64 = r.u32() != 0;
+  arch = Arch{arch_id, endianness, is64};
+  file_key = r.u64();
+  base_address = r.u64();
+  mem_size = r.u64();
+  entrypoint = r.u64();
+  const uint64_t nb_ranges = r.u64();
+  const uint64_t nb_imports = r.u64();
+  const uint64_t nb_symbols = r.u64();
+  if (!r.fits(nb_ranges, 4 * sizeof(uint64_t))) {
+    Logger::debug("{} is corrupted", path);
+    return false;
+  }
+  ranges.clear();
+  ranges.reserve(nb_ranges);
+  for (uint64_t i = 0; i < nb_ranges; ++i) {
+    Range range;
+    range.rva = r.u64();
+    range.size = r.u64();
+    range.prot = static_cast<int>(r.u64());
+    range.offset = r.u64();
+    ranges.push_back(range);
+  }
+  imports.clear();
+  symbols.clear();
+  if (!read_entries(r, nb_imports, imports) ||
+      !read_entries(r, nb_symbols, symbols)) {
+    Logger::debug("{} is corrupted", path);
+    return false;
+  }
+
+  // Ranges are mapped at a fixed address, from the content in the file: don't
+  // trust them
+  const uint64_t file_size = static_cast<uint64_t>(in.tellg()) + r.remaining();
+  bool valid = page_start(base_address) == base_address &&
+               page_align(mem_size) == mem_size && entrypoint < mem_size;
+  for (const Range &range : ranges) {
+    valid = valid && range.size != 0 && range.rva <= mem_size &&
+            range.size <= mem_size - range.rva &&
+            page_start(range.rva) == range.rva &&
+            page_align(range.size) == range.size &&
+            page_start(range.offset, CONTENT_ALIGN) == range.offset &&
+            range.offset <= file_size && range.size <= file_size - range.offset;
+  }
+  if (!valid) {
+    Logger::debug("{} is corrupted", path);
+  }
+  return valid;
+}
+
+bool PrelinkImage::read_content(std::string const &path, Range const &range,
+                                std::vector<uint8_t> &out) {
+  std::ifstream in(path, std::ios::binary);
+  out.resize(range.size);
+  in.seekg(range.offset);
+  in.read(reinterpret_cast<char *>(out.data()), out.size());
+  return static_cast<bool>(in);
+}
+
+bool PrelinkImage::write(std::string const &path, TargetMemory &mem) {
+  // Content offsets don't change the size of the header
+  uint64_t offset = page_align(serialize(*this).size(), CONTENT_ALIGN);
+  for (Range &range : ranges) {
+    range.offset = offset;
+    offset = page_align(offset + range.size, CONTENT_ALIGN);
+  }
+  const std::vector<char> header = serialize(*this);
+
+  return replace_file(path, [&](std::ostream &out) {
+    out.write(header.data(), header.size());
+    std::vector<uint8_t> content;
+    for (const Range &range : ranges) {
+      content.resize(range.size);
+      mem.read(content.data(), base_address + range.rva, content.size());
+      out.seekp(range.offset);
+      out.write(reinterpret_cast<const char *>(content.data()),
+                content.size());
+    }
+    return static_cast<bool>(out);
+  });
+}
+
+uint64_t prelink_key(const char *path, std::string const &build_id) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return 0;
+  }
+  // FNV-1a
+  static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325;
+  static constexpr uint64_t FNV_PRIME = 0x100000001b3;
+  uint64_t hash = FNV_OFFSET;
+  const auto mix = [&hash](const void *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ static_cast<const uint8_t *>(data)[i]) * FNV_PRIME;
+    }
+  };
+  const uint64_t fields[] = {
+      static_cast<uint64_t>(st.st_dev),  static_cast<uint64_t>(st.st_ino),
+      static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_mtime),
+#if defined(__APPLE__)
+      static_cast<uint64_t>(st.st_mtimespec.tv_nsec),
+#elif defined(__linux__)
+      static_cast<uint64_t>(st.st_mtim.tv_nsec),
+#endif
+  };
+  mix(fields, sizeof(fields));
+  if (!build_id.empty()) {
+    mix(build_id.data(), build_id.size());
+    return hash == 0 ? 1 : hash;
+  }
+
+  // Without a build-id, the metadata alone doesn't identify the content: a
+  // file rewritten within the resolution of the timestamps, or with its mtime
+  // restored (cp -p, tar, rsync), would get the entry of the previous version.
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> buf(1 << 16);
+  uint64_t total = 0;
+  while (in) {
+    in.read(buf.data(), buf.size());
+    mix(buf.data(), static_cast<size_t>(in.gcount()));
+    total += static_cast<uint64_t>(in.gcount());
+  }
+  if (!in.eof() || total != static_cast<uint64_t>(st.st_size)) {
+    Logger::debug("Can't read {} to compute its prelink key", path);
+    return 0;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+} // namespace QBDL
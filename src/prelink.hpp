@@ -0,0 +1,78 @@
+#ifndef QBDL_PRELINK_H_
+#define QBDL_PRELINK_H_
+
+#include <QBDL/arch.hpp>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace QBDL {
+class TargetMemory;
+
+/** Fully relocated image of a binary, as persisted in the prelink cache (see
+ * ::QBDL::TargetSystem::prelink_cache_dir).
+ *
+ * The file starts with a header and the tables below, followed by the
+ * content of each range, aligned on PrelinkImage::CONTENT_ALIGN so that it
+ * can be mapped back with ::QBDL::TargetMemory::map_file.
+ */
+struct PrelinkImage {
+  // Large enough for the page size of every supported system
+  static constexpr uint64_t CONTENT_ALIGN = 0x10000;
+
+  struct Range {
+    uint64_t rva;
+    uint64_t size;
+    int prot;
+    uint64_t offset; // of the content, in the cache file
+  };
+  using Entry = std::pair<std::string, uint64_t>;
+
+  uint64_t file_key = 0;
+  uint64_t base_address = 0;
+  uint64_t mem_size = 0;
+  uint64_t entrypoint = 0; // RVA
+  Arch arch{LIEF::ARCH_NONE, LIEF::ENDIAN_NONE, false};
+
+  std::vector<Range> ranges;
+  std::vector<Entry> imports; // name -> resolved address
+  std::vector<Entry> symbols; // name -> RVA
+
+  /** Path of the cache entry of the binary \p file_key (see
+   * ::QBDL::prelink_key).
+   */
+  static std::string path(std::string const &dir, uint64_t file_key);
+
+  /** Read the header and the tables of the cache entry \p path. The content
+   * of the ranges is left in the file.
+   */
+  bool read(std::string const &path);
+
+  /** Read the content of \p range from the cache entry \p path.
+   */
+  static bool read_content(std::string const &path, Range const &range,
+                           std::vector<uint8_t> &out);
+
+  /** Write the cache entry \p path, with the content of the ranges read from
+   * the image mapped at `base_address` in \p mem.
+   *
+   * The file is written under a temporary name and then renamed, so that
+   * concurrent loaders never see a partial entry, and images mapped from a
+   * previous version of the entry are left untouched.
+   */
+  bool write(std::string const &path, TargetMemory &mem);
+};
+
+/** Key of the file \p path in the prelink cache: a hash of its device, inode,
+ * size and modification time, and of its \p build_id. The metadata only
+ * tells apart the copies of a binary, so that the content of files without a
+ * build-id is hashed instead, which reads the whole file. Returns 0 if the
+ * file can't be stat'ed or read.
+ */
+uint64_t prelink_key(const char *path, std::string const &build_id);
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,79 @@
+#include "protections.hpp"
+#include "logging.hpp"
+#include <QBDL/Engine.hpp>
+
+namespace QBDL {
+
+void Protections::split(uint64_t at) {
+  auto it = ranges_.upper_bound(at);
+  if (it == ranges_.begin()) {
+    return;
+  }
+  --it;
+  Range &range = it->second;
+  if (it->first < at && at < range.end) {
+    ranges_.emplace(at, Range{range.end, range.prot});
+    range.end = at;
+  }
+}
+
+void Protections::set(uint64_t start, uint64_t end, int prot) {
+  if (start >= end) {
+    return;
+  }
+  split(start);
+  split(end);
+  ranges_.erase(ranges_.lower_bound(start), ranges_.lower_bound(end));
+  ranges_.emplace(start, Range{end, prot});
+}
+
+void Protections::add(uint64_t start, uint64_t end, int prot) {
+  if (start >= end) {
+    return;
+  }
+  split(start);
+  split(end);
+  uint64_t cur = start;
+  auto it = ranges_.lower_bound(start);
+  while (cur < end) {
+    if (it == ranges_.end() || it->first >= end) {
+      ranges_.emplace(cur, Range{end, prot});
+      break;
+    }
+    if (it->first > cur) {
+      ranges_.emplace(cur, Range{it->first, prot});
+    }
+    it->second.prot |= prot;
+    cur = it->second.end;
+    ++it;
+  }
+}
+
+bool Protections::apply(TargetMemory &mem, uint64_t base) const {
+  bool ret = true;
+  for_each([&](uint64_t start, uint64_t end, int prot) {
+    if (!mem.mprotect(base + start, end - start, prot)) {
+      Logger::warn("Unable to change protection of [0x{:x}, 0x{:x})",
+                   base + start, base + end);
+      ret = false;
+    }
+  });
+  return ret;
+}
+
+bool Protections::commit(TargetMemory &mem, uint64_t base) const {
+  bool ret = true;
+  for_each([&](uint64_t start, uint64_t end, int prot) {
+    if (prot == TargetMemory::NONE) {
+      return;
+    }
+    if (!mem.commit(base + start, end - start, prot)) {
+      Logger::err("Unable to commit [0x{:x}, 0x{:x})", base + start,
+                  base + end);
+      ret = false;
+    }
+  });
+  return ret;
+}
+
+} // namespace QBDL
@@ -0,0 +1,78 @@
+#ifndef QBDL_PROTECTIONS_H_
+#define QBDL_PROTECTIONS_H_
+
+#include <cstdint>
+#include <map>
+
+namespace QBDL {
+class TargetMemory;
+
+/** Page protections of a loaded image.
+ *
+ * Loaders describe the protection of each of their segments/sections (and of
+ * the holes in between) relatively to the image base, and then apply them
+ * with as few ::QBDL::TargetMemory::mprotect calls as possible, by merging
+ * adjacent ranges that share the same protection.
+ */
+class Protections {
+public:
+  /** Set the protection of [start, end), overriding any previous value.
+   */
+  void set(uint64_t start, uint64_t end, int prot);
+
+  /** Add \p prot to the protection of [start, end). This is used for pages
+   * shared between two segments, which must get the union of both
+   * protections.
+   */
+  void add(uint64_t start, uint64_t end, int prot);
+
+  /** Apply the protections to the image mapped at \p base.
+   *
+   * @returns false if one of the ::QBDL::TargetMemory::mprotect calls failed
+   */
+  bool apply(TargetMemory &mem, uint64_t base) const;
+
+  /** Commit the ranges whose protection is not ::QBDL::TargetMemory::NONE
+   * in the image reserved at \p base (see ::QBDL::TargetMemory::commit).
+   *
+   * @returns false if one of the ::QBDL::TargetMemory::commit calls failed
+   */
+  bool commit(TargetMemory &mem, uint64_t base) const;
+
+  /** Call \p F(start, end, prot) on each range, adjacent ranges with the same
+   * protection being merged.
+   */
+  template <class Func> void for_each(Func F) const {
+    auto it = ranges_.begin();
+    while (it != ranges_.end()) {
+      const uint64_t start = it->first;
+      const int prot = it->second.prot;
+      uint64_t end = it->second.end;
+      // Merge with the following ranges as long as they are contiguous
+      for (++it; it != ranges_.end(); ++it) {
+        if (it->first != end || it->second.prot != prot) {
+          break;
+        }
+        end = it->second.end;
+      }
+      F(start, end, prot);
+    }
+  }
+
+private:
+
+  struct Range {
+    uint64_t end;
+    int prot;
+  };
+
+  // Make sure a range starts at \p at, splitting the one that contains it
+  void split(uint64_t at);
+
+  // Key is the start of the range
+  std::map<uint64_t, Range> ranges_;
+};
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,161 @@
+#include "relative.hpp"
+#include "intmem.hpp"
+#include <QBDL/Engine.hpp>
+#include <QBDL/utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace QBDL {
+
+namespace {
+// A region is closed once it would grow larger than MAX_REGION, or if the
+// next relocation is MAX_GAP bytes away or more: a gap of a whole page might
+// not be mapped. Regions never share a page, so that they can be processed
+// concurrently.
+constexpr uint64_t MAX_REGION = 1 << 20;
+constexpr uint64_t MAX_GAP = 0x1000;
+
+template <class T, bool Little> struct Ptr {
+  static T load(const uint8_t *p) {
+    return Little ? intmem::loadu_le<T>(p) : intmem::loadu_be<T>(p);
+  }
+  static void store(uint8_t *p, uint64_t v) {
+    if (Little) {
+      intmem::storeu_le<T>(p, static_cast<T>(v));
+    } else {
+      intmem::storeu_be<T>(p, static_cast<T>(v));
+    }
+  }
+};
+
+template <class Func> void with_ptr(Arch const &arch, Func F) {
+  const bool little = arch.endianness != LIEF::ENDIANNESS::ENDIAN_BIG;
+  if (arch.is64) {
+    if (little) {
+      F(Ptr<uint64_t, true>{});
+    } else {
+      F(Ptr<uint64_t, false>{});
+    }
+  } else {
+    if (little) {
+      F(Ptr<uint32_t, true>{});
+    } else {
+      F(Ptr<uint32_t, false>{});
+    }
+  }
+}
+
+struct Region {
+  uint64_t start;
+  uint64_t end;
+  size_t first; // index of the first relocation
+  size_t last;  // index past the last relocation
+};
+
+// Split the sorted addresses in regions
+template <class GetAddr>
+std::vector<Region> regions(size_t count, size_t ptr_size, GetAddr addr_of) {
+  std::vector<Region> ret;
+  size_t first = 0;
+  while (first < count) {
+    Region region{addr_of(first), addr_of(first) + ptr_size, first, first + 1};
+    for (; region.last < count; ++region.last) {
+      const uint64_t addr = addr_of(region.last);
+      if (addr >= region.end + MAX_GAP) {
+        break;
+      }
+      if (addr + ptr_size - region.start > MAX_REGION &&
+          addr >= page_align(region.end)) {
+        break;
+      }
+      region.end = std::max(region.end, addr + ptr_size);
+    }
+    ret.push_back(region);
+    first = region.last;
+  }
+  return ret;
+}
+
+// Call F(region, buf) on each region, with buf holding the content of the
+// region, which is then written back. Regions are distributed on \p threads
+// threads.
+template <class Func>
+void for_each_region(TargetMemory &mem, std::vector<Region> const &regions,
+                     unsigned threads, Func F) {
+  std::atomic<size_t> next{0};
+  const auto worker = [&]() {
+    std::vector<uint8_t> buf;
+    for (size_t i = next++; i < regions.size(); i = next++) {
+      const Region &region = regions[i];
+      buf.resize(region.end - region.start);
+      mem.read(buf.data(), region.start, buf.size());
+      F(region, buf.data());
+      mem.write(region.start, buf.data(), buf.size());
+    }
+  };
+
+  threads = std::min<size_t>(threads, regions.size());
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+}
+} // namespace
+
+void RelativeRelocs::apply(TargetMemory &mem, Arch const &arch,
+                           uint64_t slide, unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (!mem.concurrent_access()) {
+    threads = 1;
+  }
+
+  // Linkers usually emit them sorted already
+  const auto by_addr = [](Entry const &a, Entry const &b) {
+    return a.addr < b.addr;
+  };
+  if (!std::is_sorted(explicit_.begin(), explicit_.end(), by_addr)) {
+    std::stable_sort(explicit_.begin(), explicit_.end(), by_addr);
+  }
+  if (!std::is_sorted(implicit_.begin(), implicit_.end())) {
+    std::sort(implicit_.begin(), implicit_.end());
+  }
+
+  const size_t ptr_size = arch.is64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  with_ptr(arch, [&](auto ptr) {
+    using P = decltype(ptr);
+    // Both passes may touch the same regions, hence they are not run
+    // concurrently.
+    for_each_region(
+        mem,
+        regions(explicit_.size(), ptr_size,
+                [this](size_t i) { return explicit_[i].addr; }),
+        threads, [this](Region const &region, uint8_t *buf) {
+          for (size_t i = region.first; i < region.last; ++i) {
+            const Entry &entry = explicit_[i];
+            P::store(buf + (entry.addr - region.start), entry.value);
+          }
+        });
+    for_each_region(
+        mem,
+        regions(implicit_.size(), ptr_size,
+                [this](size_t i) { return implicit_[i]; }),
+        threads, [this, slide](Region const &region, uint8_t *buf) {
+          for (size_t i = region.first; i < region.last; ++i) {
+            uint8_t *p = buf + (implicit_[i] - region.start);
+            P::store(p, P::load(p) + slide);
+          }
+        });
+  });
+  explicit_.clear();
+  implicit_.clear();
+}
+
+} // namespace QBDL
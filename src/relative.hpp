@@ -0,0 +1,72 @@
+#ifndef QBDL_RELATIVE_H_
+#define QBDL_RELATIVE_H_
+
+#include <QBDL/arch.hpp>
+#include <QBDL/macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace QBDL {
+class TargetMemory;
+
+/** Relative relocations (R_*_RELATIVE, RELR) of an image.
+ *
+ * They usually are the vast majority of the relocations of a shared library
+ * and only depend on the image base. Rather than going through a
+ * ::QBDL::WriteBatch entry by entry, they are sorted by address and applied
+ * on host-side copies of the relocated regions, with a loop specialized for
+ * the pointer width and endianness of the target.
+ */
+class RelativeRelocs {
+public:
+  RelativeRelocs() = default;
+
+  /** Reserve room for \p count relocations with an explicit addend.
+   */
+  void reserve(size_t count) { explicit_.reserve(count); }
+
+  /** Set the pointer at \p addr to \p value (base + addend).
+   */
+  void add(uint64_t addr, uint64_t value) {
+    explicit_.push_back({addr, value});
+  }
+
+  /** Add the slide of the image to the pointer stored at \p addr (implicit
+   * addend, or rebase).
+   */
+  void add_implicit(uint64_t addr) { implicit_.push_back(addr); }
+
+  size_t size() const { return explicit_.size() + implicit_.size(); }
+
+  /** Apply the relocations, and clear them. \p slide is the difference
+   * between the base address of the image and its preferred one.
+   *
+   * The relocated regions are read and written back with a single
+   * ::QBDL::TargetMemory::read and ::QBDL::TargetMemory::write call per
+   * region. Writes queued in a ::QBDL::WriteBatch to these regions must
+   * therefore be flushed *after* this call.
+   *
+   * Regions are processed by \p threads threads (0 for one per hardware
+   * thread) if \p mem supports it (see
+   * ::QBDL::TargetMemory::concurrent_access).
+   */
+  void apply(TargetMemory &mem, Arch const &arch, uint64_t slide,
+             unsigned threads = 1);
+
+private:
+  struct Entry {
+    uint64_t addr;
+    uint64_t value;
+  };
+
+  std::vector<Entry> explicit_;
+  std::vector<uint64_t> implicit_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelativeRelocs);
+};
+
+} // namespace QBDL
+
+#endif
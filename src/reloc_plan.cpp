@@ -0,0 +1,252 @@
+#include "reloc_plan.hpp"
+#include "logging.hpp"
+#include "serialize.hpp"
+
+#include <cstring>
+#include <fstream>
+
+namespace QBDL {
+
+namespace {
+constexpr char MAGIC[8] = {'Q', 'B', 'D', 'L', 'P', 'L', 'A', 'N'};
+constexpr uint32_t VERSION = 5;
+
+void write_relocs(Writer &w, std::vector<PlanReloc> const &relocs) {
+  w.u64(relocs.size());
+  for (const PlanReloc &reloc : relocs) {
+    w.u64(reloc.rva);
+    w.u32(reloc.kind);
+    w.u32(reloc.symbol);
+    w.u64(static_cast<uint64_t>(reloc.addend));
+  }
+}
+
+bool read_relocs(Reader &r, std::vector<PlanReloc> &relocs) {
+  const uint64_t count = r.u64();
+  relocs.clear();
+  if (!r.fits(count, 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t))) {
+    return false;
+  }
+  relocs.reserve(count);
+  for (uint64_t i = 0; i < count; ++i) {
+    PlanReloc reloc;
+    reloc.rva = r.u64();
+    reloc.kind = r.u32();
+    reloc.symbol = r.u32();
+    reloc.addend = static_cast<int64_t>(r.u64());
+    relocs.push_back(reloc);
+  }
+  return r.ok();
+}
+
+// Whether [rva, rva + size) lies in an image of mem_size bytes
+bool in_image(uint64_t rva, uint64_t size, uint64_t mem_size) {
+  return rva <= mem_size && size <= mem_size - rva;
+}
+} // namespace
+
+uint32_t RelocPlan::name_id(std::string_view name, std::string_view version,
+                            const LIEF::Symbol *source) {
+  std::string key = versioned_name(name, version);
+  const auto it = ids_.find(key);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  const auto id = static_cast<uint32_t>(names.size());
+  names.push_back(key);
+  ids_.emplace(std::move(key), id);
+  sources.push_back(source);
+  return id;
+}
+
+std::string RelocPlan::versioned_name(std::string_view name,
+                                      std::string_view version) {
+  std::string entry{name};
+  if (!version.empty()) {
+    entry += '@';
+    entry += version;
+  }
+  return entry;
+}
+
+std::pair<std::string_view, std::string_view>
+RelocPlan::split_name(std::string_view entry) {
+  const size_t pos = entry.find('@');
+  if (pos == std::string_view::npos) {
+    return {entry, {}};
+  }
+  return {entry.substr(0, pos), entry.substr(pos + 1)};
+}
+
+std::string RelocPlan::path(std::string const &binary_path) {
+  return binary_path + ".qbdlplan";
+}
+
+bool RelocPlan::read(std::string const &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  char magic[sizeof(MAGIC)];
+  in.read(magic, sizeof(magic));
+  Reader r{in};
+  if (!in || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || r.u32() != VERSION) {
+    Logger::debug("{} is not a valid relocation plan", path);
+    return false;
+  }
+  build_id = r.str();
+  const auto arch_id = static_cast<LIEF::ARCHITECTURES>(r.u32());
+  const auto endianness = static_cast<LIEF::ENDIANNESS>(r.u32());
+  const bool is64 = r.u32() != 0;
+  arch = Arch{arch_id, endianness, is64};
+  imagebase = r.u64();
+  mem_size = r.u64();
+  entrypoint = r.u64();
+  relro_rva = r.u64();
+  relro_size = r.u64();
+  tls_rva = r.u64();
+  tls_init_size = r.u64();
+  tls_size = r.u64();
+  tls_align = r.u64();
+
+  const uint64_t nb_segments = r.u64();
+  segments.clear();
+  if (!r.fits(nb_segments, 4 * sizeof(uint64_t) + sizeof(uint32_t))) {
+    Logger::debug("{} is corrupted", path);
+    return false;
+  }
+  segments.reserve(nb_segments);
+  for (uint64_t i = 0; i < nb_segments; ++i) {
+    PlanSegment segment;
+    segment.rva = r.u64();
+    segment.mem_size = r.u64();
+    segment.offset = r.u64();
+    segment.file_size = r.u64();
+    segment.prot = static_cast<int>(r.u32());
+    segments.push_back(segment);
+  }
+  if (!read_relocs(r, relocs) || !read_relocs(r, plt)) {
+    Logger::debug("{} is corrupted", path);
+    return false;
+  }
+
+  const uint64_t nb_names = r.u64();
+  names.clear();
+  ids_.clear();
+  if (!r.fits(nb_names, sizeof(uint32_t))) {
+    Logger::debug("{} is corrupted", path);
+    return false;
+  }
+  names.reserve(nb_names);
+  for (uint64_t i = 0; i < nb_names && r.ok(); ++i) {
+    names.push_back(r.str());
+  }
+  sources.assign(names.size(), nullptr);
+  const uint64_t nb_symbols = r.u64();
+  symbols.clear();
+  if (!r.fits(nb_symbols, sizeof(uint32_t) + sizeof(uint64_t))) {
+    Logger::debug("{} is corrupted", path);
+    return false;
+  }
+  symbols.reserve(nb_symbols);
+  for (uint64_t i = 0; i < nb_symbols && r.ok(); ++i) {
+    std::string name = r.str();
+    const uint64_t rva = r.u64();
+    symbols.emplace_back(std::move(name), rva);
+  }
+  if (!r.ok()) {
+    return false;
+  }
+
+  // Segments are mapped at a fixed address and relocations written there:
+  // don't trust the ranges nor the symbol indices from the file
+  bool valid = entrypoint < mem_size &&
+               in_image(relro_rva, relro_size, mem_size) &&
+               in_image(tls_rva, tls_init_size, mem_size) &&
+               tls_init_size <= tls_size;
+  for (const PlanSegment &segment : segments) {
+    valid = valid && in_image(segment.rva, segment.mem_size, mem_size) &&
+            segment.file_size <= segment.mem_size;
+  }
+  const uint64_t ptr_size = arch.is64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  for (const std::vector<PlanReloc> *list : {&relocs, &plt}) {
+    for (const PlanReloc &reloc : *list) {
+      uint64_t size = ptr_size;
+      switch (reloc.kind) {
+      case PlanReloc::SYMBOL:
+        valid = valid && reloc.symbol < names.size();
+        break;
+      case PlanReloc::COPY:
+        valid = valid && reloc.symbol < names.size() && reloc.addend >= 0;
+        size = static_cast<uint64_t>(reloc.addend);
+        break;
+      case PlanReloc::IRELATIVE:
+        // The resolver is called
+        valid = valid && reloc.addend >= 0 &&
+                static_cast<uint64_t>(reloc.addend) < mem_size;
+        break;
+      case PlanReloc::TLSDESC:
+        size = 2 * ptr_size;
+        break;
+      case PlanReloc::RELATIVE:
+      case PlanReloc::REBASE:
+      case PlanReloc::TLS_MODULE:
+      case PlanReloc::TLS_OFFSET:
+      case PlanReloc::TLS_STATIC:
+        break;
+      default:
+        valid = false;
+      }
+      valid = valid && in_image(reloc.rva, size, mem_size);
+    }
+  }
+  if (!valid) {
+    Logger::debug("{} is corrupted", path);
+  }
+  return valid;
+}
+
+bool RelocPlan::write(std::string const &path) const {
+  Writer w;
+  w.raw(MAGIC, sizeof(MAGIC));
+  w.u32(VERSION);
+  w.str(build_id);
+  w.u32(arch.arch);
+  w.u32(arch.endianness);
+  w.u32(arch.is64);
+  w.u64(imagebase);
+  w.u64(mem_size);
+  w.u64(entrypoint);
+  w.u64(relro_rva);
+  w.u64(relro_size);
+  w.u64(tls_rva);
+  w.u64(tls_init_size);
+  w.u64(tls_size);
+  w.u64(tls_align);
+  w.u64(segments.size());
+  for (const PlanSegment &segment : segments) {
+    w.u64(segment.rva);
+    w.u64(segment.mem_size);
+    w.u64(segment.offset);
+    w.u64(segment.file_size);
+    w.u32(static_cast<uint32_t>(segment.prot));
+  }
+  write_relocs(w, relocs);
+  write_relocs(w, plt);
+  w.u64(names.size());
+  for (const std::string &name : names) {
+    w.str(name);
+  }
+  w.u64(symbols.size());
+  for (const Entry &sym : symbols) {
+    w.str(sym.first);
+    w.u64(sym.second);
+  }
+
+  return replace_file(path, [&w](std::ostream &out) {
+    out.write(w.buf().data(), w.buf().size());
+    return static_cast<bool>(out);
+  });
+}
+
+} // namespace QBDL
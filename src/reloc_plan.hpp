@@ -0,0 +1,138 @@
+#ifndef QBDL_RELOC_PLAN_H_
+#define QBDL_RELOC_PLAN_H_
+
+#include <QBDL/arch.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace LIEF {
+class Symbol;
+}
+
+namespace QBDL {
+
+/** Relocation of a ::QBDL::RelocPlan
+ */
+struct PlanReloc {
+  enum Kind : uint32_t {
+    RELATIVE,   // base + addend
+    REBASE,     // slide + value stored in place
+    SYMBOL,     // symbol + addend
+    COPY,       // copy of the symbol's data, addend being its size
+    IRELATIVE,  // result of the IFUNC resolver at base + addend
+    TLS_MODULE, // TLS module id of the image
+    TLS_OFFSET, // addend, offset in the TLS block of the image
+    TLSDESC,    // TLS descriptor of the variable at offset addend
+    TLS_STATIC, // offset from the thread pointer of addend in the static block
+  };
+
+  uint64_t rva;
+  uint32_t kind;
+  uint32_t symbol; // index in RelocPlan::names, for SYMBOL and COPY
+  int64_t addend;
+};
+
+/** Symbol referenced by a relocation, while compiling a ::QBDL::RelocPlan
+ */
+struct PlanSymbol {
+  std::string_view name;
+  std::string_view version; // required version of imports, empty if none
+  uint64_t size;
+  uint64_t defined; // RVA of its definition in the image, 0 if imported
+  bool ifunc;       // defined as STT_GNU_IFUNC, `defined` being its resolver
+  int64_t tls;      // offset in the TLS block if defined as STT_TLS, or -1
+  const LIEF::Symbol *source; // nullptr if the binary has not been parsed
+};
+
+/** Loadable segment of a ::QBDL::RelocPlan
+ */
+struct PlanSegment {
+  uint64_t rva;
+  uint64_t mem_size;
+  uint64_t offset; // in the file
+  uint64_t file_size;
+  int prot;
+};
+
+/** Base-independent description of how to load and relocate a binary.
+ *
+ * Loaders compile the segments and relocations of a binary into a plan, and
+ * then replay it at the chosen base address. Plans can be persisted next to
+ * their binary (see ::QBDL::TargetSystem::cache_relocation_plans), so that
+ * later loads replay them without parsing the binary at all.
+ */
+struct RelocPlan {
+  using Entry = std::pair<std::string, uint64_t>;
+
+  std::string build_id;
+  Arch arch{LIEF::ARCH_NONE, LIEF::ENDIAN_NONE, false};
+  uint64_t imagebase = 0;
+  uint64_t mem_size = 0;
+  uint64_t entrypoint = 0; // RVA
+
+  std::vector<PlanSegment> segments;
+  uint64_t relro_rva = 0;
+  uint64_t relro_size = 0;
+
+  // TLS template (PT_TLS segment), if tls_size is not 0
+  uint64_t tls_rva = 0;
+  uint64_t tls_init_size = 0;
+  uint64_t tls_size = 0;
+  uint64_t tls_align = 0;
+
+  std::vector<PlanReloc> relocs; // applied at load time
+  std::vector<PlanReloc> plt;    // applied when binding
+  std::vector<std::string> names; // imports, see name_id()
+  std::vector<Entry> symbols; // name -> RVA
+
+  // Set if the image can't run without a relocation that is not supported.
+  // This is not persisted: such images fail to load, and their plans are
+  // never saved.
+  bool incomplete = false;
+
+  // Symbol each name comes from. This is not persisted, so that replayed
+  // plans only give names to ::QBDL::TargetSystem::symlink.
+  std::vector<const LIEF::Symbol *> sources;
+
+  /** Index of the import \p name of version \p version (empty if it is not
+   * versioned) in `names`, which is added if needed. Each (name, version)
+   * pair thus gets a single id, and is resolved once.
+   */
+  uint32_t name_id(std::string_view name, std::string_view version,
+                   const LIEF::Symbol *source);
+
+  /** Entry of `names` for the import \p name of version \p version:
+   * `name@version`, or `name` if \p version is empty.
+   */
+  static std::string versioned_name(std::string_view name,
+                                    std::string_view version);
+
+  /** Split an entry of `names` into its name and version.
+   */
+  static std::pair<std::string_view, std::string_view>
+  split_name(std::string_view entry);
+
+  /** Path of the plan of the binary \p path.
+   */
+  static std::string path(std::string const &binary_path);
+
+  /** Read the plan \p path.
+   *
+   * @returns false if the file is not a valid plan, or if one of its
+   * segments or relocations lies outside of `mem_size`
+   */
+  bool read(std::string const &path);
+  bool write(std::string const &path) const;
+
+private:
+  std::unordered_map<std::string, uint32_t> ids_;
+};
+
+} // namespace QBDL
+
+#endif
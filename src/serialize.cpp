@@ -0,0 +1,39 @@
+#include "serialize.hpp"
+#include "logging.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+namespace QBDL {
+
+bool replace_file(std::string const &path,
+                  std::function<bool(std::ostream &)> const &F) {
+  const std::string tmp_path =
+      path + ".tmp" + std::to_string(std::random_device{}());
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      Logger::warn("Can't create {}", tmp_path);
+      return false;
+    }
+    if (!F(out) || !out) {
+      Logger::warn("Error while writing {}", tmp_path);
+      out.close();
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+#if defined(_WIN32)
+  // rename() does not replace an existing file on Windows
+  std::remove(path.c_str());
+#endif
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    Logger::warn("Can't create {}", path);
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace QBDL
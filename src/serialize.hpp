@@ -0,0 +1,113 @@
+#ifndef QBDL_SERIALIZE_H_
+#define QBDL_SERIALIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace QBDL {
+
+// Cache files are only meant to be read back on the host that wrote them, so
+// integers are stored in host byte order.
+class Writer {
+public:
+  void u32(uint32_t v) { raw(&v, sizeof(v)); }
+  void u64(uint64_t v) { raw(&v, sizeof(v)); }
+  void str(std::string const &s) {
+    u32(static_cast<uint32_t>(s.size()));
+    raw(s.data(), s.size());
+  }
+  void raw(const void *p, size_t len) {
+    const auto *bytes = reinterpret_cast<const char *>(p);
+    buf_.insert(buf_.end(), bytes, bytes + len);
+  }
+  std::vector<char> const &buf() const { return buf_; }
+
+private:
+  std::vector<char> buf_;
+};
+
+// Reads are bounded by the size of the stream: lengths and counts read from
+// a corrupted file fail instead of allocating more than the file holds.
+class Reader {
+public:
+  Reader(std::istream &in) : in_(in) {
+    const std::streampos pos = in_.tellg();
+    in_.seekg(0, std::ios::end);
+    const std::streampos end = in_.tellg();
+    in_.seekg(pos);
+    if (pos >= 0 && end >= pos) {
+      remaining_ = static_cast<uint64_t>(end - pos);
+    } else {
+      in_.setstate(std::ios::failbit);
+    }
+  }
+  uint32_t u32() {
+    uint32_t v = 0;
+    if (take(sizeof(v))) {
+      in_.read(reinterpret_cast<char *>(&v), sizeof(v));
+    }
+    return v;
+  }
+  uint64_t u64() {
+    uint64_t v = 0;
+    if (take(sizeof(v))) {
+      in_.read(reinterpret_cast<char *>(&v), sizeof(v));
+    }
+    return v;
+  }
+  std::string str() {
+    const uint32_t len = u32();
+    if (!take(len)) {
+      return {};
+    }
+    std::string s(len, '\0');
+    in_.read(&s[0], s.size());
+    return s;
+  }
+  /** Check that \p count entries of at least \p entry_size bytes can still
+   * be read, before allocating them.
+   */
+  bool fits(uint64_t count, uint64_t entry_size) {
+    if (count > remaining_ / entry_size) {
+      in_.setstate(std::ios::failbit);
+    }
+    return ok();
+  }
+  uint64_t remaining() const { return remaining_; }
+  bool ok() const { return static_cast<bool>(in_); }
+
+private:
+  bool take(uint64_t len) {
+    if (len > remaining_) {
+      in_.setstate(std::ios::failbit);
+    }
+    if (!ok()) {
+      return false;
+    }
+    remaining_ -= len;
+    return true;
+  }
+
+  std::istream &in_;
+  uint64_t remaining_{0};
+};
+
+/** Replace \p path with the content written by \p F(std::ostream&).
+ *
+ * The file is written under a temporary name and then renamed, so that
+ * concurrent readers never see a partial file, and mappings of the previous
+ * version of the file are left untouched.
+ *
+ * @returns false if the file could not be written, or if \p F returned false
+ */
+bool replace_file(std::string const &path,
+                  std::function<bool(std::ostream &)> const &F);
+
+} // namespace QBDL
+
+#endif
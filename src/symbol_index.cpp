@@ -0,0 +1,35 @@
+#include "symbol_index.hpp"
+
+#include <algorithm>
+
+namespace QBDL {
+
+namespace {
+bool name_less(std::pair<std::string_view, uint64_t> const &a,
+               std::pair<std::string_view, uint64_t> const &b) {
+  return a.first < b.first;
+}
+} // namespace
+
+void SymbolIndex::build() {
+  // Stable, so that the first occurrence of a name is kept
+  std::stable_sort(entries_.begin(), entries_.end(), name_less);
+  entries_.erase(std::unique(entries_.begin(), entries_.end(),
+                             [](auto const &a, auto const &b) {
+                               return a.first == b.first;
+                             }),
+                 entries_.end());
+  entries_.shrink_to_fit();
+}
+
+bool SymbolIndex::find(std::string_view name, uint64_t &value) const {
+  auto it = std::lower_bound(entries_.begin(), entries_.end(),
+                             std::make_pair(name, uint64_t{0}), name_less);
+  if (it == entries_.end() || it->first != name) {
+    return false;
+  }
+  value = it->second;
+  return true;
+}
+
+} // namespace QBDL
@@ -0,0 +1,44 @@
+#ifndef QBDL_SYMBOL_INDEX_H_
+#define QBDL_SYMBOL_INDEX_H_
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace QBDL {
+
+/** Compact name -> value index, looked up by binary search.
+ *
+ * Names are views over strings owned by someone else (usually the LIEF
+ * binary), so that building the index does not allocate a string per
+ * symbol.
+ */
+class SymbolIndex {
+public:
+  /** Add a symbol. If a name is added several times, the first value wins.
+   */
+  void add(std::string_view name, uint64_t value) {
+    entries_.emplace_back(name, value);
+  }
+
+  /** Sort the index. This must be called once every symbol has been added,
+   * and before any call to ::QBDL::SymbolIndex::find.
+   */
+  void build();
+
+  /** Look \p name up.
+   *
+   * @returns true and sets \p value if \p name has been found
+   */
+  bool find(std::string_view name, uint64_t &value) const;
+
+  bool empty() const { return entries_.empty(); }
+
+private:
+  std::vector<std::pair<std::string_view, uint64_t>> entries_;
+};
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,61 @@
+#include "trampoline.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define QBDL_HAS_XSAVE
+#include <cpuid.h>
+#endif
+
+uint32_t _qbdl_xstate_mode = XSTATE_FXSAVE;
+uint64_t _qbdl_xstate_size = 512;
+
+namespace QBDL {
+
+namespace {
+#if defined(QBDL_HAS_XSAVE)
+void select_xstate() {
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE)) {
+    return;
+  }
+  // Components enabled by the OS
+  uint32_t xcr0 = 0, xcr0_high = 0;
+  asm volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+  const uint32_t mask = XSTATE_MASK & xcr0;
+
+  __cpuid_count(0xd, 1, eax, ebx, ecx, edx);
+  const bool compact = (eax & (1 << 1)) != 0;
+
+  // Legacy area and header, followed by the components from the second one:
+  // packed (and some of them aligned on 64 bytes) in the compacted format of
+  // xsavec, at fixed offsets otherwise.
+  uint64_t size = 512 + 64;
+  for (unsigned i = 2; i < 32; ++i) {
+    if (!(mask & (1u << i))) {
+      continue;
+    }
+    __cpuid_count(0xd, i, eax, ebx, ecx, edx);
+    if (!compact) {
+      size = std::max<uint64_t>(size, uint64_t{ebx} + eax);
+      continue;
+    }
+    if (ecx & (1 << 1)) {
+      size = (size + 63) / 64 * 64;
+    }
+    size += eax;
+  }
+  _qbdl_xstate_size = (size + 63) / 64 * 64;
+  _qbdl_xstate_mode = compact ? XSTATE_XSAVEC : XSTATE_XSAVE;
+}
+#else
+void select_xstate() {}
+#endif
+} // namespace
+
+void init_trampolines() {
+  static const bool selected = (select_xstate(), true);
+  (void)selected;
+}
+
+} // namespace QBDL
@@ -0,0 +1,139 @@
+#ifndef QBDL_TRAMPOLINE_H_
+#define QBDL_TRAMPOLINE_H_
+
+// State of the caller saved by the x86-64 trampolines (lazy binding, TLSDESC)
+// around their calls into QBDL. The C++ code it calls may use any vector
+// register (memcpy, malloc, ... end with vzeroupper), so that the whole
+// extended state is saved with xsavec, xsave or fxsave, whichever is the most
+// recent instruction the CPU supports.
+
+// Instruction saving the extended state
+#define XSTATE_FXSAVE 0
+#define XSTATE_XSAVE 1
+#define XSTATE_XSAVEC 2
+
+/* Components saved by xsave, as in the glibc: SSE, AVX, MPX bounds and
+ * AVX-512 (opmasks, upper halves of zmm0-15, zmm16-31). The x87 state is not
+ * used to pass values, and accessing AMX tiles faults in threads that never
+ * asked for them. */
+#define XSTATE_MASK 0xee
+
+#if !defined(__ASSEMBLER__)
+#include <cstdint>
+
+extern "C" {
+// One of the XSTATE_* values, and the size of the save area (a multiple of
+// 64 bytes), read by SAVE_STATE and RESTORE_STATE
+extern uint32_t _qbdl_xstate_mode;
+extern uint64_t _qbdl_xstate_size;
+}
+
+namespace QBDL {
+
+/** Select how the trampolines save the extended state, from the features of
+ * the CPU. It must be called before handing out the address of a trampoline,
+ * and is thread-safe.
+ */
+void init_trampolines();
+
+} // namespace QBDL
+
+#elif defined(__x86_64__)
+
+#if defined(__CET__)
+#define ENDBR endbr64
+#else
+#define ENDBR
+#endif
+
+/* Frame of SAVE_STATE: the scratch registers, then the save area of the
+ * extended state, aligned on 64 bytes. */
+#define STATE_RAX 0
+#define STATE_RCX 8
+#define STATE_RDX 16
+#define STATE_RSI 24
+#define STATE_RDI 32
+#define STATE_R8 40
+#define STATE_R9 48
+#define STATE_R10 56
+#define STATE_R11 64
+#define STATE_XSAVE 128
+
+/* Save the scratch registers and the extended state, %rbx pointing to the
+ * saved %rbx (and %rsp + 8 on entry) afterward. */
+.macro SAVE_STATE
+  pushq %rbx
+  .cfi_adjust_cfa_offset 8
+  .cfi_rel_offset %rbx, 0
+  movq %rsp, %rbx
+  .cfi_def_cfa_register %rbx
+  andq $-64, %rsp
+  subq _qbdl_xstate_size(%rip), %rsp
+  subq $STATE_XSAVE, %rsp
+
+  movq %rax, STATE_RAX(%rsp)
+  movq %rcx, STATE_RCX(%rsp)
+  movq %rdx, STATE_RDX(%rsp)
+  movq %rsi, STATE_RSI(%rsp)
+  movq %rdi, STATE_RDI(%rsp)
+  movq %r8, STATE_R8(%rsp)
+  movq %r9, STATE_R9(%rsp)
+  movq %r10, STATE_R10(%rsp)
+  movq %r11, STATE_R11(%rsp)
+
+  cmpl $XSTATE_FXSAVE, _qbdl_xstate_mode(%rip)
+  jne 1f
+  fxsave STATE_XSAVE(%rsp)
+  jmp 3f
+1:
+  movl $XSTATE_MASK, %eax
+  xorl %edx, %edx
+  /* xrstor faults on garbage in the reserved part of the header */
+  movq %rdx, (STATE_XSAVE + 512 + 8)(%rsp)
+  movq %rdx, (STATE_XSAVE + 512 + 16)(%rsp)
+  movq %rdx, (STATE_XSAVE + 512 + 24)(%rsp)
+  movq %rdx, (STATE_XSAVE + 512 + 32)(%rsp)
+  movq %rdx, (STATE_XSAVE + 512 + 40)(%rsp)
+  movq %rdx, (STATE_XSAVE + 512 + 48)(%rsp)
+  movq %rdx, (STATE_XSAVE + 512 + 56)(%rsp)
+  cmpl $XSTATE_XSAVEC, _qbdl_xstate_mode(%rip)
+  jne 2f
+  xsavec STATE_XSAVE(%rsp)
+  jmp 3f
+2:
+  xsave STATE_XSAVE(%rsp)
+3:
+.endm
+
+/* Restore the state saved by SAVE_STATE, including the scratch registers
+ * written to its frame in between. */
+.macro RESTORE_STATE
+  cmpl $XSTATE_FXSAVE, _qbdl_xstate_mode(%rip)
+  jne 1f
+  fxrstor STATE_XSAVE(%rsp)
+  jmp 2f
+1:
+  movl $XSTATE_MASK, %eax
+  xorl %edx, %edx
+  xrstor STATE_XSAVE(%rsp)
+2:
+  movq STATE_R11(%rsp), %r11
+  movq STATE_R10(%rsp), %r10
+  movq STATE_R9(%rsp), %r9
+  movq STATE_R8(%rsp), %r8
+  movq STATE_RDI(%rsp), %rdi
+  movq STATE_RSI(%rsp), %rsi
+  movq STATE_RDX(%rsp), %rdx
+  movq STATE_RCX(%rsp), %rcx
+  movq STATE_RAX(%rsp), %rax
+
+  movq %rbx, %rsp
+  .cfi_def_cfa_register %rsp
+  popq %rbx
+  .cfi_adjust_cfa_offset -8
+  .cfi_restore %rbx
+.endm
+
+#endif
+
+#endif
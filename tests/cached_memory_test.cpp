@@ -0,0 +1,108 @@
+#include "check.hpp"
+#include "fake_memory.hpp"
+#include <QBDL/engines/Cached.hpp>
+
+#include <vector>
+
+using namespace QBDL;
+using QBDL::Engines::CachedTargetMemory;
+
+namespace {
+
+uint32_t load32(FakeMemory const &mem, uint64_t addr) {
+  uint32_t v = 0;
+  for (size_t i = 0; i < sizeof(v); ++i) {
+    const auto it = mem.bytes.find(addr + i);
+    v |= uint32_t{it != mem.bytes.end() ? it->second : uint8_t{0}} << (8 * i);
+  }
+  return v;
+}
+
+void test_write_back() {
+  FakeMemory backend;
+  CachedTargetMemory mem{backend};
+  CHECK_EQ(mem.mmap(0x10000, 0x8000), 0x10000u);
+
+  // Pages of fresh mappings are zeros: partial writes don't fetch them, and
+  // nothing reaches the backend before the flush
+  const uint32_t value = 0x11223344;
+  mem.write(0x10ffe, &value, sizeof(value));
+  uint32_t read = 0;
+  mem.read(&read, 0x10ffe, sizeof(read));
+  CHECK_EQ(read, value);
+  CHECK_EQ(backend.count("read"), 0u);
+  CHECK_EQ(backend.count("read_batch"), 0u);
+  CHECK_EQ(backend.count("write"), 0u);
+  CHECK_EQ(backend.count("write_batch"), 0u);
+
+  // Contiguous dirty pages are written back as a single span
+  std::vector<uint8_t> page(0x1000, 0xAB);
+  mem.write(0x12000, page.data(), page.size());
+  mem.write(0x15000, &value, sizeof(value));
+  mem.flush();
+  CHECK_EQ(backend.count("write_batch"), 1u);
+  CHECK_EQ(backend.calls.back().op, "write_batch");
+  CHECK_EQ(backend.calls.back().len, 2u);
+  CHECK_EQ(load32(backend, 0x10ffe), value);
+  CHECK_EQ(load32(backend, 0x15000), value);
+  CHECK_EQ(backend.bytes.at(0x12fff), 0xAB);
+  CHECK_EQ(backend.bytes.at(0x10ffd), 0);
+}
+
+void test_partial_fetch() {
+  // Outside of fresh mappings, partially written pages are fetched first so
+  // that the rest of their content is written back untouched
+  FakeMemory backend;
+  const uint32_t before = 0xCAFEBABE;
+  backend.write(0x20000, &before, sizeof(before));
+  backend.calls.clear();
+
+  CachedTargetMemory mem{backend};
+  const uint8_t byte = 0x42;
+  mem.write(0x20010, &byte, 1);
+  CHECK_EQ(backend.count("read_batch"), 1u);
+  mem.flush();
+  CHECK_EQ(load32(backend, 0x20000), before);
+  CHECK_EQ(backend.bytes.at(0x20010), byte);
+}
+
+void test_flush_before_mprotect() {
+  FakeMemory backend;
+  CachedTargetMemory mem{backend};
+  mem.mmap(0x10000, 0x1000);
+  const uint32_t value = 1;
+  mem.write(0x10000, &value, sizeof(value));
+  mem.mprotect(0x10000, 0x1000, TargetMemory::READ);
+  CHECK_EQ(backend.calls.size(), 3u);
+  if (backend.calls.size() == 3) {
+    CHECK_EQ(backend.calls[1].op, "write_batch");
+    CHECK_EQ(backend.calls[2].op, "mprotect");
+  }
+}
+
+void test_release() {
+  // Pending writes to released regions are dropped, the others are written
+  // back on destruction
+  FakeMemory backend;
+  {
+    CachedTargetMemory mem{backend};
+    mem.mmap(0x10000, 0x2000);
+    const uint32_t value = 1;
+    mem.write(0x10000, &value, sizeof(value));
+    mem.write(0x11000, &value, sizeof(value));
+    mem.release(0x10000, 0x1000);
+  }
+  CHECK_EQ(backend.count("write_batch"), 1u);
+  CHECK_EQ(backend.bytes.count(0x10000), 0u);
+  CHECK_EQ(load32(backend, 0x11000), 1u);
+}
+
+} // namespace
+
+int main() {
+  test_write_back();
+  test_partial_fetch();
+  test_flush_before_mprotect();
+  test_release();
+  return check_result();
+}
@@ -0,0 +1,191 @@
+#include "chained_fixups.hpp"
+#include "check.hpp"
+
+#include <cstring>
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+constexpr uint64_t IMAGEBASE = 0x100000000;
+
+template <class T> void put(std::vector<uint8_t> &data, size_t off, T v) {
+  if (data.size() < off + sizeof(v)) {
+    data.resize(off + sizeof(v));
+  }
+  memcpy(&data[off], &v, sizeof(v));
+}
+
+// Fixups of the chain of \p format that starts at the beginning of
+// \p content, mapped at RVA 0x4000
+std::vector<ChainedFixup> chain(uint16_t format,
+                                std::vector<uint64_t> const &content,
+                                bool *valid = nullptr) {
+  std::vector<ChainedFixup> fixups;
+  const bool ok = ChainedFixups::for_each_in_chain(
+      format, reinterpret_cast<const uint8_t *>(content.data()),
+      content.size() * sizeof(uint64_t), 0, 0x4000, IMAGEBASE,
+      [&](ChainedFixup const &fixup) { fixups.push_back(fixup); });
+  if (valid != nullptr) {
+    *valid = ok;
+  }
+  return fixups;
+}
+
+void test_ptr64() {
+  // rebase: target:36 high8:8 reserved:7 next:12 bind:1, then
+  // bind: ordinal:24 addend:8 reserved:19 next:12 bind:1
+  const uint64_t rebase =
+      (IMAGEBASE + 0x1000) | uint64_t{0xAB} << 36 | uint64_t{2} << 51;
+  const uint64_t bind = uint64_t{1} << 63 | uint64_t{3} << 24 | 5;
+  const std::vector<ChainedFixup> fixups =
+      chain(ChainedFixups::PTR_64, {rebase, bind});
+  CHECK_EQ(fixups.size(), 2u);
+  if (fixups.size() != 2) {
+    return;
+  }
+  CHECK(!fixups[0].bind);
+  CHECK_EQ(fixups[0].rva, 0x4000u);
+  CHECK_EQ(fixups[0].target, 0x1000u);
+  CHECK_EQ(fixups[0].high8, 0xAB);
+  CHECK(fixups[1].bind);
+  CHECK_EQ(fixups[1].rva, 0x4008u);
+  CHECK_EQ(fixups[1].ordinal, 5u);
+  CHECK_EQ(fixups[1].addend, 3);
+}
+
+void test_ptr64_offset() {
+  // Targets are offsets from the image base already
+  const std::vector<ChainedFixup> fixups =
+      chain(ChainedFixups::PTR_64_OFFSET, {0x2000});
+  CHECK_EQ(fixups.size(), 1u);
+  CHECK(!fixups.empty() && fixups[0].target == 0x2000);
+
+  // A chain that goes past the end of the content
+  bool valid = true;
+  chain(ChainedFixups::PTR_64_OFFSET, {uint64_t{4} << 51}, &valid);
+  CHECK(!valid);
+}
+
+void test_arm64e() {
+  // auth:1 bind:1 next:11 ..., next counted in 8-byte strides
+  const uint64_t AUTH = uint64_t{1} << 63;
+  const uint64_t BIND = uint64_t{1} << 62;
+  const uint64_t NEXT = uint64_t{1} << 51;
+  const std::vector<uint64_t> content{
+      // rebase: target:43 high8:8, the target being a vmaddr
+      (IMAGEBASE + 0x3000) | uint64_t{0x12} << 43 | NEXT,
+      // bind: ordinal:16 zero:16 addend:19 (signed)
+      BIND | (uint64_t{0x7FFFF & -4} << 32) | 7 | NEXT,
+      // authenticated rebase: target:32, an offset
+      AUTH | 0x5000 | uint64_t{0x3} << 32 | NEXT,
+      // authenticated bind: ordinal:16, no addend
+      AUTH | BIND | 9,
+  };
+  const std::vector<ChainedFixup> fixups =
+      chain(ChainedFixups::PTR_ARM64E, content);
+  CHECK_EQ(fixups.size(), 4u);
+  if (fixups.size() != 4) {
+    return;
+  }
+  CHECK(!fixups[0].bind);
+  CHECK_EQ(fixups[0].target, 0x3000u);
+  CHECK_EQ(fixups[0].high8, 0x12);
+  CHECK(fixups[1].bind);
+  CHECK_EQ(fixups[1].ordinal, 7u);
+  CHECK_EQ(fixups[1].addend, -4);
+  CHECK(!fixups[2].bind);
+  CHECK_EQ(fixups[2].target, 0x5000u);
+  CHECK_EQ(fixups[2].high8, 0);
+  CHECK(fixups[3].bind);
+  CHECK_EQ(fixups[3].ordinal, 9u);
+  CHECK_EQ(fixups[3].addend, 0);
+  CHECK_EQ(fixups[3].rva, 0x4018u);
+
+  // Userland formats store offsets, and USERLAND24 has 24-bit ordinals
+  std::vector<ChainedFixup> userland =
+      chain(ChainedFixups::PTR_ARM64E_USERLAND, {0x3000});
+  CHECK(!userland.empty() && userland[0].target == 0x3000);
+  userland = chain(ChainedFixups::PTR_ARM64E_USERLAND24, {BIND | 0x123456});
+  CHECK(!userland.empty() && userland[0].ordinal == 0x123456);
+}
+
+// Payload with one IMPORT import (_foo from the first library) and two
+// segments, the second one having a chain at 0x10 of its first page
+std::vector<uint8_t> payload() {
+  std::vector<uint8_t> data;
+  put<uint32_t>(data, 0, 0);   // version
+  put<uint32_t>(data, 4, 32);  // starts_offset
+  put<uint32_t>(data, 8, 80);  // imports_offset
+  put<uint32_t>(data, 12, 88); // symbols_offset
+  put<uint32_t>(data, 16, 1);  // imports_count
+  put<uint32_t>(data, 20, 1);  // imports_format
+  put<uint32_t>(data, 24, 0);  // symbols_format
+
+  put<uint32_t>(data, 32, 2);       // seg_count
+  put<uint32_t>(data, 36, 0);       // no fixups in the first segment
+  put<uint32_t>(data, 40, 12);      // -> 44
+  put<uint16_t>(data, 48, 0x4000);  // page_size
+  put<uint16_t>(data, 50, ChainedFixups::PTR_64);
+  put<uint64_t>(data, 52, 0x4000);  // segment_offset
+  put<uint16_t>(data, 64, 1);       // page_count
+  put<uint16_t>(data, 66, 0x10);    // page_start
+
+  put<uint32_t>(data, 80, 1 | 1 << 9);
+  const char names[] = "\0_foo";
+  data.resize(88 + sizeof(names));
+  memcpy(&data[88], names, sizeof(names));
+  return data;
+}
+
+void test_parse() {
+  const std::vector<uint8_t> data = payload();
+  ChainedFixups fixups;
+  CHECK(fixups.parse(data.data(), data.size()));
+  CHECK_EQ(fixups.segments_count(), 2u);
+  CHECK_EQ(fixups.imports().size(), 1u);
+  if (!fixups.imports().empty()) {
+    CHECK(fixups.imports()[0].name == "_foo");
+    CHECK_EQ(fixups.imports()[0].lib_ordinal, 1);
+  }
+
+  std::vector<uint8_t> content(0x4000);
+  put<uint64_t>(content, 0x10, uint64_t{1} << 63);
+  std::vector<uint64_t> rvas;
+  CHECK(fixups.for_each_fixup(1, content.data(), content.size(), IMAGEBASE,
+                              [&](ChainedFixup const &fixup) {
+                                rvas.push_back(fixup.rva);
+                              }));
+  CHECK(rvas == std::vector<uint64_t>{0x4010});
+}
+
+void test_parse_bounds() {
+  // Counts larger than the payload are rejected before allocating
+  std::vector<uint8_t> data = payload();
+  put<uint32_t>(data, 16, 0xFFFFFFFF);
+  ChainedFixups fixups;
+  CHECK(!fixups.parse(data.data(), data.size()));
+
+  data = payload();
+  put<uint32_t>(data, 32, 0x40000000);
+  CHECK(!fixups.parse(data.data(), data.size()));
+
+  data = payload();
+  put<uint16_t>(data, 64, 0xFFFF);
+  CHECK(!fixups.parse(data.data(), data.size()));
+
+  data = payload();
+  put<uint32_t>(data, 8, 0xFFFFFFF0);
+  CHECK(!fixups.parse(data.data(), data.size()));
+}
+
+} // namespace
+
+int main() {
+  test_ptr64();
+  test_ptr64_offset();
+  test_arm64e();
+  test_parse();
+  test_parse_bounds();
+  return check_result();
+}
@@ -0,0 +1,29 @@
+#ifndef QBDL_TESTS_CHECK_H_
+#define QBDL_TESTS_CHECK_H_
+
+#include <cstdio>
+
+// Minimal assertion helpers of the unit tests: each test is an executable
+// that returns non-zero if any check failed.
+inline int check_failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #cond);                                                          \
+      ++check_failures;                                                        \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(lhs, rhs) CHECK((lhs) == (rhs))
+
+inline int check_result() {
+  if (check_failures != 0) {
+    fprintf(stderr, "%d check(s) failed\n", check_failures);
+    return 1;
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "check.hpp"
+#include "elf_file.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+constexpr const char *PATH = "elf_file_test.tmp";
+
+constexpr uint32_t PT_LOAD = 1;
+constexpr uint32_t PT_DYNAMIC = 2;
+constexpr uint32_t PT_NOTE = 4;
+constexpr uint64_t DT_NULL = 0;
+constexpr uint64_t DT_HASH = 4;
+constexpr uint64_t DT_STRTAB = 5;
+constexpr uint64_t DT_SYMTAB = 6;
+constexpr uint64_t DT_RELA = 7;
+constexpr uint64_t DT_RELASZ = 8;
+constexpr uint64_t DT_STRSZ = 10;
+
+// Little-endian ELF64 image, built in memory and written to PATH
+struct Image {
+  std::vector<uint8_t> data;
+
+  explicit Image(size_t size) : data(size) {
+    const uint8_t ident[] = {0x7f, 'E', 'L', 'F', 2, 1, 1};
+    memcpy(data.data(), ident, sizeof(ident));
+    put16(16, 3);  // ET_DYN
+    put16(18, 62); // EM_X86_64
+    put32(20, 1);
+    put64(32, 64); // e_phoff
+    put16(52, 64);
+    put16(54, 56); // e_phentsize
+    put16(58, 64); // e_shentsize
+  }
+
+  void put16(size_t off, uint16_t v) { memcpy(&data[off], &v, sizeof(v)); }
+  void put32(size_t off, uint32_t v) { memcpy(&data[off], &v, sizeof(v)); }
+  void put64(size_t off, uint64_t v) { memcpy(&data[off], &v, sizeof(v)); }
+
+  void phdr(uint32_t type, uint64_t offset, uint64_t vaddr, uint64_t file_size,
+            uint64_t mem_size) {
+    uint16_t phnum = 0;
+    memcpy(&phnum, &data[56], sizeof(phnum));
+    const size_t off = 64 + phnum * 56;
+    put32(off, type);
+    put64(off + 8, offset);
+    put64(off + 16, vaddr);
+    put64(off + 32, file_size);
+    put64(off + 40, mem_size);
+    put16(56, phnum + 1);
+  }
+
+  bool open(ElfFile &file) const {
+    {
+      std::ofstream out(PATH, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+    const bool ret = file.open(PATH);
+    std::remove(PATH);
+    return ret;
+  }
+};
+
+void test_headers() {
+  ElfFile truncated;
+  CHECK(!Image{32}.open(truncated));
+
+  // Program headers past the end of the file
+  Image img{0x100};
+  img.put64(32, 0xf0);
+  img.put16(56, 1);
+  ElfFile phdrs;
+  CHECK(!img.open(phdrs));
+
+  // Section headers past the end of the file are ignored
+  Image sections{0x100};
+  sections.put64(40, 0x1000);
+  sections.put16(60, 4);
+  ElfFile file;
+  CHECK(sections.open(file));
+}
+
+void test_ranges() {
+  Image img{0x200};
+  img.phdr(PT_LOAD, 0, 0x400000, 0x200, 0x1000);
+  ElfFile file;
+  CHECK(img.open(file));
+  CHECK_EQ(file.imagebase(), 0x400000u);
+
+  CHECK(file.content(0x1f0, 0x10) != nullptr);
+  CHECK(file.content(0x200, 0) != nullptr);
+  CHECK(file.content(0x1f0, 0x11) == nullptr);
+  CHECK(file.content(0x201, 0) == nullptr);
+  CHECK(file.content(0x10, ~uint64_t{0}) == nullptr);
+
+  // Only the part of the segment backed by the file can be read
+  CHECK(file.at(0x400000, 0x200) != nullptr);
+  CHECK(file.at(0x4001fc, 8) == nullptr);
+  CHECK(file.at(0x400800, 4) == nullptr);
+  CHECK(file.at(0x3ffffc, 8) == nullptr);
+  CHECK(file.at(0x400010, ~uint64_t{0} - 8) == nullptr);
+}
+
+// Dynamic section at 0x100, hash table at 0x180, symbols at 0x1a0 and
+// strings at 0x1d0
+Image dynamic_image(uint32_t nchain, uint64_t strsz, uint64_t relasz) {
+  Image img{0x200};
+  img.phdr(PT_LOAD, 0, 0, 0x200, 0x200);
+  img.phdr(PT_DYNAMIC, 0x100, 0x100, 0x80, 0x80);
+  const uint64_t dynamic[][2] = {
+      {DT_HASH, 0x180},    {DT_SYMTAB, 0x1a0}, {DT_STRTAB, 0x1d0},
+      {DT_STRSZ, strsz},   {DT_RELA, 0x1e8},   {DT_RELASZ, relasz},
+      {DT_NULL, 0},
+  };
+  for (size_t i = 0; i < sizeof(dynamic) / sizeof(dynamic[0]); ++i) {
+    img.put64(0x100 + i * 16, dynamic[i][0]);
+    img.put64(0x100 + i * 16 + 8, dynamic[i][1]);
+  }
+  img.put32(0x180, 1);
+  img.put32(0x184, nchain);
+  img.put32(0x1a0 + 24, 1); // st_name of the second symbol
+  memcpy(&img.data[0x1d0], "\0foo", 5);
+  return img;
+}
+
+void test_dynamic() {
+  ElfFile file;
+  CHECK(dynamic_image(2, 5, 0x18).open(file));
+  CHECK_EQ(file.nb_dynamic_symbols(), 2u);
+  ElfFile::Symbol sym;
+  CHECK(file.dynamic_symbol(1, sym));
+  CHECK(sym.name == "foo");
+  CHECK(!file.dynamic_symbol(2, sym));
+  std::vector<ElfFile::Reloc> relocs;
+  CHECK(file.relocations(DT_RELA, DT_RELASZ, true, relocs));
+  CHECK_EQ(relocs.size(), 1u);
+
+  // Counts and sizes that don't fit in the file
+  ElfFile huge;
+  CHECK(dynamic_image(0x10000000, 5, 0x1000).open(huge));
+  CHECK_EQ(huge.nb_dynamic_symbols(), 0u);
+  relocs.clear();
+  CHECK(!huge.relocations(DT_RELA, DT_RELASZ, true, relocs));
+  CHECK(relocs.empty());
+
+  // Names out of the string table
+  ElfFile strings;
+  CHECK(dynamic_image(2, 0x100, 0x18).open(strings));
+  CHECK(!strings.dynamic_symbol(1, sym));
+}
+
+void test_build_id() {
+  Image img{0x100};
+  img.phdr(PT_NOTE, 0xc0, 0, 0x20, 0x20);
+  img.put32(0xc0, 4);     // namesz
+  img.put32(0xc0 + 4, 8); // descsz
+  img.put32(0xc0 + 8, 3); // NT_GNU_BUILD_ID
+  memcpy(&img.data[0xcc], "GNU", 4);
+  memcpy(&img.data[0xd0], "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+  ElfFile file;
+  CHECK(img.open(file));
+  CHECK(file.build_id() == "\x01\x02\x03\x04\x05\x06\x07\x08");
+
+  // Description past the end of the note
+  img.put32(0xc0 + 4, 0x20);
+  ElfFile truncated;
+  CHECK(img.open(truncated));
+  CHECK(truncated.build_id().empty());
+}
+
+} // namespace
+
+int main() {
+  test_headers();
+  test_ranges();
+  test_dynamic();
+  test_build_id();
+  return check_result();
+}
@@ -0,0 +1,85 @@
+#ifndef QBDL_TESTS_FAKE_MEMORY_H_
+#define QBDL_TESTS_FAKE_MEMORY_H_
+
+#include <QBDL/Engine.hpp>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** ::QBDL::TargetMemory whose content is a sparse map of bytes (zero by
+ * default), and that records the calls made to it.
+ */
+class FakeMemory : public QBDL::TargetMemory {
+public:
+  struct Call {
+    std::string op;
+    uint64_t addr;
+    size_t len; // number of spans for the batched calls
+    int prot;
+  };
+
+  uint64_t mmap(uint64_t hint, size_t len) override {
+    calls.push_back({"mmap", hint, len, 0});
+    return hint;
+  }
+  uint64_t reserve(uint64_t hint, size_t len) override {
+    calls.push_back({"reserve", hint, len, 0});
+    return hint;
+  }
+  bool commit(uint64_t addr, size_t len, int prot) override {
+    calls.push_back({"commit", addr, len, prot});
+    return true;
+  }
+  bool mprotect(uint64_t addr, size_t len, int prot) override {
+    calls.push_back({"mprotect", addr, len, prot});
+    return true;
+  }
+  void write(uint64_t addr, const void *buf, size_t len) override {
+    calls.push_back({"write", addr, len, 0});
+    store(addr, buf, len);
+  }
+  void read(void *dst, uint64_t addr, size_t len) override {
+    calls.push_back({"read", addr, len, 0});
+    load(dst, addr, len);
+  }
+  void write_batch(std::vector<WriteSpan> const &spans) override {
+    calls.push_back({"write_batch", 0, spans.size(), 0});
+    for (const WriteSpan &span : spans) {
+      store(span.addr, span.buf, span.len);
+    }
+  }
+  void read_batch(std::vector<ReadSpan> const &spans) override {
+    calls.push_back({"read_batch", 0, spans.size(), 0});
+    for (const ReadSpan &span : spans) {
+      load(span.buf, span.addr, span.len);
+    }
+  }
+
+  size_t count(std::string const &op) const {
+    size_t n = 0;
+    for (const Call &call : calls) {
+      n += call.op == op;
+    }
+    return n;
+  }
+
+  std::vector<Call> calls;
+  std::unordered_map<uint64_t, uint8_t> bytes;
+
+private:
+  void store(uint64_t addr, const void *buf, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+      bytes[addr + i] = static_cast<const uint8_t *>(buf)[i];
+    }
+  }
+  void load(void *dst, uint64_t addr, size_t len) const {
+    for (size_t i = 0; i < len; ++i) {
+      const auto it = bytes.find(addr + i);
+      static_cast<uint8_t *>(dst)[i] = it != bytes.end() ? it->second : 0;
+    }
+  }
+};
+
+#endif
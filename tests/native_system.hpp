@@ -0,0 +1,20 @@
+#ifndef QBDL_TESTS_NATIVE_SYSTEM_H_
+#define QBDL_TESTS_NATIVE_SYSTEM_H_
+
+#include <LIEF/LIEF.hpp>
+#include <QBDL/Engine.hpp>
+#include <QBDL/engines/Native.hpp>
+
+#include <dlfcn.h>
+
+// Native target system of the tests that load libraries in the process,
+// whose imports resolve to the symbols of the process
+struct NativeSystem : public QBDL::Engines::Native::TargetSystem {
+  using QBDL::Engines::Native::TargetSystem::TargetSystem;
+
+  uint64_t symlink(QBDL::Loader &, const LIEF::Symbol &sym) override {
+    return reinterpret_cast<uint64_t>(dlsym(RTLD_DEFAULT, sym.name().c_str()));
+  }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "check.hpp"
+#include "packed_relocs.hpp"
+
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+
+void put_word(std::vector<uint8_t> &out, uint64_t v, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+  }
+}
+
+void put_sleb128(std::vector<uint8_t> &out, int64_t v) {
+  bool more = true;
+  while (more) {
+    uint8_t byte = v & 0x7f;
+    v >>= 7;
+    more = !((v == 0 && (byte & 0x40) == 0) || (v == -1 && (byte & 0x40)));
+    out.push_back(more ? byte | 0x80 : byte);
+  }
+}
+
+std::vector<uint64_t> relr(std::vector<uint8_t> const &table, bool is64,
+                           bool *valid = nullptr) {
+  std::vector<uint64_t> offsets;
+  const bool ok = for_each_relr(table.data(), table.size(), is64,
+                                [&](uint64_t off) { offsets.push_back(off); });
+  if (valid != nullptr) {
+    *valid = ok;
+  }
+  return offsets;
+}
+
+void test_relr64() {
+  std::vector<uint8_t> table;
+  put_word(table, 0x1000, 8);
+  // Words 1 and 3 after the address, then the 63rd word of the next bitmap
+  put_word(table, (1 << 1 | 1 << 3) << 1 | 1, 8);
+  put_word(table, uint64_t{1} << 63 | 1, 8);
+  put_word(table, 0x3000, 8);
+
+  const std::vector<uint64_t> expected{0x1000, 0x1010, 0x1020,
+                                       0x1008 + 63 * 8 + 62 * 8, 0x3000};
+  CHECK(relr(table, true) == expected);
+}
+
+void test_relr32() {
+  std::vector<uint8_t> table;
+  put_word(table, 0x2000, 4);
+  put_word(table, 0x3, 4); // bitmap: the word right after the address
+  put_word(table, 0x3, 4); // next bitmap: 31 words further
+  const std::vector<uint64_t> expected{0x2000, 0x2004, 0x2004 + 31 * 4};
+  CHECK(relr(table, false) == expected);
+}
+
+void test_relr_truncated() {
+  std::vector<uint8_t> table;
+  put_word(table, 0x1000, 8);
+  table.resize(12);
+  bool valid = true;
+  const std::vector<uint64_t> offsets = relr(table, true, &valid);
+  CHECK(!valid);
+  CHECK_EQ(offsets.size(), 1u);
+}
+
+std::vector<uint8_t> aps2_header(uint64_t count, uint64_t offset) {
+  std::vector<uint8_t> table{'A', 'P', 'S', '2'};
+  put_sleb128(table, count);
+  put_sleb128(table, offset);
+  return table;
+}
+
+bool aps2(std::vector<uint8_t> const &table, std::vector<PackedReloc> &out) {
+  out.clear();
+  return for_each_aps2(table.data(), table.size(),
+                       [&](PackedReloc const &reloc) { out.push_back(reloc); });
+}
+
+void test_aps2_groups() {
+  constexpr int64_t BY_INFO = 1;
+  constexpr int64_t BY_OFFSET_DELTA = 2;
+  constexpr int64_t BY_ADDEND = 4;
+  constexpr int64_t HAS_ADDEND = 8;
+
+  std::vector<uint8_t> table = aps2_header(6, 0x1000);
+  // Shared offset delta and info, one addend delta per relocation
+  put_sleb128(table, 2);
+  put_sleb128(table, BY_OFFSET_DELTA | BY_INFO | HAS_ADDEND);
+  put_sleb128(table, 8);
+  put_sleb128(table, 0x403);
+  put_sleb128(table, 0x10);
+  put_sleb128(table, -0x8);
+  // Nothing shared, no addend: it is reset
+  put_sleb128(table, 1);
+  put_sleb128(table, 0);
+  put_sleb128(table, 0x100);
+  put_sleb128(table, 7);
+  // Shared addend delta, applied once for the group
+  put_sleb128(table, 3);
+  put_sleb128(table, BY_OFFSET_DELTA | BY_INFO | BY_ADDEND | HAS_ADDEND);
+  put_sleb128(table, 8);
+  put_sleb128(table, 0x401);
+  put_sleb128(table, -0x20);
+
+  std::vector<PackedReloc> relocs;
+  CHECK(aps2(table, relocs));
+  CHECK_EQ(relocs.size(), 6u);
+  if (relocs.size() != 6) {
+    return;
+  }
+  const PackedReloc expected[] = {
+      {0x1008, 0x403, 0x10}, {0x1010, 0x403, 0x8},  {0x1110, 7, 0},
+      {0x1118, 0x401, -0x20}, {0x1120, 0x401, -0x20}, {0x1128, 0x401, -0x20},
+  };
+  for (size_t i = 0; i < relocs.size(); ++i) {
+    CHECK_EQ(relocs[i].offset, expected[i].offset);
+    CHECK_EQ(relocs[i].info, expected[i].info);
+    CHECK_EQ(relocs[i].addend, expected[i].addend);
+  }
+}
+
+void test_aps2_invalid() {
+  std::vector<PackedReloc> relocs;
+  std::vector<uint8_t> table{'A', 'P', 'S', '1', 0, 0};
+  CHECK(!aps2(table, relocs));
+
+  // Group larger than the number of relocations left
+  table = aps2_header(1, 0);
+  put_sleb128(table, 2);
+  put_sleb128(table, 0);
+  CHECK(!aps2(table, relocs));
+  CHECK(relocs.empty());
+
+  // Truncated in the middle of a group
+  table = aps2_header(2, 0);
+  put_sleb128(table, 2);
+  put_sleb128(table, 0);
+  put_sleb128(table, 8);
+  put_sleb128(table, 1);
+  CHECK(!aps2(table, relocs));
+  CHECK_EQ(relocs.size(), 1u);
+}
+
+} // namespace
+
+int main() {
+  test_relr64();
+  test_relr32();
+  test_relr_truncated();
+  test_aps2_groups();
+  test_aps2_invalid();
+  return check_result();
+}
@@ -0,0 +1,59 @@
+#include "check.hpp"
+#include "prelink.hpp"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+
+using namespace QBDL;
+
+namespace {
+constexpr const char *PATH = "prelink_key_test.tmp";
+
+void write_file(std::string const &content) {
+  std::ofstream out(PATH, std::ios::binary | std::ios::trunc);
+  out << content;
+}
+
+// Rewrite PATH with \p content, of the same size, and restore its timestamps
+// as cp -p would.
+void rewrite_keeping_mtime(std::string const &content) {
+  struct stat st;
+  stat(PATH, &st);
+  write_file(content);
+#if defined(__APPLE__)
+  const struct timespec times[2] = {st.st_atimespec, st.st_mtimespec};
+#else
+  const struct timespec times[2] = {st.st_atim, st.st_mtim};
+#endif
+  utimensat(AT_FDCWD, PATH, times, 0);
+}
+} // namespace
+
+int main() {
+  CHECK_EQ(prelink_key("prelink_key_test.missing", ""), 0u);
+
+  write_file("first content");
+  const uint64_t first = prelink_key(PATH, "");
+  CHECK(first != 0);
+  CHECK_EQ(prelink_key(PATH, ""), first);
+
+  // Without a build-id, the content tells the two versions apart
+  rewrite_keeping_mtime("other content");
+  const uint64_t other = prelink_key(PATH, "");
+  CHECK(other != 0);
+  CHECK(other != first);
+
+  // With a build-id, the file isn't read
+  const uint64_t with_id = prelink_key(PATH, "\x01\x02\x03\x04");
+  CHECK(with_id != 0);
+  CHECK(with_id != other);
+  rewrite_keeping_mtime("first content");
+  CHECK_EQ(prelink_key(PATH, "\x01\x02\x03\x04"), with_id);
+  CHECK_EQ(prelink_key(PATH, ""), first);
+
+  remove(PATH);
+  return check_result();
+}
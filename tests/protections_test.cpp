@@ -0,0 +1,111 @@
+#include "check.hpp"
+#include "fake_memory.hpp"
+#include "protections.hpp"
+
+#include <tuple>
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+constexpr int R = TargetMemory::READ;
+constexpr int W = TargetMemory::WRITE;
+constexpr int X = TargetMemory::EXEC;
+constexpr int NONE = TargetMemory::NONE;
+
+using Ranges = std::vector<std::tuple<uint64_t, uint64_t, int>>;
+
+Ranges ranges(Protections const &prots) {
+  Ranges out;
+  prots.for_each([&](uint64_t start, uint64_t end, int prot) {
+    out.emplace_back(start, end, prot);
+  });
+  return out;
+}
+
+void test_shared_pages() {
+  // Segments sharing a page get the union of their protections
+  Protections prots;
+  prots.set(0, 0x5000, NONE);
+  prots.add(0x1000, 0x3000, R | X);
+  prots.add(0x2000, 0x4000, R | W);
+  const Ranges expected{{0, 0x1000, NONE},
+                        {0x1000, 0x2000, R | X},
+                        {0x2000, 0x3000, R | W | X},
+                        {0x3000, 0x4000, R | W},
+                        {0x4000, 0x5000, NONE}};
+  CHECK(ranges(prots) == expected);
+}
+
+void test_add_to_holes() {
+  Protections prots;
+  prots.add(0x1000, 0x2000, R);
+  prots.add(0, 0x3000, W);
+  const Ranges expected{
+      {0, 0x1000, W}, {0x1000, 0x2000, R | W}, {0x2000, 0x3000, W}};
+  CHECK(ranges(prots) == expected);
+}
+
+void test_set_splits() {
+  Protections prots;
+  prots.set(0, 0x3000, R);
+  prots.set(0x1000, 0x2000, R | W);
+  const Ranges expected{
+      {0, 0x1000, R}, {0x1000, 0x2000, R | W}, {0x2000, 0x3000, R}};
+  CHECK(ranges(prots) == expected);
+
+  // Empty ranges are ignored
+  prots.set(0x2000, 0x2000, NONE);
+  prots.add(0x3000, 0x1000, X);
+  CHECK(ranges(prots) == expected);
+}
+
+void test_merge() {
+  // Adjacent ranges with the same protection are applied at once, as for a
+  // RELRO region that ends up with the protection of the text before it
+  Protections prots;
+  prots.set(0, 0x4000, NONE);
+  prots.add(0, 0x1000, R);
+  prots.add(0x1000, 0x3000, R | W);
+  prots.set(0x1000, 0x2000, R);
+  const Ranges expected{
+      {0, 0x2000, R}, {0x2000, 0x3000, R | W}, {0x3000, 0x4000, NONE}};
+  CHECK(ranges(prots) == expected);
+
+  FakeMemory mem;
+  CHECK(prots.apply(mem, 0x10000));
+  CHECK_EQ(mem.calls.size(), 3u);
+  if (mem.calls.size() == 3) {
+    CHECK_EQ(mem.calls[0].addr, 0x10000u);
+    CHECK_EQ(mem.calls[0].len, 0x2000u);
+    CHECK_EQ(mem.calls[0].prot, R);
+    CHECK_EQ(mem.calls[2].addr, 0x13000u);
+    CHECK_EQ(mem.calls[2].prot, NONE);
+  }
+}
+
+void test_commit() {
+  // Inaccessible ranges are left reserved
+  Protections prots;
+  prots.set(0, 0x4000, NONE);
+  prots.add(0x1000, 0x2000, R | X);
+  prots.add(0x2000, 0x3000, R | W);
+  FakeMemory mem;
+  CHECK(prots.commit(mem, 0x10000));
+  CHECK_EQ(mem.count("commit"), 2u);
+  for (const FakeMemory::Call &call : mem.calls) {
+    CHECK(call.prot != NONE);
+    CHECK(call.addr >= 0x11000 && call.addr + call.len <= 0x13000);
+  }
+}
+
+} // namespace
+
+int main() {
+  test_shared_pages();
+  test_add_to_holes();
+  test_set_splits();
+  test_merge();
+  test_commit();
+  return check_result();
+}
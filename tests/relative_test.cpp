@@ -0,0 +1,106 @@
+#include "check.hpp"
+#include "fake_memory.hpp"
+#include "relative.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+const Arch X64{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, true};
+const Arch PPC{LIEF::ARCH_PPC, LIEF::ENDIAN_BIG, false};
+
+using Regions = std::vector<std::pair<uint64_t, uint64_t>>;
+
+// Regions read (and written back) by the last apply()
+Regions regions(FakeMemory const &mem) {
+  Regions out;
+  for (const FakeMemory::Call &call : mem.calls) {
+    if (call.op == "read") {
+      out.emplace_back(call.addr, call.addr + call.len);
+    }
+  }
+  return out;
+}
+
+Regions apply_implicit(std::vector<uint64_t> const &addrs) {
+  FakeMemory mem;
+  RelativeRelocs relocs;
+  for (const uint64_t addr : addrs) {
+    relocs.add_implicit(addr);
+  }
+  relocs.apply(mem, X64, 0x1000);
+  return regions(mem);
+}
+
+void test_gaps() {
+  // Close relocations share a region, even with a gap of almost a page
+  CHECK(apply_implicit({0x1000, 0x1008, 0x1ff8}) ==
+        (Regions{{0x1000, 0x2000}}));
+  CHECK(apply_implicit({0xff8, 0x1ff8}) == (Regions{{0xff8, 0x2000}}));
+  // A whole page between two relocations might not be mapped
+  CHECK(apply_implicit({0xff8, 0x2000}) ==
+        (Regions{{0xff8, 0x1000}, {0x2000, 0x2008}}));
+  CHECK(apply_implicit({0x1000, 0x3000}) ==
+        (Regions{{0x1000, 0x1008}, {0x3000, 0x3008}}));
+}
+
+void test_max_region() {
+  // Large regions are split on a page boundary
+  std::vector<uint64_t> addrs;
+  for (uint64_t addr = 0x10000; addr < 0x10000 + (1 << 20) + 0x800;
+       addr += 8) {
+    addrs.push_back(addr);
+  }
+  CHECK(apply_implicit(addrs) ==
+        (Regions{{0x10000, 0x110000}, {0x110000, 0x110800}}));
+}
+
+void test_values() {
+  FakeMemory mem;
+  const uint64_t initial = 0x4000;
+  mem.write(0x2010, &initial, sizeof(initial));
+
+  RelativeRelocs relocs;
+  // Unsorted, as they may come from several tables
+  relocs.add_implicit(0x2010);
+  relocs.add(0x2008, 0x123456789);
+  relocs.add(0x2000, 0x42);
+  relocs.apply(mem, X64, 0x10000);
+  CHECK_EQ(relocs.size(), 0u);
+
+  uint64_t values[3] = {};
+  mem.read(values, 0x2000, sizeof(values));
+  CHECK_EQ(values[0], 0x42u);
+  CHECK_EQ(values[1], 0x123456789u);
+  CHECK_EQ(values[2], 0x14000u);
+}
+
+void test_big_endian32() {
+  FakeMemory mem;
+  const uint8_t initial[4] = {0x00, 0x00, 0x10, 0x00};
+  mem.write(0x3000, initial, sizeof(initial));
+
+  RelativeRelocs relocs;
+  relocs.add_implicit(0x3000);
+  relocs.add(0x3004, 0x11223344);
+  relocs.apply(mem, PPC, 0x20000);
+
+  uint8_t out[8] = {};
+  mem.read(out, 0x3000, sizeof(out));
+  const uint8_t expected[8] = {0x00, 0x02, 0x10, 0x00,
+                               0x11, 0x22, 0x33, 0x44};
+  CHECK(std::equal(out, out + 8, expected));
+}
+
+} // namespace
+
+int main() {
+  test_gaps();
+  test_max_region();
+  test_values();
+  test_big_endian32();
+  return check_result();
+}
@@ -0,0 +1,7 @@
+// Library built with -ftls-model=initial-exec: its thread-local variables are
+// accessed at a fixed offset from the thread pointer (R_*_TPOFF64 and
+// R_AARCH64_TLS_TPREL64 relocations)
+
+static thread_local int counter;
+
+extern "C" int static_tls_next() { return ++counter; }
@@ -0,0 +1,53 @@
+#include "check.hpp"
+#include "native_system.hpp"
+#include <QBDL/loaders/ELF.hpp>
+
+#include <atomic>
+#include <thread>
+
+using namespace QBDL;
+
+namespace {
+using next_t = int (*)();
+
+void count_twice(next_t next) {
+  if (next != nullptr) {
+    CHECK_EQ(next(), 1);
+    CHECK_EQ(next(), 2);
+  }
+}
+} // namespace
+
+// The variables of the library are per-thread, in the threads that existed
+// when it was loaded as well as in the later ones.
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <static_tls_lib>\n", argv[0]);
+    return 1;
+  }
+  Engines::Native::TargetMemory mem;
+  NativeSystem system{mem};
+
+  std::atomic<bool> loaded{false};
+  next_t next = nullptr;
+  std::thread before([&] {
+    while (!loaded) {
+      std::this_thread::yield();
+    }
+    count_twice(next);
+  });
+  std::unique_ptr<Loaders::ELF> loader =
+      Loaders::ELF::from_file(argv[1], system, Loader::BIND::NOW);
+  CHECK(loader != nullptr);
+  if (loader != nullptr) {
+    next = reinterpret_cast<next_t>(loader->get_address("static_tls_next"));
+  }
+  CHECK(next != nullptr);
+  loaded = true;
+  before.join();
+
+  count_twice(next);
+  std::thread after([&] { count_twice(next); });
+  after.join();
+  return check_result();
+}
@@ -0,0 +1,15 @@
+// Library linked with -z notext, whose text segment holds a pointer that is
+// relocated when the library is loaded (text relocation)
+
+extern "C" {
+__attribute__((visibility("hidden"))) int textrel_value = 42;
+__attribute__((visibility("hidden"))) extern int *const textrel_ptr;
+
+int textrel_answer() { return *textrel_ptr; }
+}
+
+asm(".text\n"
+    ".p2align 3\n"
+    ".hidden textrel_ptr\n"
+    "textrel_ptr:\n"
+    ".quad textrel_value\n");
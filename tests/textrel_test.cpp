@@ -0,0 +1,42 @@
+#include "check.hpp"
+#include "native_system.hpp"
+#include <LIEF/ELF.hpp>
+#include <QBDL/loaders/ELF.hpp>
+
+using namespace QBDL;
+
+namespace {
+
+void check_loaded(std::unique_ptr<Loaders::ELF> const &loader) {
+  CHECK(loader != nullptr);
+  if (loader == nullptr) {
+    return;
+  }
+  const auto answer =
+      reinterpret_cast<int (*)()>(loader->get_address("textrel_answer"));
+  CHECK(answer != nullptr);
+  if (answer != nullptr) {
+    CHECK_EQ(answer(), 42);
+  }
+}
+
+} // namespace
+
+// The relocated pointer is in a read-only segment: it must be mapped
+// writable until the relocations are applied, whichever way the library is
+// loaded.
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <textrel_lib>\n", argv[0]);
+    return 1;
+  }
+  const char *path = argv[1];
+  Engines::Native::TargetMemory mem;
+  NativeSystem system{mem};
+  for (const Loader::BIND binding : {Loader::BIND::NOW, Loader::BIND::LAZY}) {
+    check_loaded(Loaders::ELF::from_file(path, system, binding));
+  }
+  check_loaded(Loaders::ELF::from_binary(LIEF::ELF::Parser::parse(path),
+                                         system, Loader::BIND::NOW));
+  return check_result();
+}